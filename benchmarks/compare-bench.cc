@@ -0,0 +1,318 @@
+#include <fnmatch.h>
+
+// glob(3) has the same name of the glob namespace, so the function is
+// declared with another name and linked with the symbol from libc
+#define glob glob_libc_decl
+#include <glob.h>
+#undef glob
+extern "C" int LibcGlob(const char* pattern, int flags,
+    int (*errfunc)(const char*, int), glob_t* pglob) __asm__("glob");
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "glob-cpp/file-glob.h"
+#include "tree-generator.h"
+
+namespace {
+
+namespace fs = boost::filesystem;
+
+// each pattern has the equivalent ECMAScript regex, and the fnmatch flags
+// needed to understand it
+struct CompareCase {
+  const char* pattern;
+  const char* regex;
+  int fnmatch_flags;
+};
+
+const CompareCase kCompareCases[] = {
+  {"main.cc",                    "main\\.cc",                           0},
+  {"*.txt",                      ".*\\.txt",                            0},
+  {"*.tar.gz",                   ".*\\.tar\\.gz",                       0},
+  {"*_[0-9][0-9].?",             ".*_[0-9][0-9]\\..",                   0},
+  {"[a-z]*[!0-9].[ch]",          "[a-z].*[^0-9]\\.[ch]",                0},
+  {"*a*e*i*o*u*",                ".*a.*e.*i.*o.*u.*",                   0},
+  {"+([a-z0-9_]).@(txt|pdf|md)", "[a-z0-9_]+\\.(?:txt|pdf|md)", FNM_EXTMATCH},
+  {"*.@(c|cc|h)",                ".*\\.(?:c|cc|h)",               FNM_EXTMATCH},
+};
+
+const size_t kNumCompareCases = sizeof(kCompareCases)/sizeof(kCompareCases[0]);
+
+// the corpus looks like file names, with some of them designed to match
+// each pattern of the table above
+const std::vector<std::string>& GetCorpus() {
+  static std::vector<std::string> corpus;
+  if (!corpus.empty()) {
+    return corpus;
+  }
+
+  const char* exts[] = {".txt", ".tar.gz", ".c", ".cc", ".h", ".md", ".pdf",
+      ".o", ""};
+  const size_t num_exts = sizeof(exts)/sizeof(exts[0]);
+  std::mt19937 rand(42);
+
+  for (size_t i = 0; i < 4096; i++) {
+    std::string name;
+    size_t len = 3 + rand() % 24;
+    for (size_t j = 0; j < len; j++) {
+      name += "abcdefghijklmnopqrstuvwxyz_0123456789"[rand() % 37];
+    }
+    corpus.push_back(name + exts[rand() % num_exts]);
+  }
+
+  corpus.push_back("main.cc");
+  corpus.push_back("file_42.c");
+  corpus.push_back("facetious_ou.txt");
+  return corpus;
+}
+
+std::vector<bool> GlobCppResults(const CompareCase& cc) {
+  glob::glob g(cc.pattern);
+  std::vector<bool> res;
+  for (auto& str : GetCorpus()) {
+    res.push_back(glob::glob_match(str, g));
+  }
+
+  return res;
+}
+
+std::vector<bool> FnmatchResults(const CompareCase& cc) {
+  std::vector<bool> res;
+  for (auto& str : GetCorpus()) {
+    res.push_back(fnmatch(cc.pattern, str.c_str(), cc.fnmatch_flags) == 0);
+  }
+
+  return res;
+}
+
+std::vector<bool> RegexResults(const CompareCase& cc) {
+  std::regex re(cc.regex);
+  std::vector<bool> res;
+  for (auto& str : GetCorpus()) {
+    res.push_back(std::regex_match(str, re));
+  }
+
+  return res;
+}
+
+// all engines must agree with fnmatch, that is the reference here, when they
+// don't, the numbers of the benchmark doesn't mean anything
+bool CheckAgreement(benchmark::State& state, const CompareCase& cc,
+    const std::vector<bool>& res) {
+  std::vector<bool> ref = FnmatchResults(cc);
+  size_t mismatches = 0;
+  for (size_t i = 0; i < ref.size(); i++) {
+    if (ref[i] != res[i]) {
+      mismatches++;
+    }
+  }
+
+  state.counters["matches"] = static_cast<double>(
+      std::count(ref.begin(), ref.end(), true));
+
+  if (mismatches > 0) {
+    state.SkipWithError(("results differ from fnmatch in " +
+        std::to_string(mismatches) + " inputs").c_str());
+    return false;
+  }
+
+  return true;
+}
+
+// ns of fnmatch over the whole corpus, used as baseline for the relative
+// throughput of the other engines
+double FnmatchBaseline(const CompareCase& cc) {
+  const int passes = 8;
+  auto& corpus = GetCorpus();
+  size_t count = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < passes; i++) {
+    for (auto& str : corpus) {
+      count += fnmatch(cc.pattern, str.c_str(), cc.fnmatch_flags) == 0;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  benchmark::DoNotOptimize(count);
+  return std::chrono::duration<double, std::nano>(end - start).count() / passes;
+}
+
+void SetCompareCounters(benchmark::State& state, const CompareCase& cc,
+    double baseline) {
+  size_t num_inputs = GetCorpus().size();
+  state.SetItemsProcessed(state.iterations() * num_inputs);
+  state.SetLabel(cc.pattern);
+
+  // the time of one pass over the corpus, it is compared with the time of
+  // fnmatch measured before the benchmark, values bigger than 1 mean faster
+  // than fnmatch
+  state.counters["vs_fnmatch"] = benchmark::Counter(
+      baseline * state.iterations() / 1e9,
+      benchmark::Counter::kIsRate);
+}
+
+void BM_GlobCpp(benchmark::State& state) {
+  const CompareCase& cc = kCompareCases[state.range(0)];
+  if (!CheckAgreement(state, cc, GlobCppResults(cc))) {
+    return;
+  }
+
+  double baseline = FnmatchBaseline(cc);
+  glob::glob g(cc.pattern);
+  auto& corpus = GetCorpus();
+
+  for (auto _ : state) {
+    size_t count = 0;
+    for (auto& str : corpus) {
+      count += glob::glob_match(str, g);
+    }
+    benchmark::DoNotOptimize(count);
+  }
+
+  SetCompareCounters(state, cc, baseline);
+}
+
+void BM_Fnmatch(benchmark::State& state) {
+  const CompareCase& cc = kCompareCases[state.range(0)];
+  double baseline = FnmatchBaseline(cc);
+  auto& corpus = GetCorpus();
+
+  for (auto _ : state) {
+    size_t count = 0;
+    for (auto& str : corpus) {
+      count += fnmatch(cc.pattern, str.c_str(), cc.fnmatch_flags) == 0;
+    }
+    benchmark::DoNotOptimize(count);
+  }
+
+  SetCompareCounters(state, cc, baseline);
+}
+
+void BM_Regex(benchmark::State& state) {
+  const CompareCase& cc = kCompareCases[state.range(0)];
+  if (!CheckAgreement(state, cc, RegexResults(cc))) {
+    return;
+  }
+
+  double baseline = FnmatchBaseline(cc);
+  std::regex re(cc.regex);
+  auto& corpus = GetCorpus();
+
+  for (auto _ : state) {
+    size_t count = 0;
+    for (auto& str : corpus) {
+      count += std::regex_match(str, re);
+    }
+    benchmark::DoNotOptimize(count);
+  }
+
+  SetCompareCounters(state, cc, baseline);
+}
+
+void CompareArgs(benchmark::internal::Benchmark* b) {
+  for (size_t i = 0; i < kNumCompareCases; i++) {
+    b->Arg(static_cast<int>(i));
+  }
+}
+
+// file globs are compared with glob(3), the paths are normalized without the
+// leading "./" that FileGlog returns for relative patterns
+const char* kFileGlobPatterns[] = {
+  "*.c",
+  "*/*.h",
+  "a/*/*.c",
+  "[ab]/*/[!a]*.cc",
+};
+
+const bench::TempTree& GetTree() {
+  static bench::TempTree tree{bench::TreeOptions{}};
+  return tree;
+}
+
+std::vector<std::string> FileGlobPaths(const char* pattern) {
+  glob::file_glob fglob{pattern};
+  std::vector<std::string> paths;
+  for (auto& res : fglob.Exec()) {
+    std::string path = res.path().string();
+    if (path.compare(0, 2, "./") == 0) {
+      path = path.substr(2);
+    }
+    paths.push_back(path);
+  }
+
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+std::vector<std::string> LibcGlobPaths(const char* pattern) {
+  glob_t g;
+  std::vector<std::string> paths;
+  if (LibcGlob(pattern, 0, nullptr, &g) == 0) {
+    for (size_t i = 0; i < g.gl_pathc; i++) {
+      paths.push_back(g.gl_pathv[i]);
+    }
+  }
+  globfree(&g);
+
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+void BM_FileGlob(benchmark::State& state) {
+  const char* pattern = kFileGlobPatterns[state.range(0)];
+  fs::path old_path = fs::current_path();
+  fs::current_path(GetTree().Root());
+  state.SetLabel(pattern);
+
+  if (FileGlobPaths(pattern) != LibcGlobPaths(pattern)) {
+    state.SkipWithError("results differ from glob(3)");
+  } else {
+    for (auto _ : state) {
+      glob::file_glob fglob{pattern};
+      auto results = fglob.Exec();
+      benchmark::DoNotOptimize(results.data());
+    }
+  }
+
+  fs::current_path(old_path);
+}
+
+void BM_LibcGlob(benchmark::State& state) {
+  const char* pattern = kFileGlobPatterns[state.range(0)];
+  fs::path old_path = fs::current_path();
+  fs::current_path(GetTree().Root());
+  state.SetLabel(pattern);
+
+  for (auto _ : state) {
+    glob_t g;
+    LibcGlob(pattern, 0, nullptr, &g);
+    benchmark::DoNotOptimize(g.gl_pathc);
+    globfree(&g);
+  }
+
+  fs::current_path(old_path);
+}
+
+void FileGlobArgs(benchmark::internal::Benchmark* b) {
+  for (size_t i = 0; i < sizeof(kFileGlobPatterns)/sizeof(char*); i++) {
+    b->Arg(static_cast<int>(i));
+  }
+  b->Unit(benchmark::kMicrosecond);
+}
+
+}  // namespace
+
+BENCHMARK(BM_GlobCpp)->Apply(CompareArgs);
+BENCHMARK(BM_Fnmatch)->Apply(CompareArgs);
+BENCHMARK(BM_Regex)->Apply(CompareArgs);
+
+BENCHMARK(BM_FileGlob)->Apply(FileGlobArgs);
+BENCHMARK(BM_LibcGlob)->Apply(FileGlobArgs);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "glob-cpp/glob.h"
+#include "glob-cpp/glob-batch.h"
+#include "glob-cpp/glob-cache.h"
+#include "glob-cpp/glob-grep.h"
+#include "glob-cpp/glob-parallel.h"
+#include "glob-cpp/glob-serialize.h"
+#include "glob-cpp/path-index.h"
+
+// the allocations of the program are counted, so the compile benchmarks
+// report how many allocations each compile does
+static size_t g_num_allocs = 0;
+
+void* operator new(size_t size) {
+  g_num_allocs++;
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+// gcc sees free on memory from new when it inlines these operators
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+#pragma GCC diagnostic pop
+
+namespace {
+
+// the same patterns are used for compile and match benchmarks, each one
+// represents a family of glob that we care about
+struct PatternCase {
+  const char* name;
+  const char* pattern;
+};
+
+const PatternCase kPatterns[] = {
+  {"literal",    "glob-str-test.cc"},
+  {"star_ext",   "*.txt"},
+  {"set_heavy",  "[a-z][a-z0-9_]*[0-9][0-9].[ch]"},
+  {"extglob",    "+([a-z0-9_]).@(txt|pdf|md)"},
+  {"pathological", "*a*a*a*a*b"},
+  {"segments",   "*foo*bar*.log"},
+};
+
+enum PatternIndex {
+  LITERAL = 0,
+  STAR_EXT,
+  SET_HEAVY,
+  EXTGLOB,
+  PATHOLOGICAL,
+  SEGMENTS
+};
+
+template<class charT>
+glob::String<charT> Widen(const std::string& str) {
+  return glob::String<charT>(str.begin(), str.end());
+}
+
+// generates an input of exactly len chars for the given pattern family,
+// all inputs match their pattern except the pathological one, that is
+// built to walk the whole string before failing, len must not be less than
+// the fixed end of the input, 4 chars, or 10 chars for segments
+std::string GenInput(PatternIndex index, size_t len) {
+  std::string filler;
+  for (size_t i = 0; filler.length() < len; i++) {
+    filler += static_cast<char>('a' + (i * 7) % 26);
+  }
+
+  switch (index) {
+    case LITERAL:
+      return filler.substr(0, len);
+
+    case STAR_EXT:
+      return filler.substr(0, len - 4) + ".txt";
+
+    case SET_HEAVY:
+      return filler.substr(0, len - 4) + "42.c";
+
+    case EXTGLOB:
+      return filler.substr(0, len - 4) + ".pdf";
+
+    case PATHOLOGICAL:
+      return std::string(len, 'a');
+
+    case SEGMENTS:
+      return filler.substr(0, len - 10) + "foobar.log";
+  }
+
+  return filler;
+}
+
+std::string GenPattern(PatternIndex index, size_t len) {
+  // a literal pattern only makes sense with the same length of the input
+  if (index == LITERAL) {
+    return GenInput(LITERAL, len);
+  }
+
+  return kPatterns[index].pattern;
+}
+
+template<class charT>
+void BM_Lexer(benchmark::State& state) {
+  auto pattern = Widen<charT>(kPatterns[state.range(0)].pattern);
+  state.SetLabel(kPatterns[state.range(0)].name);
+
+  for (auto _ : state) {
+    glob::Lexer<charT> l(pattern);
+    auto tokens = l.Scanner();
+    benchmark::DoNotOptimize(tokens.data());
+  }
+}
+
+template<class charT>
+void BM_Parser(benchmark::State& state) {
+  auto pattern = Widen<charT>(kPatterns[state.range(0)].pattern);
+  state.SetLabel(kPatterns[state.range(0)].name);
+
+  glob::Lexer<charT> l(pattern);
+  std::vector<glob::Token<charT>> tokens = l.Scanner();
+
+  for (auto _ : state) {
+    // the parser takes the ownership of the tokens, so the copy is part of
+    // the measure, it is small compared with the allocations of the ast
+    glob::Parser<charT> p(std::vector<glob::Token<charT>>{tokens});
+    auto ast = p.GenAst();
+    benchmark::DoNotOptimize(ast.get());
+  }
+}
+
+template<class charT>
+void BM_AstConsumer(benchmark::State& state) {
+  auto pattern = Widen<charT>(kPatterns[state.range(0)].pattern);
+  state.SetLabel(kPatterns[state.range(0)].name);
+
+  glob::Lexer<charT> l(pattern);
+  glob::Parser<charT> p(l.Scanner());
+  auto ast = p.GenAst();
+
+  for (auto _ : state) {
+    glob::Automata<charT> automata;
+    glob::AstConsumer<charT> ast_consumer;
+    ast_consumer.GenAutomata(ast.get(), automata);
+    benchmark::DoNotOptimize(automata.GetNumStates());
+  }
+}
+
+template<class charT>
+void BM_Compile(benchmark::State& state) {
+  auto pattern = Widen<charT>(kPatterns[state.range(0)].pattern);
+  state.SetLabel(kPatterns[state.range(0)].name);
+
+  size_t num_allocs = g_num_allocs;
+  for (auto _ : state) {
+    glob::basic_glob<charT> g(pattern);
+    benchmark::DoNotOptimize(g.GetAutomata().GetNumStates());
+  }
+
+  state.counters["allocs"] = benchmark::Counter(
+      static_cast<double>(g_num_allocs - num_allocs),
+      benchmark::Counter::kAvgIterations);
+}
+
+// the cost of a pattern that is already in the cache, to compare with the
+// compile of BM_Compile
+template<class charT>
+void BM_CachedCompile(benchmark::State& state) {
+  auto pattern = Widen<charT>(kPatterns[state.range(0)].pattern);
+  state.SetLabel(kPatterns[state.range(0)].name);
+
+  glob::GlobCache<charT> cache;
+  for (auto _ : state) {
+    auto g = cache.Get(pattern);
+    benchmark::DoNotOptimize(g.get());
+  }
+
+  auto stats = cache.GetStats();
+  state.counters["hits"] = static_cast<double>(stats.hits);
+  state.counters["misses"] = static_cast<double>(stats.misses);
+}
+
+// builds the glob from its serialized form, to compare with BM_Compile
+template<class charT>
+void BM_Load(benchmark::State& state) {
+  auto pattern = Widen<charT>(kPatterns[state.range(0)].pattern);
+  state.SetLabel(kPatterns[state.range(0)].name);
+
+  glob::GlobWriter<charT> writer;
+  writer.Add(pattern);
+  std::string data = writer.Data();
+  glob::GlobFile<charT> file(data.data(), data.size());
+
+  for (auto _ : state) {
+    auto g = file.Load(0);
+    benchmark::DoNotOptimize(g.GetAutomata().GetNumStates());
+  }
+
+  state.counters["bytes"] = static_cast<double>(data.size());
+}
+
+template<class charT>
+void BM_Match(benchmark::State& state) {
+  PatternIndex index = static_cast<PatternIndex>(state.range(0));
+  size_t len = static_cast<size_t>(state.range(1));
+  state.SetLabel(kPatterns[index].name);
+
+  glob::basic_glob<charT> g(Widen<charT>(GenPattern(index, len)));
+  auto input = Widen<charT>(GenInput(index, len));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(glob::glob_match(input, g));
+  }
+
+  state.SetBytesProcessed(state.iterations() * len * sizeof(charT));
+}
+
+// a manifest of paths separated by '\n', some of them match each pattern
+std::string GenManifest(size_t num_lines) {
+  const char* kExts[] = {".txt", ".c", ".pdf", ".log", ".md", ".cc"};
+  std::string manifest;
+  for (size_t i = 0; i < num_lines; i++) {
+    manifest += "src/module_" + std::to_string(i % 97) + "/foo_" +
+        std::to_string(i) + (i % 5 == 0 ? "_bar" : "") + kExts[i % 6] + "\n";
+  }
+
+  return manifest;
+}
+
+constexpr size_t kManifestLines = 10000;
+
+// one glob_match for each line, the way a caller without the batch api
+// filters a manifest
+void BM_ManifestLoop(benchmark::State& state) {
+  PatternIndex index = static_cast<PatternIndex>(state.range(0));
+  state.SetLabel(kPatterns[index].name);
+  glob::glob g(kPatterns[index].pattern);
+  std::string manifest = GenManifest(kManifestLines);
+
+  for (auto _ : state) {
+    size_t num_matches = 0;
+    size_t pos = 0;
+    while (pos < manifest.size()) {
+      size_t next = manifest.find('\n', pos);
+      num_matches += glob::glob_match(manifest.substr(pos, next - pos), g);
+      pos = next + 1;
+    }
+    benchmark::DoNotOptimize(num_matches);
+  }
+
+  state.SetItemsProcessed(state.iterations() * kManifestLines);
+}
+
+void BM_ManifestPacked(benchmark::State& state) {
+  PatternIndex index = static_cast<PatternIndex>(state.range(0));
+  state.SetLabel(kPatterns[index].name);
+  glob::glob g(kPatterns[index].pattern);
+  std::string manifest = GenManifest(kManifestLines);
+  std::vector<bool> out;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(glob::glob_match_packed(g, manifest.data(),
+        manifest.size(), '\n', out));
+  }
+
+  state.SetItemsProcessed(state.iterations() * kManifestLines);
+}
+
+// the lines are found with the scanner of delims and matched in place, the
+// allocations of the loop are reported, they don't grow with the lines
+void BM_ManifestGrep(benchmark::State& state) {
+  PatternIndex index = static_cast<PatternIndex>(state.range(0));
+  state.SetLabel(kPatterns[index].name);
+  glob::glob g(kPatterns[index].pattern);
+  std::string manifest = GenManifest(kManifestLines);
+  size_t num_allocs = g_num_allocs;
+
+  for (auto _ : state) {
+    size_t bytes = 0;
+    glob::glob_grep(g, manifest.data(), manifest.size(),
+        [&bytes](const glob::LineMatch<char>& line) { bytes += line.size; });
+    benchmark::DoNotOptimize(bytes);
+  }
+
+  state.counters["allocs"] = benchmark::Counter(
+      static_cast<double>(g_num_allocs - num_allocs),
+      benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(state.iterations() * kManifestLines);
+}
+
+// the manifest split by parallel_filter over a pool of range(1) threads, it
+// only scales with the cores of the machine
+void BM_ParallelFilter(benchmark::State& state) {
+  PatternIndex index = static_cast<PatternIndex>(state.range(0));
+  size_t num_threads = static_cast<size_t>(state.range(1));
+  state.SetLabel(kPatterns[index].name);
+  glob::shared_glob<char> g(kPatterns[index].pattern);
+  std::string manifest = GenManifest(kManifestLines * 10);
+  glob::ThreadPool pool(num_threads);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(glob::parallel_filter(g, manifest.data(),
+        manifest.size(), '\n', pool));
+  }
+
+  state.SetItemsProcessed(state.iterations() * kManifestLines * 10);
+}
+
+// path globs over the manifest, a literal directory, a wildcard directory
+// with a literal prefix in the name, and "**"
+const char* kPathPatterns[] = {"src/module_7/*.c", "src/*/foo_1*_bar.*",
+    "**/*.md"};
+
+// a glob in path mode over each line of the manifest
+void BM_PathScan(benchmark::State& state) {
+  const char* pattern = kPathPatterns[state.range(0)];
+  state.SetLabel(pattern);
+  glob::glob g(pattern, glob::GlobOptions().SetPathMode(true));
+  std::string manifest = GenManifest(kManifestLines);
+
+  for (auto _ : state) {
+    size_t num_matches = 0;
+    glob::glob_grep(g, manifest.data(), manifest.size(),
+        [&num_matches](const glob::LineMatch<char>&) { num_matches++; });
+    benchmark::DoNotOptimize(num_matches);
+  }
+
+  state.SetItemsProcessed(state.iterations() * kManifestLines);
+}
+
+// the same globs over a PathIndex of the manifest, the index is built once
+void BM_PathIndex(benchmark::State& state) {
+  const char* pattern = kPathPatterns[state.range(0)];
+  state.SetLabel(pattern);
+  std::string manifest = GenManifest(kManifestLines);
+  glob::path_index index(manifest.data(), manifest.size());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(index.Glob(pattern, [](size_t) {}));
+  }
+
+  state.SetItemsProcessed(state.iterations() * kManifestLines);
+}
+
+void BM_PathIndexBuild(benchmark::State& state) {
+  std::string manifest = GenManifest(kManifestLines);
+
+  for (auto _ : state) {
+    glob::path_index index(manifest.data(), manifest.size());
+    benchmark::DoNotOptimize(index.Size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * kManifestLines);
+}
+
+void CompileArgs(benchmark::internal::Benchmark* b) {
+  for (int i = LITERAL; i <= SEGMENTS; i++) {
+    b->Arg(i);
+  }
+}
+
+void MatchArgs(benchmark::internal::Benchmark* b) {
+  for (int i = LITERAL; i <= SEGMENTS; i++) {
+    for (int len = 8; len <= 4096; len *= 8) {
+      // "foobar.log" doesn't fit in 8 chars
+      b->Args({i, i == SEGMENTS ? std::max(len, 10) : len});
+    }
+  }
+}
+
+}  // namespace
+
+BENCHMARK_TEMPLATE(BM_Lexer, char)->Apply(CompileArgs);
+BENCHMARK_TEMPLATE(BM_Lexer, wchar_t)->Apply(CompileArgs);
+BENCHMARK_TEMPLATE(BM_Parser, char)->Apply(CompileArgs);
+BENCHMARK_TEMPLATE(BM_Parser, wchar_t)->Apply(CompileArgs);
+BENCHMARK_TEMPLATE(BM_AstConsumer, char)->Apply(CompileArgs);
+BENCHMARK_TEMPLATE(BM_AstConsumer, wchar_t)->Apply(CompileArgs);
+BENCHMARK_TEMPLATE(BM_Compile, char)->Apply(CompileArgs);
+BENCHMARK_TEMPLATE(BM_Compile, wchar_t)->Apply(CompileArgs);
+BENCHMARK_TEMPLATE(BM_CachedCompile, char)->Apply(CompileArgs);
+BENCHMARK_TEMPLATE(BM_CachedCompile, wchar_t)->Apply(CompileArgs);
+BENCHMARK_TEMPLATE(BM_Load, char)->Apply(CompileArgs);
+BENCHMARK_TEMPLATE(BM_Load, wchar_t)->Apply(CompileArgs);
+
+BENCHMARK_TEMPLATE(BM_Match, char)->Apply(MatchArgs);
+BENCHMARK_TEMPLATE(BM_Match, wchar_t)->Apply(MatchArgs);
+
+BENCHMARK(BM_ManifestLoop)->Apply(CompileArgs);
+BENCHMARK(BM_ManifestPacked)->Apply(CompileArgs);
+BENCHMARK(BM_ManifestGrep)->Apply(CompileArgs);
+BENCHMARK(BM_PathScan)->DenseRange(0, 2);
+BENCHMARK(BM_PathIndex)->DenseRange(0, 2);
+BENCHMARK(BM_PathIndexBuild);
+BENCHMARK(BM_ParallelFilter)->ArgsProduct({{STAR_EXT, EXTGLOB}, {1, 2, 4, 8}})
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
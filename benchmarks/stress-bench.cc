@@ -0,0 +1,57 @@
+#include <string>
+#include <benchmark/benchmark.h>
+#include "glob-cpp/glob.h"
+
+namespace {
+
+// adversarial patterns, the input is a long run of 'a' followed by a tail
+// that makes the match fail as late as possible
+struct StressCase {
+  const char* pattern;
+  const char* tail;
+};
+
+const StressCase kStressCases[] = {
+  {"*a*a*a*a*b",       ""},
+  {"*(*(a|aa))b",      "c"},
+  {"+(a|aa|aaa)",      "b"},
+  {"*(a|aa)+(a|b)b",   "bc"},
+  {"*[a-wA-Z0-9]x",    ""},
+  {"*+(ab|a)*x",       ""},
+};
+
+void BM_Stress(benchmark::State& state) {
+  const StressCase& sc = kStressCases[state.range(0)];
+  size_t len = static_cast<size_t>(state.range(1));
+  std::string str = std::string(len, 'a') + sc.tail;
+  glob::glob g(sc.pattern);
+  state.SetLabel(sc.pattern);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(glob::glob_match(str, g));
+  }
+
+  state.SetComplexityN(static_cast<int64_t>(len));
+  state.counters["steps"] = static_cast<double>(g.GetAutomata().Steps());
+}
+
+// each pattern is a separated family, so google benchmark fits the
+// complexity of each one
+template<int Index>
+void StressArgs(benchmark::internal::Benchmark* b) {
+  for (int len = 64; len <= 4096; len *= 2) {
+    b->Args({Index, len});
+  }
+  b->Complexity();
+}
+
+}  // namespace
+
+BENCHMARK(BM_Stress)->Apply(StressArgs<0>);
+BENCHMARK(BM_Stress)->Apply(StressArgs<1>);
+BENCHMARK(BM_Stress)->Apply(StressArgs<2>);
+BENCHMARK(BM_Stress)->Apply(StressArgs<3>);
+BENCHMARK(BM_Stress)->Apply(StressArgs<4>);
+BENCHMARK(BM_Stress)->Apply(StressArgs<5>);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "glob-cpp/dir-cache.h"
+#include "glob-cpp/dir-source.h"
+#include "glob-cpp/file-glob.h"
+#include "glob-cpp/tar-source.h"
+#include "tree-generator.h"
+
+namespace {
+
+namespace fs = boost::filesystem;
+
+struct TraversalCase {
+  const char* pattern;
+
+  // directory relative to the root of the tree where the glob runs
+  const char* work_dir;
+};
+
+const TraversalCase kTraversalCases[] = {
+  {"*.c",            "."},
+  {"**/*.h",         "."},
+  {"a/*/b/**/c*",    "."},
+  {"~/*/*.c",        "."},
+  {"../../*.c",      "a/b"},
+};
+
+// trees are expensive to generate, so each configuration is generated once
+// and removed when the program exits
+const bench::TempTree& GetTree(size_t fan_out, size_t depth) {
+  static std::map<std::pair<size_t, size_t>,
+      std::unique_ptr<bench::TempTree>> trees;
+
+  auto key = std::make_pair(fan_out, depth);
+  auto it = trees.find(key);
+  if (it != trees.end()) {
+    return *it->second;
+  }
+
+  bench::TreeOptions opt;
+  opt.fan_out = fan_out;
+  opt.depth = depth;
+  auto& tree = trees[key];
+  tree.reset(new bench::TempTree(opt));
+  return *tree;
+}
+
+// CountingDirSource counts the entries that the walk listed, so entries/s is
+// the rate of the entries a pattern really read, not the size of the tree
+class CountingDirSource: public glob::DirSource {
+ public:
+  explicit CountingDirSource(glob::DirSource& source): source_(source) {}
+
+  bool List(const std::string& path,
+      std::vector<glob::DirEntry>& entries) override {
+    size_t size = entries.size();
+    bool ok = source_.List(path, entries);
+    num_listed_ += entries.size() - size;
+    return ok;
+  }
+
+  bool Stat(const std::string& path, glob::EntryStat& stat) override {
+    return source_.Stat(path, stat);
+  }
+
+  bool RealPath(const std::string& path, std::string& real) override {
+    return source_.RealPath(path, real);
+  }
+
+  size_t NumListed() const {
+    return num_listed_;
+  }
+
+ private:
+  glob::DirSource& source_;
+  size_t num_listed_ = 0;
+};
+
+void SetCounters(benchmark::State& state, size_t num_results,
+    const CountingDirSource& counting) {
+  state.counters["results"] = static_cast<double>(num_results);
+  state.counters["listed"] = static_cast<double>(counting.NumListed()) /
+      static_cast<double>(std::max<benchmark::IterationCount>(
+      1, state.iterations()));
+  state.counters["entries/s"] = benchmark::Counter(
+      static_cast<double>(counting.NumListed()),
+      benchmark::Counter::kIsRate);
+}
+
+void BM_FileGlob(benchmark::State& state) {
+  const TraversalCase& tc = kTraversalCases[state.range(0)];
+  const bench::TempTree& tree = GetTree(state.range(1), state.range(2));
+  state.SetLabel(tc.pattern);
+
+  fs::path old_path = fs::current_path();
+  fs::current_path(tree.Root() / tc.work_dir);
+  setenv("HOME", tree.Root().string().c_str(), 1);
+  CountingDirSource counting(glob::DefaultDirSource());
+
+  size_t num_results = 0;
+  for (auto _ : state) {
+    glob::file_glob fglob{tc.pattern};
+    fglob.SetDirSource(counting);
+    auto results = fglob.Exec();
+    num_results = results.size();
+    benchmark::DoNotOptimize(results.data());
+  }
+
+  fs::current_path(old_path);
+  state.counters["entries"] = static_cast<double>(
+      tree.Generator().NumEntries());
+  SetCounters(state, num_results, counting);
+}
+
+// the generated tree copied in memory at the same paths, so the walk is the
+// same without the reads of the disk
+void CopyTree(const std::string& dir, glob::MemoryDirSource& memory) {
+  std::vector<glob::DirEntry> entries;
+  glob::DefaultDirSource().List(dir, entries);
+  for (auto& entry : entries) {
+    std::string path = dir + "/" + entry.name;
+    if (entry.type == glob::EntryType::DIR) {
+      memory.AddDir(path);
+      CopyTree(path, memory);
+    } else {
+      memory.AddFile(path);
+    }
+  }
+}
+
+void BM_FileGlobMemory(benchmark::State& state) {
+  const TraversalCase& tc = kTraversalCases[state.range(0)];
+  const bench::TempTree& tree = GetTree(state.range(1), state.range(2));
+  state.SetLabel(tc.pattern);
+
+  glob::MemoryDirSource memory;
+  CopyTree(tree.Root().string(), memory);
+  memory.SetWorkDir((tree.Root() / tc.work_dir).string());
+  setenv("HOME", tree.Root().string().c_str(), 1);
+  CountingDirSource counting(memory);
+
+  size_t num_results = 0;
+  for (auto _ : state) {
+    glob::file_glob fglob{tc.pattern};
+    fglob.SetDirSource(counting);
+    auto results = fglob.Exec();
+    num_results = results.size();
+    benchmark::DoNotOptimize(results.data());
+  }
+
+  state.counters["entries"] = static_cast<double>(
+      tree.Generator().NumEntries());
+  SetCounters(state, num_results, counting);
+}
+
+// the same glob again over a tree that doesn't change, as a process that
+// checks its globs in a loop, range(3) is the invalidation of the cache
+void BM_FileGlobCached(benchmark::State& state) {
+  const TraversalCase& tc = kTraversalCases[state.range(0)];
+  const bench::TempTree& tree = GetTree(state.range(1), state.range(2));
+  auto invalidation =
+      static_cast<glob::CachedDirSource::Invalidation>(state.range(3));
+  state.SetLabel(std::string(tc.pattern) +
+      (invalidation == glob::CachedDirSource::Invalidation::INOTIFY ?
+      " inotify" : " mtime"));
+
+  fs::path old_path = fs::current_path();
+  fs::current_path(tree.Root() / tc.work_dir);
+  setenv("HOME", tree.Root().string().c_str(), 1);
+  glob::CachedDirSource cache(glob::DefaultDirSource(), invalidation);
+  CountingDirSource counting(cache);
+
+  size_t num_results = 0;
+  for (auto _ : state) {
+    glob::file_glob fglob{tc.pattern};
+    fglob.SetDirSource(counting);
+    auto results = fglob.Exec();
+    num_results = results.size();
+    benchmark::DoNotOptimize(results.data());
+  }
+
+  fs::current_path(old_path);
+  auto stats = cache.GetStats();
+  state.counters["hit_ratio"] = static_cast<double>(stats.hits) /
+      static_cast<double>(std::max<uint64_t>(1, stats.hits + stats.misses));
+  SetCounters(state, num_results, counting);
+}
+
+// a ustar header with the size of the data that follows it
+void AppendTarHeader(const std::string& name, size_t size, char type,
+    std::string& tar) {
+  std::string block(512, '\0');
+  block.replace(0, std::min<size_t>(name.size(), 100), name);
+  std::snprintf(&block[124], 12, "%011zo", size);
+  block[156] = type;
+  block.replace(257, 5, "ustar");
+  block.replace(148, 8, 8, ' ');
+
+  unsigned sum = 0;
+  for (char c : block) {
+    sum += static_cast<unsigned char>(c);
+  }
+  std::snprintf(&block[148], 8, "%06o", sum);
+  tar += block;
+  tar.append((size + 511) / 512 * 512, '\0');
+}
+
+// the generated tree as a tar archive, each file has one block of data
+void TarTree(const std::string& dir, const std::string& prefix,
+    std::string& tar) {
+  std::vector<glob::DirEntry> entries;
+  glob::DefaultDirSource().List(dir, entries);
+  for (auto& entry : entries) {
+    std::string name = prefix + entry.name;
+    if (entry.type == glob::EntryType::DIR) {
+      AppendTarHeader(name + "/", 0, '5', tar);
+      TarTree(dir + "/" + entry.name, name + "/", tar);
+    } else {
+      AppendTarHeader(name, 512, '0', tar);
+    }
+  }
+}
+
+// the archive is read and globbed on each iteration, what a caller does
+// instead of extracting it
+void BM_FileGlobTar(benchmark::State& state) {
+  const TraversalCase& tc = kTraversalCases[state.range(0)];
+  const bench::TempTree& tree = GetTree(state.range(1), state.range(2));
+  state.SetLabel(tc.pattern);
+
+  std::string tar;
+  TarTree(tree.Root().string(), "", tar);
+  tar.append(1024, '\0');
+
+  size_t num_results = 0;
+  size_t num_listed = 0;
+  for (auto _ : state) {
+    std::istringstream in(tar);
+    glob::TarDirSource source(in);
+    CountingDirSource counting(source);
+    glob::file_glob fglob{tc.pattern};
+    fglob.SetDirSource(counting);
+    auto results = fglob.Exec();
+    num_results = results.size();
+    num_listed += counting.NumListed();
+    benchmark::DoNotOptimize(results.data());
+  }
+
+  // the archive is read whole on each iteration, whatever the walk lists
+  state.counters["results"] = static_cast<double>(num_results);
+  state.counters["listed"] = static_cast<double>(num_listed) /
+      static_cast<double>(std::max<benchmark::IterationCount>(
+      1, state.iterations()));
+  state.counters["entries/s"] = benchmark::Counter(
+      static_cast<double>(num_listed), benchmark::Counter::kIsRate);
+}
+
+void TraversalArgs(benchmark::internal::Benchmark* b) {
+  const size_t num_cases = sizeof(kTraversalCases)/sizeof(kTraversalCases[0]);
+  const int trees[][2] = {{4, 2}, {4, 4}, {8, 3}};
+
+  for (size_t i = 0; i < num_cases; i++) {
+    for (auto& tree : trees) {
+      b->Args({static_cast<int>(i), tree[0], tree[1]});
+    }
+  }
+
+  b->ArgNames({"pattern", "fan_out", "depth"});
+  b->Unit(benchmark::kMicrosecond);
+}
+
+}  // namespace
+
+BENCHMARK(BM_FileGlob)->Apply(TraversalArgs);
+BENCHMARK(BM_FileGlobMemory)->Apply(TraversalArgs);
+BENCHMARK(BM_FileGlobCached)->ArgsProduct({{0, 1, 2, 3, 4}, {4}, {4}, {0, 1}})
+    ->ArgNames({"pattern", "fan_out", "depth", "invalidation"})
+    ->Unit(benchmark::kMicrosecond);
+
+// the patterns that start at the root of the archive
+BENCHMARK(BM_FileGlobTar)->ArgsProduct({{0, 1, 2}, {4, 8}, {3}})
+    ->ArgNames({"pattern", "fan_out", "depth"})->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
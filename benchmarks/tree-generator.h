@@ -0,0 +1,187 @@
+#ifndef GLOB_CPP_TREE_GENERATOR_H
+#define GLOB_CPP_TREE_GENERATOR_H
+
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+namespace bench {
+
+namespace fs = boost::filesystem;
+
+struct TreeOptions {
+  // number of sub directories in each directory
+  size_t fan_out = 4;
+
+  // number of directory levels below the root
+  size_t depth = 3;
+
+  // number of regular files in each directory
+  size_t files_per_dir = 16;
+
+  // fraction of files and directories which name starts with '.'
+  double hidden_ratio = 0.1;
+
+  // length range of the random part of file names
+  size_t min_name_len = 3;
+  size_t max_name_len = 12;
+
+  // extensions of files and their relative weight
+  std::vector<std::pair<std::string, unsigned>> extensions = {
+    {".c", 4}, {".h", 3}, {".cc", 2}, {".txt", 1}, {".o", 2}
+  };
+
+  uint32_t seed = 42;
+};
+
+// TreeGenerator builds the same directory tree for the same options, the
+// names of directories come from a fixed list, so patterns like a/*/b can be
+// used in benchmarks, and the names of files are random
+class TreeGenerator {
+ public:
+  TreeGenerator(const TreeOptions& opt)
+    : opt_{opt}
+    , rand_{opt.seed}
+    , num_dirs_{0}
+    , num_files_{0} {}
+
+  void Generate(const fs::path& root) {
+    rand_.seed(opt_.seed);
+    num_dirs_ = 0;
+    num_files_ = 0;
+    fs::create_directories(root);
+    GenerateDir(root, 0);
+  }
+
+  size_t NumDirs() const {
+    return num_dirs_;
+  }
+
+  size_t NumFiles() const {
+    return num_files_;
+  }
+
+  size_t NumEntries() const {
+    return num_dirs_ + num_files_;
+  }
+
+ private:
+  void GenerateDir(const fs::path& dir, size_t level) {
+    for (size_t i = 0; i < opt_.files_per_dir; i++) {
+      std::ofstream{(dir / FileName()).string()};
+      num_files_++;
+    }
+
+    if (level == opt_.depth) {
+      return;
+    }
+
+    for (size_t i = 0; i < opt_.fan_out; i++) {
+      fs::path sub_dir = dir / DirName(i);
+      fs::create_directory(sub_dir);
+      num_dirs_++;
+      GenerateDir(sub_dir, level + 1);
+    }
+  }
+
+  // the raw output of mt19937 is the same on every platform, the
+  // std distributions are not, so only modulo is used here
+  uint32_t Rand(uint32_t n) {
+    return static_cast<uint32_t>(rand_() % n);
+  }
+
+  bool Hidden() {
+    return Rand(1000) < static_cast<uint32_t>(opt_.hidden_ratio * 1000);
+  }
+
+  std::string DirName(size_t i) {
+    static const char* names[] = {"a", "b", "src", "include", "lib", "test",
+        "docs", "build"};
+    const size_t num_names = sizeof(names)/sizeof(names[0]);
+
+    std::string name = names[i % num_names];
+    if (i >= num_names) {
+      name += std::to_string(i / num_names);
+    }
+
+    // "a" and "b" are always visible, so patterns can rely on them
+    if (i < 2) {
+      return name;
+    }
+
+    return Hidden() ? "." + name : name;
+  }
+
+  std::string FileName() {
+    size_t len = opt_.min_name_len +
+        Rand(static_cast<uint32_t>(opt_.max_name_len - opt_.min_name_len + 1));
+
+    std::string name = Hidden() ? "." : "";
+    for (size_t i = 0; i < len; i++) {
+      name += static_cast<char>('a' + Rand(26));
+    }
+
+    // random names can collide, the file index keeps the count exact
+    name += "_" + std::to_string(num_files_);
+
+    unsigned total = 0;
+    for (auto& ext : opt_.extensions) {
+      total += ext.second;
+    }
+
+    uint32_t w = Rand(total);
+    for (auto& ext : opt_.extensions) {
+      if (w < ext.second) {
+        return name + ext.first;
+      }
+      w -= ext.second;
+    }
+
+    return name;
+  }
+
+  TreeOptions opt_;
+  std::mt19937 rand_;
+  size_t num_dirs_;
+  size_t num_files_;
+};
+
+// TempTree generates a tree in the temporary directory and removes it when
+// it is destroyed
+class TempTree {
+ public:
+  TempTree(const TreeOptions& opt)
+    : gen_{opt}
+    , root_{fs::temp_directory_path() /
+        fs::unique_path("glob-cpp-bench-%%%%-%%%%")} {
+    gen_.Generate(root_);
+  }
+
+  TempTree(const TempTree&) = delete;
+  TempTree& operator=(const TempTree&) = delete;
+
+  ~TempTree() {
+    boost::system::error_code ec;
+    fs::remove_all(root_, ec);
+  }
+
+  const fs::path& Root() const {
+    return root_;
+  }
+
+  const TreeGenerator& Generator() const {
+    return gen_;
+  }
+
+ private:
+  TreeGenerator gen_;
+  fs::path root_;
+};
+
+}  // namespace bench
+
+#endif  // GLOB_CPP_TREE_GENERATOR_H
@@ -0,0 +1,465 @@
+#ifndef GLOB_CPP_DIR_CACHE_H
+#define GLOB_CPP_DIR_CACHE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "dir-source.h"
+
+#ifdef __linux__
+#define GLOB_CPP_HAS_INOTIFY 1
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace glob {
+
+// CachedDirSource keeps the listings of the directories of other source,
+// so the globs that run again over a tree that didn't change don't read it
+// again, one cache is shared by the globs of all threads
+//
+// with inotify each cached directory has a watch, an event on it drops the
+// listing, the events are read at the start of each call, so a change is
+// seen by the next call, without inotify, or when the watches run out, the
+// mtime of the directory is checked on each call, one stat instead of a
+// listing, a listing taken in the same second as its mtime is not kept,
+// since a change in that second may not change the mtime
+//
+// the keys are the paths as the globs give them, a process that changes
+// its working directory calls Clear, inotify only sees the local
+// filesystem, so sources that are not the system use MTIME
+class CachedDirSource: public DirSource {
+ public:
+  enum class Invalidation {
+    INOTIFY,
+    MTIME
+  };
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+    uint64_t evictions;
+    size_t size;
+  };
+
+  static constexpr size_t kDefaultCapacity = 4096;
+
+  // a listing is kept when its directory didn't change in this window
+  static constexpr int64_t kRacyWindow = 1000000000;
+
+  explicit CachedDirSource(DirSource& source = DefaultDirSource(),
+      Invalidation invalidation = Invalidation::INOTIFY,
+      size_t capacity = kDefaultCapacity)
+    : source_(source)
+    , invalidation_{Invalidation::MTIME}
+    , capacity_{std::max<size_t>(1, capacity)} {
+#ifdef GLOB_CPP_HAS_INOTIFY
+    if (invalidation == Invalidation::INOTIFY) {
+      fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (fd_ >= 0) {
+        invalidation_ = Invalidation::INOTIFY;
+      }
+    }
+#else
+    (void)invalidation;
+#endif
+  }
+
+  CachedDirSource(const CachedDirSource&) = delete;
+  CachedDirSource& operator=(const CachedDirSource&) = delete;
+
+  ~CachedDirSource() {
+#ifdef GLOB_CPP_HAS_INOTIFY
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+#endif
+  }
+
+  // the invalidation in use, MTIME when inotify can't be used
+  Invalidation GetInvalidation() const {
+    return invalidation_;
+  }
+
+  bool List(const std::string& path,
+      std::vector<DirEntry>& entries) override {
+    if (invalidation_ == Invalidation::INOTIFY) {
+      return ListWatched(path, entries);
+    }
+
+    return ListChecked(path, entries);
+  }
+
+  // with inotify the stats of the entries of cached directories are kept
+  // too, an event in the directory drops them with the listing, the stats
+  // of symlinks are not kept, their targets are not watched, nor the stats
+  // of subdirectories, a change inside one changes its mtime but is an
+  // event of its own watch, not of the parent
+  bool Stat(const std::string& path, EntryStat& stat) override {
+    if (invalidation_ != Invalidation::INOTIFY) {
+      return source_.Stat(path, stat);
+    }
+
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+      return source_.Stat(path, stat);
+    }
+
+    std::string dir = path.substr(0, slash == 0 ? 1 : slash);
+    std::string name = path.substr(slash + 1);
+    uint64_t generation = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ReadEvents();
+      Slot* slot = Find(dir);
+      if (!slot || slot->wd < 0) {
+        return source_.Stat(path, stat);
+      }
+
+      auto it = slot->stats.find(name);
+      if (it != slot->stats.end()) {
+        hits_++;
+        stat = it->second;
+        return true;
+      }
+      generation = watches_[slot->wd].generation;
+    }
+
+    if (!source_.Stat(path, stat)) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ReadEvents();
+    Slot* slot = Find(dir);
+    if (slot && slot->wd >= 0 &&
+        watches_[slot->wd].generation == generation &&
+        IsStatCached(ListedAs(*slot, name))) {
+      slot->stats[name] = stat;
+    }
+    return true;
+  }
+
+  bool RealPath(const std::string& path, std::string& real) override {
+    return source_.RealPath(path, real);
+  }
+
+  Stats GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t size = 0;
+    for (auto& slot : slots_) {
+      size += slot.valid ? 1 : 0;
+    }
+    return Stats{hits_, misses_, invalidations_, evictions_, size};
+  }
+
+  // drops all listings and watches, the counters are kept
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ClearLocked();
+  }
+
+ private:
+  struct Slot {
+    std::string path;
+    std::vector<DirEntry> entries;
+    std::unordered_map<std::string, EntryStat> stats;
+    int wd;
+    int64_t mtime;
+    bool valid;
+    bool referenced;
+  };
+
+  // a watch can be shared by paths of the same directory, its generation
+  // counts its events, a listing taken while an event came is not kept
+  struct Watch {
+    std::vector<size_t> slots;
+    uint64_t generation;
+  };
+
+  bool ListWatched(const std::string& path, std::vector<DirEntry>& entries) {
+    uint64_t generation = 0;
+    int wd = -1;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ReadEvents();
+      Slot* slot = Find(path);
+      if (slot && slot->wd >= 0) {
+        hits_++;
+        slot->referenced = true;
+        entries.insert(entries.end(), slot->entries.begin(),
+            slot->entries.end());
+        return true;
+      }
+
+      // the watch is added before the listing, so a change after the
+      // listing is an event
+      wd = AddWatch(path);
+      if (wd >= 0) {
+        misses_++;
+        generation = watches_[wd].generation;
+      }
+    }
+
+    // no watch left, or the path is not a directory
+    if (wd < 0) {
+      return ListChecked(path, entries);
+    }
+
+    std::vector<DirEntry> listed;
+    bool ok = source_.List(path, listed);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ReadEvents();
+      auto it = watches_.find(wd);
+      if (ok && it != watches_.end() && it->second.generation == generation) {
+        Insert(path, listed, wd, 0);
+      } else if (it != watches_.end() && it->second.slots.empty()) {
+#ifdef GLOB_CPP_HAS_INOTIFY
+        inotify_rm_watch(fd_, wd);
+#endif
+        watches_.erase(it);
+      }
+    }
+
+    if (!ok) {
+      return false;
+    }
+
+    entries.insert(entries.end(), std::make_move_iterator(listed.begin()),
+        std::make_move_iterator(listed.end()));
+    return true;
+  }
+
+  bool ListChecked(const std::string& path, std::vector<DirEntry>& entries) {
+    EntryStat stat;
+    if (!source_.Stat(path, stat) || stat.type != EntryType::DIR) {
+      return false;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = index_.find(path);
+      if (it != index_.end()) {
+        Slot& slot = slots_[it->second];
+        if (slot.valid && slot.mtime == stat.mtime) {
+          hits_++;
+          slot.referenced = true;
+          entries.insert(entries.end(), slot.entries.begin(),
+              slot.entries.end());
+          return true;
+        }
+
+        if (slot.valid) {
+          invalidations_++;
+          slot.valid = false;
+        }
+      }
+      misses_++;
+    }
+
+    // the mtime read before the listing, if the directory changes after,
+    // its mtime is other
+    std::vector<DirEntry> listed;
+    if (!source_.List(path, listed)) {
+      return false;
+    }
+
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    if (now - stat.mtime > kRacyWindow) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Insert(path, listed, -1, stat.mtime);
+    }
+
+    entries.insert(entries.end(), std::make_move_iterator(listed.begin()),
+        std::make_move_iterator(listed.end()));
+    return true;
+  }
+
+  // the functions below must be called with the lock
+
+  Slot* Find(const std::string& path) {
+    auto it = index_.find(path);
+    if (it == index_.end() || !slots_[it->second].valid) {
+      return nullptr;
+    }
+    return &slots_[it->second];
+  }
+
+  // the type of the entry in the listing, the names that are not listed
+  // are taken as symlinks, their stats are not kept
+  EntryType ListedAs(const Slot& slot, const std::string& name) {
+    for (auto& entry : slot.entries) {
+      if (entry.name == name) {
+        return entry.type;
+      }
+    }
+    return EntryType::SYMLINK;
+  }
+
+  static bool IsStatCached(EntryType type) {
+    return type != EntryType::SYMLINK && type != EntryType::DIR;
+  }
+
+  // the slot of the path is reused, or the next one of the clock when the
+  // cache is full, as in GlobCache
+  void Insert(const std::string& path, std::vector<DirEntry>& entries,
+      int wd, int64_t mtime) {
+    size_t i;
+    auto it = index_.find(path);
+    if (it != index_.end()) {
+      i = it->second;
+      Unwatch(i, wd);
+    } else if (slots_.size() < capacity_) {
+      i = slots_.size();
+      slots_.push_back(Slot{});
+      index_[path] = i;
+    } else {
+      while (slots_[hand_].referenced) {
+        slots_[hand_].referenced = false;
+        hand_ = (hand_ + 1) % slots_.size();
+      }
+
+      i = hand_;
+      hand_ = (hand_ + 1) % slots_.size();
+      Unwatch(i, wd);
+      index_.erase(slots_[i].path);
+      index_[path] = i;
+      evictions_++;
+    }
+
+    slots_[i] = Slot{path, entries, {}, wd, mtime, true, false};
+    if (wd >= 0) {
+      watches_[wd].slots.push_back(i);
+    }
+  }
+
+  // the watch is removed with the last slot that uses it, unless the slot
+  // takes the same watch again, a listing taken again after an event has
+  // the same wd, and removing it would drop the new listing
+  void Unwatch(size_t i, int keep_wd = -1) {
+    int wd = slots_[i].wd;
+    auto it = watches_.find(wd);
+    slots_[i].wd = -1;
+    if (wd < 0 || it == watches_.end()) {
+      return;
+    }
+
+    auto& slots = it->second.slots;
+    slots.erase(std::remove(slots.begin(), slots.end(), i), slots.end());
+    if (slots.empty() && wd != keep_wd) {
+#ifdef GLOB_CPP_HAS_INOTIFY
+      inotify_rm_watch(fd_, wd);
+#endif
+      watches_.erase(it);
+    }
+  }
+
+  void ClearLocked() {
+    for (auto& watch : watches_) {
+#ifdef GLOB_CPP_HAS_INOTIFY
+      inotify_rm_watch(fd_, watch.first);
+#endif
+      (void)watch;
+    }
+
+    watches_.clear();
+    index_.clear();
+    slots_.clear();
+    hand_ = 0;
+  }
+
+#ifdef GLOB_CPP_HAS_INOTIFY
+  // the events of the children change the stats, the events of the
+  // directory itself tell that it was removed or moved
+  static constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE |
+      IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_MODIFY | IN_DELETE_SELF |
+      IN_MOVE_SELF | IN_ONLYDIR;
+
+  // without watches left the directory is not cached, ListWatched lists it
+  // each time
+  int AddWatch(const std::string& path) {
+    int wd = inotify_add_watch(fd_, path.c_str(), kWatchMask);
+    if (wd >= 0 && watches_.find(wd) == watches_.end()) {
+      watches_[wd] = Watch{{}, 0};
+    }
+    return wd;
+  }
+
+  // drops the listings of the directories that had events, the queue of
+  // the kernel is read without blocking, an overflow of the queue drops
+  // all listings
+  void ReadEvents() {
+    alignas(struct inotify_event) char buf[4096];
+    while (true) {
+      ssize_t len = read(fd_, buf, sizeof(buf));
+      if (len <= 0) {
+        return;
+      }
+
+      for (ssize_t pos = 0; pos < len;) {
+        auto* event = reinterpret_cast<struct inotify_event*>(buf + pos);
+        pos += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+
+        if (event->mask & IN_Q_OVERFLOW) {
+          invalidations_ += index_.size();
+          ClearLocked();
+          continue;
+        }
+
+        auto it = watches_.find(event->wd);
+        if (it == watches_.end()) {
+          continue;
+        }
+
+        it->second.generation++;
+        for (size_t i : it->second.slots) {
+          if (slots_[i].valid) {
+            invalidations_++;
+            slots_[i].valid = false;
+          }
+          slots_[i].stats.clear();
+        }
+
+        // the kernel removed the watch, the directory is gone
+        if (event->mask & IN_IGNORED) {
+          for (size_t i : it->second.slots) {
+            slots_[i].wd = -1;
+          }
+          watches_.erase(it);
+        }
+      }
+    }
+  }
+#else
+  int AddWatch(const std::string&) {
+    return -1;
+  }
+
+  void ReadEvents() {}
+#endif
+
+  DirSource& source_;
+  Invalidation invalidation_;
+  size_t capacity_;
+  int fd_ = -1;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, size_t> index_;
+  std::vector<Slot> slots_;
+  std::unordered_map<int, Watch> watches_;
+  size_t hand_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t invalidations_ = 0;
+  uint64_t evictions_ = 0;
+};
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_DIR_CACHE_H
@@ -0,0 +1,515 @@
+#ifndef GLOB_CPP_DIR_SOURCE_H
+#define GLOB_CPP_DIR_SOURCE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "glob.h"
+#include "path-index.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define GLOB_CPP_HAS_DIRENT 1
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <cstdlib>
+#else
+#include <boost/filesystem.hpp>
+#endif
+
+namespace glob {
+
+enum class EntryType {
+  FILE,
+  DIR,
+  SYMLINK,
+  OTHER
+};
+
+// the type of an entry is the one of the entry itself, a symlink is
+// SYMLINK whatever it points to
+struct DirEntry {
+  std::string name;
+  EntryType type;
+};
+
+struct EntryStat {
+  EntryType type;
+  uint64_t size;
+
+  // nanoseconds since the epoch, or a counter for the sources that are not
+  // on a filesystem
+  int64_t mtime;
+};
+
+// DirSource is where FileGlog reads the directories, the system, a tree in
+// memory or the members of an archive, the paths are the ones FileGlog
+// builds, relative to the working directory or absolute
+class DirSource {
+ public:
+  virtual ~DirSource() = default;
+
+  // appends the entries of the directory, without "." and "..", returns
+  // false if the path is not a directory that can be read
+  virtual bool List(const std::string& path,
+      std::vector<DirEntry>& entries) = 0;
+
+  // follows symlinks, returns false if the path doesn't exist
+  virtual bool Stat(const std::string& path, EntryStat& stat) = 0;
+
+  // the absolute path without symlinks, "." and ".." components
+  virtual bool RealPath(const std::string& path, std::string& real) = 0;
+};
+
+// the components of path resolved against the components of the working
+// directory, "." and ".." are resolved without the source, as realpath does
+// when there is no symlink
+inline std::vector<std::string> ResolvePath(
+    const std::vector<std::string>& work_dir, const std::string& path) {
+  std::vector<std::string> components;
+  if (path.empty() || path[0] != '/') {
+    components = work_dir;
+  }
+
+  size_t pos = 0;
+  while (pos <= path.length()) {
+    size_t end = path.find('/', pos);
+    if (end == std::string::npos) {
+      end = path.length();
+    }
+
+    std::string component = path.substr(pos, end - pos);
+    if (component == "..") {
+      if (!components.empty()) {
+        components.pop_back();
+      }
+    } else if (!component.empty() && component != ".") {
+      components.push_back(std::move(component));
+    }
+    pos = end + 1;
+  }
+
+  return components;
+}
+
+inline std::string JoinPath(const std::vector<std::string>& components) {
+  std::string path;
+  for (auto& component : components) {
+    path += '/';
+    path += component;
+  }
+
+  return path.empty() ? "/" : path;
+}
+
+// SystemDirSource reads the filesystem, with dirent the types come from
+// readdir, so a walk doesn't stat each entry, only the entries which type
+// the filesystem doesn't give are stat
+class SystemDirSource: public DirSource {
+ public:
+  bool List(const std::string& path,
+      std::vector<DirEntry>& entries) override {
+#ifdef GLOB_CPP_HAS_DIRENT
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+      return false;
+    }
+
+    while (struct dirent* d = readdir(dir)) {
+      const char* name = d->d_name;
+      if (name[0] == '.' && (name[1] == '\0' ||
+          (name[1] == '.' && name[2] == '\0'))) {
+        continue;
+      }
+
+      entries.push_back(DirEntry{name, EntryTypeOf(dir, d)});
+    }
+
+    closedir(dir);
+    return true;
+#else
+    namespace fs = boost::filesystem;
+    boost::system::error_code ec;
+    fs::directory_iterator it(path, ec);
+    if (ec) {
+      return false;
+    }
+
+    for (; it != fs::directory_iterator(); it.increment(ec)) {
+      if (ec) {
+        return false;
+      }
+
+      entries.push_back(DirEntry{it->path().filename().string(),
+          EntryTypeOf(it->symlink_status(ec).type())});
+    }
+    return true;
+#endif
+  }
+
+  bool Stat(const std::string& path, EntryStat& stat) override {
+#ifdef GLOB_CPP_HAS_DIRENT
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+      return false;
+    }
+
+    stat.type = EntryTypeOf(st.st_mode);
+    stat.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+    stat.mtime = int64_t(st.st_mtimespec.tv_sec) * 1000000000 +
+        st.st_mtimespec.tv_nsec;
+#else
+    stat.mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 +
+        st.st_mtim.tv_nsec;
+#endif
+    return true;
+#else
+    namespace fs = boost::filesystem;
+    boost::system::error_code ec;
+    fs::file_status status = fs::status(path, ec);
+    if (ec) {
+      return false;
+    }
+
+    stat.type = EntryTypeOf(status.type());
+    stat.size = stat.type == EntryType::FILE ? fs::file_size(path, ec) : 0;
+    stat.mtime = int64_t(fs::last_write_time(path, ec)) * 1000000000;
+    return true;
+#endif
+  }
+
+  bool RealPath(const std::string& path, std::string& real) override {
+#ifdef GLOB_CPP_HAS_DIRENT
+    char* resolved = realpath(path.c_str(), nullptr);
+    if (!resolved) {
+      return false;
+    }
+
+    real = resolved;
+    free(resolved);
+    return true;
+#else
+    boost::system::error_code ec;
+    real = boost::filesystem::canonical(path, ec).string();
+    return !ec;
+#endif
+  }
+
+ private:
+#ifdef GLOB_CPP_HAS_DIRENT
+  static EntryType EntryTypeOf(mode_t mode) {
+    if (S_ISREG(mode)) {
+      return EntryType::FILE;
+    } else if (S_ISDIR(mode)) {
+      return EntryType::DIR;
+    } else if (S_ISLNK(mode)) {
+      return EntryType::SYMLINK;
+    }
+    return EntryType::OTHER;
+  }
+
+  static EntryType EntryTypeOf(DIR* dir, struct dirent* d) {
+#ifdef _DIRENT_HAVE_D_TYPE
+    switch (d->d_type) {
+      case DT_REG:
+        return EntryType::FILE;
+
+      case DT_DIR:
+        return EntryType::DIR;
+
+      case DT_LNK:
+        return EntryType::SYMLINK;
+
+      case DT_UNKNOWN:
+        break;
+
+      default:
+        return EntryType::OTHER;
+    }
+#endif
+
+    struct stat st;
+    if (fstatat(dirfd(dir), d->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      return EntryType::OTHER;
+    }
+    return EntryTypeOf(st.st_mode);
+  }
+#else
+  static EntryType EntryTypeOf(boost::filesystem::file_type type) {
+    switch (type) {
+      case boost::filesystem::regular_file:
+        return EntryType::FILE;
+
+      case boost::filesystem::directory_file:
+        return EntryType::DIR;
+
+      case boost::filesystem::symlink_file:
+        return EntryType::SYMLINK;
+
+      default:
+        return EntryType::OTHER;
+    }
+  }
+#endif
+};
+
+// the source of the globs that don't set one, it has no state, so it is
+// shared by all threads
+inline DirSource& DefaultDirSource() {
+  static SystemDirSource source;
+  return source;
+}
+
+// MemoryDirSource is a tree of directories and files in memory, the walks
+// over it don't read the disk, so tests and benchmarks get the same tree
+// each time, relative paths start at the working directory of the source,
+// and the mtime of a directory changes when an entry is added or removed,
+// the clock is a counter, so the times are the same on each run
+class MemoryDirSource: public DirSource {
+ public:
+  MemoryDirSource(): root_{new Node{EntryType::DIR, 0, 0, {}}} {}
+
+  void SetWorkDir(const std::string& path) {
+    work_dir_ = ResolvePath(work_dir_, path);
+  }
+
+  std::string WorkDir() const {
+    return JoinPath(work_dir_);
+  }
+
+  // the parents that don't exist are added as directories, a file that
+  // exists gets the new size and mtime
+  void AddFile(const std::string& path, uint64_t size = 0) {
+    Node* node = Add(path, EntryType::FILE);
+    node->size = size;
+    node->mtime = ++clock_;
+  }
+
+  void AddDir(const std::string& path) {
+    Add(path, EntryType::DIR);
+  }
+
+  // removes the entry and all its entries, returns false if it doesn't
+  // exist
+  bool Remove(const std::string& path) {
+    std::vector<std::string> components = ResolvePath(work_dir_, path);
+    if (components.empty()) {
+      return false;
+    }
+
+    std::string name = std::move(components.back());
+    components.pop_back();
+    Node* parent = Find(components);
+    if (!parent || parent->children.erase(name) == 0) {
+      return false;
+    }
+
+    parent->mtime = ++clock_;
+    return true;
+  }
+
+  bool List(const std::string& path,
+      std::vector<DirEntry>& entries) override {
+    Node* node = Find(ResolvePath(work_dir_, path));
+    if (!node || node->type != EntryType::DIR) {
+      return false;
+    }
+
+    for (auto& child : node->children) {
+      entries.push_back(DirEntry{child.first, child.second->type});
+    }
+    return true;
+  }
+
+  bool Stat(const std::string& path, EntryStat& stat) override {
+    Node* node = Find(ResolvePath(work_dir_, path));
+    if (!node) {
+      return false;
+    }
+
+    stat = EntryStat{node->type, node->size, node->mtime};
+    return true;
+  }
+
+  bool RealPath(const std::string& path, std::string& real) override {
+    std::vector<std::string> components = ResolvePath(work_dir_, path);
+    if (!Find(components)) {
+      return false;
+    }
+
+    real = JoinPath(components);
+    return true;
+  }
+
+ private:
+  struct Node {
+    EntryType type;
+    uint64_t size;
+    int64_t mtime;
+    std::map<std::string, std::unique_ptr<Node>> children;
+  };
+
+  Node* Find(const std::vector<std::string>& components) {
+    Node* node = root_.get();
+    for (auto& component : components) {
+      auto it = node->children.find(component);
+      if (it == node->children.end()) {
+        return nullptr;
+      }
+      node = it->second.get();
+    }
+
+    return node;
+  }
+
+  Node* Add(const std::string& path, EntryType type) {
+    Node* node = root_.get();
+    for (auto& component : ResolvePath(work_dir_, path)) {
+      if (node->type != EntryType::DIR) {
+        throw Error("not a directory: " + path);
+      }
+
+      auto& child = node->children[component];
+      if (!child) {
+        child.reset(new Node{EntryType::DIR, 0, 0, {}});
+        node->mtime = ++clock_;
+      }
+      node = child.get();
+    }
+
+    if (node == root_.get() ||
+        (node->type != type && !node->children.empty())) {
+      throw Error("can't add: " + path);
+    }
+
+    node->type = type;
+    return node;
+  }
+
+  std::unique_ptr<Node> root_;
+  std::vector<std::string> work_dir_;
+  int64_t clock_ = 0;
+};
+
+// a member of an archive, offset and size tell where its data is in the
+// archive, so a caller reads only the members that matched
+struct ArchiveMember {
+  std::string path;
+  EntryType type;
+  uint64_t offset;
+  uint64_t size;
+  int64_t mtime;
+};
+
+// ArchiveDirSource lists the members of an archive as a tree, the root of
+// the archive is the root and the working directory of the source, the
+// directories that are only in the paths of members are listed too, and a
+// member that is in the archive twice is the last one, as when the archive
+// is extracted, symlinks are not followed
+class ArchiveDirSource: public DirSource {
+ public:
+  explicit ArchiveDirSource(std::vector<ArchiveMember> members)
+      : members_{std::move(members)} {
+    std::vector<std::string> paths;
+    paths.reserve(members_.size());
+    for (auto& member : members_) {
+      paths.push_back(member.path);
+    }
+
+    index_ = PathIndex<char>(paths);
+    member_of_entry_.assign(index_.Size() + 1, kNoMember);
+    for (size_t i = 0; i < members_.size(); i++) {
+      size_t entry = index_.Find(members_[i].path);
+      if (entry != PathIndex<char>::npos) {
+        member_of_entry_[entry] = i;
+      }
+    }
+  }
+
+  // the member of the path, or nullptr for the directories that are not
+  // members and the paths that are not in the archive
+  const ArchiveMember* Member(const std::string& path) const {
+    size_t entry = Find(path);
+    if (entry == PathIndex<char>::npos ||
+        member_of_entry_[entry] == kNoMember) {
+      return nullptr;
+    }
+
+    return &members_[member_of_entry_[entry]];
+  }
+
+  const std::vector<ArchiveMember>& Members() const {
+    return members_;
+  }
+
+  bool List(const std::string& path,
+      std::vector<DirEntry>& entries) override {
+    size_t entry = Find(path);
+    if (entry == PathIndex<char>::npos || Type(entry) != EntryType::DIR) {
+      return false;
+    }
+
+    for (size_t i = 0; i < index_.NumChildren(entry); i++) {
+      size_t child = index_.Child(entry, i);
+      entries.push_back(DirEntry{index_.Name(child), Type(child)});
+    }
+    return true;
+  }
+
+  bool Stat(const std::string& path, EntryStat& stat) override {
+    size_t entry = Find(path);
+    if (entry == PathIndex<char>::npos) {
+      return false;
+    }
+
+    size_t member = member_of_entry_[entry];
+    if (member == kNoMember) {
+      stat = EntryStat{EntryType::DIR, 0, 0};
+    } else {
+      stat = EntryStat{Type(entry), members_[member].size,
+          members_[member].mtime};
+    }
+    return true;
+  }
+
+  bool RealPath(const std::string& path, std::string& real) override {
+    if (Find(path) == PathIndex<char>::npos) {
+      return false;
+    }
+
+    real = JoinPath(ResolvePath({}, path));
+    return true;
+  }
+
+ private:
+  static constexpr size_t kNoMember = PathIndex<char>::npos;
+
+  size_t Find(const std::string& path) const {
+    std::vector<std::string> components = ResolvePath({}, path);
+    if (components.empty()) {
+      return PathIndex<char>::kRoot;
+    }
+
+    return index_.Find(JoinPath(components));
+  }
+
+  // a member with entries below it is a directory, whatever its type
+  EntryType Type(size_t entry) const {
+    size_t member = member_of_entry_[entry];
+    if (member == kNoMember || index_.NumChildren(entry) > 0) {
+      return EntryType::DIR;
+    }
+    return members_[member].type;
+  }
+
+  std::vector<ArchiveMember> members_;
+  PathIndex<char> index_;
+  std::vector<size_t> member_of_entry_;
+};
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_DIR_SOURCE_H
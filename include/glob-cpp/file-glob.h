@@ -1,35 +1,52 @@
 #ifndef FILE_GLOB_CPP_H
 #define FILE_GLOB_CPP_H
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include "glob.h"
+#include "dir-source.h"
 #include <boost/filesystem.hpp>
-#include <boost/range/iterator_range.hpp>
 #include <boost/process.hpp>
 
 namespace glob {
 
 namespace fs = boost::filesystem;
 
-template<class charT>
+// PathMatch is allocator-aware like MatchResults, the path is kept as a
+// string in the memory of the allocator, boost paths don't take allocators
+template<class charT, class Alloc=std::allocator<charT>>
 class PathMatch {
  public:
-  PathMatch(fs::path&& path, MatchResults<charT>&& match_res)
-      : path_{std::move(path)}
-      , match_res_{std::move(match_res)} {}
-
-  PathMatch(const fs::path& path, MatchResults<charT>&& match_res)
-      : path_{path}
+  using allocator_type = Alloc;
+  using path_string = std::basic_string<fs::path::value_type,
+      std::char_traits<fs::path::value_type>,
+      RebindAlloc<Alloc, fs::path::value_type>>;
+
+  PathMatch(const fs::path& path, MatchResults<charT, Alloc>&& match_res)
+      : path_(path.native().begin(), path.native().end(),
+            match_res.get_allocator())
       , match_res_{std::move(match_res)} {}
 
   PathMatch(const PathMatch& pm)
       : path_{pm.path_}
       , match_res_{pm.match_res_} {}
 
-  PathMatch(PathMatch&& pm)
+  PathMatch(PathMatch&& pm) noexcept
       : path_{std::move(pm.path_)}
       , match_res_{std::move(pm.match_res_)} {}
 
+  // the copies built by containers with uses-allocator construction take
+  // the allocator of the container
+  PathMatch(const PathMatch& pm, const Alloc& alloc)
+      : path_(pm.path_, alloc)
+      , match_res_(pm.match_res_, alloc) {}
+
+  PathMatch(PathMatch&& pm, const Alloc& alloc)
+      : path_(std::move(pm.path_), alloc)
+      , match_res_(std::move(pm.match_res_), alloc) {}
+
   PathMatch& operator=(const PathMatch& pm) {
     path_ = pm.path_;
     match_res_ = pm.match_res_;
@@ -45,30 +62,90 @@ class PathMatch {
   }
 
   const fs::path path() const {
+    return fs::path(path_.begin(), path_.end());
+  }
+
+  const path_string& native() const {
     return path_;
   }
 
-  const MatchResults<charT>& match_result() const {
+  const MatchResults<charT, Alloc>& match_result() const {
     return match_res_;
   }
 
+  allocator_type get_allocator() const {
+    return match_res_.get_allocator();
+  }
+
  private:
-  fs::path path_;
-  MatchResults<charT> match_res_;
+  path_string path_;
+  MatchResults<charT, Alloc> match_res_;
 };
 
-template<class charT>
+// CancellationToken stops the walks of the globs that hold it, the copies of
+// a token share the same state, so any thread can cancel a walk through its
+// own copy
+class CancellationToken {
+ public:
+  CancellationToken(): cancelled_{std::make_shared<std::atomic<bool>>(false)} {}
+
+  void Cancel() {
+    cancelled_->store(true, std::memory_order_relaxed);
+  }
+
+  bool IsCancelled() const {
+    return cancelled_->load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+// the results of Exec are built with the allocator of FileGlog, see
+// pmr::file_glob, the directories are read from the system unless a
+// DirSource is set
+template<class charT, class Alloc=std::allocator<charT>>
 class FileGlog {
  public:
-  FileGlog(const String<charT>& str_path): path_{str_path} {}
+  using Clock = std::chrono::steady_clock;
+  using Match = PathMatch<charT, Alloc>;
+  using Results = std::vector<Match, RebindAlloc<Alloc, Match>>;
+
+  FileGlog(const String<charT>& str_path, const Alloc& alloc = Alloc())
+    : path_{str_path}
+    , alloc_{alloc} {}
+
+  FileGlog& SetCancellationToken(const CancellationToken& token) {
+    token_ = token;
+    return *this;
+  }
+
+  // the walk stops at the deadline, and Exec returns the paths found so far
+  FileGlog& SetDeadline(Clock::time_point deadline) {
+    deadline_ = deadline;
+    return *this;
+  }
 
-  std::vector<PathMatch<charT>> Exec() {
+  // the source must outlive the glob, it is used by one Exec at a time
+  FileGlog& SetDirSource(DirSource& source) {
+    source_ = &source;
+    return *this;
+  }
+
+  // true if the last Exec stopped before the end of the walk, because the
+  // token was cancelled or the deadline passed
+  bool Interrupted() const {
+    return interrupted_;
+  }
+
+  Results Exec() {
+    interrupted_ = false;
     std::vector<String<charT>> vec_glob_path;
       for (auto it = path_.begin(); it != path_.end(); it++ ) {
         vec_glob_path.push_back(it->string());
       }
 
-      std::vector<PathMatch<charT>> vec_files;
+      Results vec_files(alloc_);
       if (IsRootDir(vec_glob_path[0])) {
         return HandleRootDir(vec_glob_path);
       } else if (IsHomeDir(vec_glob_path[0])) {
@@ -84,21 +161,21 @@ class FileGlog {
         return HandleDir(vec_glob_path);
       }
 
-      return std::vector<PathMatch<charT>>{};
+      return Results(alloc_);
   }
 
  private:
-  std::vector<PathMatch<charT>> HandleRootDir(
+  Results HandleRootDir(
       const std::vector<String<charT>>& vec_glob_path) {
-    std::vector<PathMatch<charT>> vec_ret;
+    Results vec_ret(alloc_);
     fs::path p{"/"};
 
     if (vec_glob_path.size() < 2) {
-      return std::vector<PathMatch<charT>>{};
+      return Results(alloc_);
     }
 
     if (IsParentDir(vec_glob_path[1])) {
-      return std::vector<PathMatch<charT>>{};
+      return Results(alloc_);
     }
 
     if (IsThisDir(vec_glob_path[1])) {
@@ -113,17 +190,16 @@ class FileGlog {
     return RecursiveGlobDir(vec_glob_path, p, 1);
   }
 
-  std::vector<PathMatch<charT>> HandleHomeDir(
+  Results HandleHomeDir(
       const std::vector<String<charT>>& vec_glob_path) {
     namespace bp = boost::process;
 
-    std::vector<PathMatch<charT>> vec_ret;
+    Results vec_ret(alloc_);
     bp::environment env = boost::this_process::environment();
     fs::path p{env["HOME"].to_string()};
 
     if (vec_glob_path.size() < 2) {
-      return std::vector<PathMatch<charT>>{PathMatch<charT>{std::move(p),
-          MatchResults<charT>{}}};
+      return SinglePath(p);
     }
 
     if (IsParentDir(vec_glob_path[1])) {
@@ -143,13 +219,13 @@ class FileGlog {
     return RecursiveGlobDir(vec_glob_path, p, 1);
   }
 
-  std::vector<PathMatch<charT>> HandleUpDir(
+  Results HandleUpDir(
       const std::vector<String<charT>>& vec_glob_path) {
-    std::vector<PathMatch<charT>> vec_ret;
+    Results vec_ret(alloc_);
     fs::path p{".."};
 
     if (vec_glob_path.size() < 2) {
-      return std::vector<PathMatch<charT>>{};
+      return Results(alloc_);
     }
 
     if (IsParentDir(vec_glob_path[1])) {
@@ -169,13 +245,13 @@ class FileGlog {
     return RecursiveGlobDir(vec_glob_path, p, 1);
   }
 
-  std::vector<PathMatch<charT>> HandleThisDir(
+  Results HandleThisDir(
       const std::vector<String<charT>>& vec_glob_path) {
-    std::vector<PathMatch<charT>> vec_ret;
+    Results vec_ret(alloc_);
     fs::path p{"."};
 
     if (vec_glob_path.size() < 2) {
-      return std::vector<PathMatch<charT>>{};
+      return Results(alloc_);
     }
 
     if (IsParentDir(vec_glob_path[1])) {
@@ -195,39 +271,37 @@ class FileGlog {
     return RecursiveGlobDir(vec_glob_path, p, 1);
   }
 
-  std::vector<PathMatch<charT>> HandleDir(
+  Results HandleDir(
       const std::vector<String<charT>>& vec_glob_path) {
-    std::vector<PathMatch<charT>> vec_ret;
+    Results vec_ret(alloc_);
     fs::path p{"."};
 
     if (vec_glob_path.size() < 1) {
-      return std::vector<PathMatch<charT>>{};
+      return Results(alloc_);
     }
 
     return RecursiveGlobDir(vec_glob_path, p, 0);
   }
 
-  std::vector<PathMatch<charT>> RecursiveGlobDir(
+  Results RecursiveGlobDir(
       const std::vector<String<charT>>& vec_glob_path,
       const fs::path& real_path,
       size_t level) {
-    std::vector<PathMatch<charT>> vec_ret;
+    Results vec_ret(alloc_);
     fs::path p = real_path;
     if (level >= vec_glob_path.size()) {
-      return std::vector<PathMatch<charT>>{};
+      return Results(alloc_);
     }
 
     if (level == (vec_glob_path.size() - 1)) {
       if (IsParentDir(vec_glob_path[level])) {
         p /= fs::path{".."};
-        return std::vector<PathMatch<charT>>{PathMatch<charT>{std::move(p),
-          MatchResults<charT>{}}};
+        return SinglePath(p);
       }
 
       if (IsThisDir(vec_glob_path[level])) {
         p /= fs::path{"."};
-        return std::vector<PathMatch<charT>>{PathMatch<charT>{std::move(p),
-          MatchResults<charT>{}}};
+        return SinglePath(p);
       }
     }
 
@@ -245,26 +319,35 @@ class FileGlog {
       return TwoStarsGlobDir(vec_glob_path, p, level + 1);
     }
 
-    for(auto& d : boost::make_iterator_range(fs::directory_iterator(p), {})) {
-      glob g(vec_glob_path[level]);
-      MatchResults<charT> match_res;
-      if (glob_match(d.path().filename().string(), match_res, g)) {
-        if (level == (vec_glob_path.size() - 1)) {
-          if (IsHidden(d.path()) && vec_glob_path[level][0] != '.') {
-            continue;
-          }
+    // a directory that can't be read has no entries
+    std::vector<DirEntry> entries;
+    if (!source_->List(p.string(), entries)) {
+      return Results(alloc_);
+    }
+
+    glob g(vec_glob_path[level]);
+    for (auto& entry : entries) {
+      if (Stop()) {
+        break;
+      }
+
+      MatchResults<charT, Alloc> match_res(alloc_);
+      if (glob_match(entry.name, match_res, g)) {
+        if (IsHidden(entry.name) && vec_glob_path[level][0] != '.') {
+          continue;
+        }
 
-          PathMatch<charT> path_match(d.path(), std::move(match_res));
+        fs::path entry_path = p / entry.name;
+        if (level == (vec_glob_path.size() - 1)) {
+          Match path_match(entry_path, std::move(match_res));
           vec_ret.push_back(std::move(path_match));
         } else {
-          if (!fs::is_directory(d.path()) || !HasPermission(d.path())) {
-            continue;
-          }
-          if (IsHidden(d.path()) && vec_glob_path[level][0] != '.') {
+          if (!IsDir(entry_path, entry)) {
             continue;
           }
-          auto ret = RecursiveGlobDir(vec_glob_path, d.path(), level + 1);
-          vec_ret.insert(vec_ret.end(), ret.begin(), ret.end());
+          auto ret = RecursiveGlobDir(vec_glob_path, entry_path, level + 1);
+          vec_ret.insert(vec_ret.end(), std::make_move_iterator(ret.begin()),
+              std::make_move_iterator(ret.end()));
         }
       }
     }
@@ -272,58 +355,106 @@ class FileGlog {
     return vec_ret;
   }
 
-  std::vector<PathMatch<charT>> TwoStarsGlobDir(
+  // the segments after the two stars must match the last components of a
+  // path, the walk keeps for each directory the set of its live states, state
+  // i means that the last i components matched the first i segments, so each
+  // entry is matched only with the segments that can follow its directory,
+  // and an entry matches when its state reaches the number of segments
+  //
+  // state 0 is live in every directory, the two stars take any depth, so
+  // unlike the segments before the two stars, this part of the walk can't
+  // skip a directory, see glob_match_prefix for walks of whole paths
+  Results TwoStarsGlobDir(
       const std::vector<String<charT>>& vec_glob_path,
       const fs::path& real_path,
       size_t level) {
-    fs::recursive_directory_iterator end;
-    std::vector<PathMatch<charT>> vec_paths;
-
-    for (fs::recursive_directory_iterator it(real_path); it != end; ++it) {
-      MatchGlobDir(vec_glob_path, real_path, *it, level, vec_paths);
+    std::vector<std::unique_ptr<glob>> globs;
+    for (size_t i = level; i < vec_glob_path.size(); i++) {
+      globs.emplace_back(new glob(vec_glob_path[i]));
     }
 
+    std::vector<std::vector<size_t>> live_states{{0}};
+    Results vec_paths(alloc_);
+    TwoStarsWalk(globs, real_path, 1, live_states, vec_paths);
     return vec_paths;
   }
 
-  bool MatchGlobDir(const std::vector<String<charT>>& vec_glob_path,
-      const fs::path& base_path, const fs::path& real_path,
-      size_t level, std::vector<PathMatch<charT>>& vec_res) {
-    std::vector<String<charT>> vec_path;
-    std::vector<String<charT>> vec_base_path;
-
-    for (auto it = real_path.begin(); it != real_path.end(); it++ ) {
-      vec_path.push_back(it->string());
+  // the entries come before the entries below them, and the symlinks to
+  // directories are not followed
+  void TwoStarsWalk(const std::vector<std::unique_ptr<glob>>& globs,
+      const fs::path& dir, size_t depth,
+      std::vector<std::vector<size_t>>& live_states, Results& vec_paths) {
+    std::vector<DirEntry> entries;
+    if (!source_->List(dir.string(), entries)) {
+      return;
     }
 
-    for (auto it = base_path.begin(); it != base_path.end(); it++ ) {
-      vec_base_path.push_back(it->string());
+    size_t num_globs = globs.size();
+    for (auto& entry : entries) {
+      if (Stop()) {
+        return;
+      }
+
+      live_states.resize(std::max(live_states.size(), depth + 1));
+      const std::vector<size_t>& parent_states = live_states[depth - 1];
+      std::vector<size_t>& states = live_states[depth];
+      states.assign(1, 0);
+
+      bool matched = num_globs == 0;
+      for (size_t state : parent_states) {
+        if (state < num_globs && glob_match(entry.name, *globs[state])) {
+          matched = matched || state + 1 == num_globs;
+          states.push_back(state + 1);
+        }
+      }
+
+      fs::path entry_path = dir / entry.name;
+      if (matched) {
+        vec_paths.push_back(MatchTwoStars(globs, entry_path));
+      }
+
+      if (entry.type == EntryType::DIR) {
+        TwoStarsWalk(globs, entry_path, depth + 1, live_states, vec_paths);
+      }
     }
+  }
 
-    int stop_point = vec_path.size() - vec_base_path.size();
-    int glob_point = vec_glob_path.size() - level;
+  // the results of a match after the two stars are the ones of the first
+  // segment, with the component that it matched
+  Match MatchTwoStars(const std::vector<std::unique_ptr<glob>>& globs,
+      const fs::path& path) {
+    MatchResults<charT, Alloc> match_res(alloc_);
+    if (!globs.empty()) {
+      fs::path component = path;
+      for (size_t i = 1; i < globs.size(); i++) {
+        component = component.parent_path();
+      }
 
-    if (glob_point > stop_point) {
-      return false;
+      glob_match(component.filename().string(), match_res, *globs.front());
     }
 
-    size_t j = 1;
-    size_t glob_size = vec_glob_path.size();
-    size_t real_path_size = vec_path.size();
-    MatchResults<charT> match_res;
+    return Match(path, std::move(match_res));
+  }
 
-    for (size_t i = vec_glob_path.size(); i > level; i--) {
-      glob g(vec_glob_path[glob_size - j]);
-      if (!glob_match(vec_path[real_path_size - j], match_res, g)) {
-        return false;
-      }
+  // checked for each entry of the walk, the clock is read only when there is
+  // a deadline
+  bool Stop() {
+    if (interrupted_) {
+      return true;
+    }
 
-      j++;
+    if (token_.IsCancelled() ||
+        (deadline_ != Clock::time_point::max() && Clock::now() >= deadline_)) {
+      interrupted_ = true;
     }
 
-    PathMatch<charT> path_res{real_path, std::move(match_res)};
-    vec_res.push_back(std::move(path_res));
-    return true;
+    return interrupted_;
+  }
+
+  Results SinglePath(const fs::path& path) {
+    Results results(alloc_);
+    results.push_back(Match(path, MatchResults<charT, Alloc>(alloc_)));
+    return results;
   }
 
   bool IsTwoStarDir(const String<charT>& dir) {
@@ -377,13 +508,17 @@ class FileGlog {
     return false;
   }
 
-  bool HasPermission(const fs::path& path) {
-    std::ifstream ifs (path.string(), std::ifstream::in);
-    return ifs.good();
+  // a symlink is a directory if it points to one, as fs::is_directory
+  bool IsDir(const fs::path& path, const DirEntry& entry) {
+    if (entry.type != EntryType::SYMLINK) {
+      return entry.type == EntryType::DIR;
+    }
+
+    EntryStat stat;
+    return source_->Stat(path.string(), stat) && stat.type == EntryType::DIR;
   }
 
-  bool IsHidden(const fs::path& path) {
-    fs::path::string_type name = path.filename().string();
+  bool IsHidden(const std::string& name) {
     return name[0] == '.';
   }
 
@@ -399,12 +534,26 @@ class FileGlog {
   }
 
   fs::path path_;
+  DirSource* source_ = &DefaultDirSource();
+  CancellationToken token_;
+  Clock::time_point deadline_ = Clock::time_point::max();
+  bool interrupted_ = false;
+  Alloc alloc_;
 };
 
 using path_match = PathMatch<char>;
 using wpath_match = PathMatch<wchar_t>;
 using file_glob = FileGlog<char>;
 using wfile_glob = FileGlog<wchar_t>;
+
+#if __cplusplus >= 201703L
+namespace pmr {
+
+using path_match = PathMatch<char, std::pmr::polymorphic_allocator<char>>;
+using file_glob = FileGlog<char, std::pmr::polymorphic_allocator<char>>;
+
+}  // namespace pmr
+#endif
 }
 
 #endif
@@ -0,0 +1,156 @@
+#ifndef GLOB_CPP_GLOB_BATCH_H
+#define GLOB_CPP_GLOB_BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "glob.h"
+
+namespace glob {
+
+// BatchMatcher matches many strings with one glob, what the engines need
+// from the glob is read once for all strings, the strings don't need to be
+// Strings, only strings that need the automata are copied, and always to the
+// same scratch string, so the batch doesn't allocate for each string
+template<class charT, class globT>
+class BatchMatcher {
+ public:
+  BatchMatcher(BasicGlob<charT, globT>& glob)
+    : glob_(glob)
+    , prefilter_(glob.GetPrefilter())
+    , fast_matcher_(glob.GetFastMatcher())
+    , min_len_(prefilter_.MinLength())
+    , max_len_(prefilter_.MaxLength()) {}
+
+  // only the length, the batches check it for all strings before the other
+  // engines run
+  bool CheckLength(size_t len) const {
+    return len - min_len_ <= max_len_ - min_len_;
+  }
+
+  bool Match(const charT* str, size_t len) {
+    MatchStatus status;
+    if (ExecConstEngines(prefilter_, fast_matcher_, str, len, MatchBudget{},
+        false, status)) {
+      return status == MatchStatus::MATCH;
+    }
+
+    scratch_.assign(str, len);
+    return glob_match(scratch_, glob_);
+  }
+
+  bool Match(const String<charT>& str) {
+    MatchStatus status;
+    if (ExecConstEngines(prefilter_, fast_matcher_, str, MatchBudget{}, false,
+        status)) {
+      return status == MatchStatus::MATCH;
+    }
+
+    return glob_match(str, glob_);
+  }
+
+ private:
+  BasicGlob<charT, globT>& glob_;
+  const Prefilter<charT>& prefilter_;
+  const FastMatcher<charT>* fast_matcher_;
+  size_t min_len_;
+  size_t max_len_;
+  String<charT> scratch_;
+};
+
+// the lengths of the strings are checked in a loop of its own, without
+// branches, so the compiler can vectorize it, the other engines run only for
+// the strings that pass
+template<class charT, class globT, class LengthOf>
+void CheckBatchLengths(const BatchMatcher<charT, globT>& matcher,
+    size_t num_inputs, LengthOf length_of, std::vector<uint8_t>& pass) {
+  pass.resize(num_inputs);
+  for (size_t i = 0; i < num_inputs; i++) {
+    pass[i] = matcher.CheckLength(length_of(i));
+  }
+}
+
+// matches each input with the glob, bit i of out is set if input i matches,
+// returns the number of matches
+template<class charT, class globT>
+size_t glob_match_batch(BasicGlob<charT, globT>& glob,
+    const String<charT>* inputs, size_t num_inputs, std::vector<bool>& out) {
+  BatchMatcher<charT, globT> matcher(glob);
+  std::vector<uint8_t> pass;
+  CheckBatchLengths(matcher, num_inputs,
+      [inputs](size_t i) { return inputs[i].length(); }, pass);
+
+  out.assign(num_inputs, false);
+  size_t num_matches = 0;
+  for (size_t i = 0; i < num_inputs; i++) {
+    if (pass[i] && matcher.Match(inputs[i])) {
+      out[i] = true;
+      num_matches++;
+    }
+  }
+
+  return num_matches;
+}
+
+template<class charT, class globT>
+size_t glob_match_batch(BasicGlob<charT, globT>& glob,
+    const std::vector<String<charT>>& inputs, std::vector<bool>& out) {
+  return glob_match_batch(glob, inputs.data(), inputs.size(), out);
+}
+
+// matches the strings of a packed buffer, string i is the chars
+// [offsets[i], offsets[i + 1]) of data, so offsets has num_inputs + 1 items
+template<class charT, class globT>
+size_t glob_match_packed(BasicGlob<charT, globT>& glob, const charT* data,
+    const size_t* offsets, size_t num_inputs, std::vector<bool>& out) {
+  BatchMatcher<charT, globT> matcher(glob);
+  std::vector<uint8_t> pass;
+  CheckBatchLengths(matcher, num_inputs,
+      [offsets](size_t i) { return offsets[i + 1] - offsets[i]; }, pass);
+
+  out.assign(num_inputs, false);
+  size_t num_matches = 0;
+  for (size_t i = 0; i < num_inputs; i++) {
+    if (pass[i] &&
+        matcher.Match(data + offsets[i], offsets[i + 1] - offsets[i])) {
+      out[i] = true;
+      num_matches++;
+    }
+  }
+
+  return num_matches;
+}
+
+// matches the strings of a buffer separated by delim, like '\0' or '\n', a
+// delim at the end of the buffer doesn't start one more string, bit i of out
+// is the string i of the buffer
+template<class charT, class globT>
+size_t glob_match_packed(BasicGlob<charT, globT>& glob, const charT* data,
+    size_t size, charT delim, std::vector<bool>& out) {
+  using Traits = std::char_traits<charT>;
+  BatchMatcher<charT, globT> matcher(glob);
+  out.clear();
+  size_t num_matches = 0;
+
+  // the search for the delim is the one of the standard library, memchr
+  // for chars, that checks many chars at once
+  const charT* end = data + size;
+  for (const charT* str = data; str < end;) {
+    const charT* next = Traits::find(str, end - str, delim);
+    if (next == nullptr) {
+      next = end;
+    }
+
+    size_t len = next - str;
+    bool r = matcher.CheckLength(len) && matcher.Match(str, len);
+    out.push_back(r);
+    num_matches += r;
+    str = next + 1;
+  }
+
+  return num_matches;
+}
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_GLOB_BATCH_H
@@ -0,0 +1,344 @@
+#ifndef GLOB_CPP_GLOB_CACHE_H
+#define GLOB_CPP_GLOB_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "glob.h"
+
+namespace glob {
+
+// SharedGlob is a compiled glob that many threads can use at once, the
+// prefilter and the fast matcher run without locks, the automata keeps the
+// state of the match, so each thread that needs it takes one compiled glob
+// from a pool, the pool grows only when threads need the automata at the
+// same time
+template<class charT, class globT=extended_glob<charT>>
+class SharedGlob {
+ public:
+  using Glob = BasicGlob<charT, globT>;
+
+  SharedGlob(const String<charT>& pattern,
+      const GlobOptions& options = GlobOptions())
+    : pattern_{pattern}
+    , options_{options} {
+    globs_.push_back(std::unique_ptr<Glob>(new Glob(pattern, options)));
+    free_.push_back(globs_.back().get());
+    first_ = globs_.back().get();
+  }
+
+  SharedGlob(const SharedGlob&) = delete;
+  SharedGlob& operator=(SharedGlob&) = delete;
+
+  const String<charT>& Pattern() const {
+    return pattern_;
+  }
+
+  const GlobOptions& Options() const {
+    return options_;
+  }
+
+  bool Match(const String<charT>& str) const {
+    return Match(str, MatchBudget{}) == MatchStatus::MATCH;
+  }
+
+  MatchStatus Match(const String<charT>& str,
+      const MatchBudget& budget) const {
+    MatchStatus status;
+    if (ExecConstEngines(first_->GetPrefilter(), first_->GetFastMatcher(),
+        str, budget, false, status)) {
+      return status;
+    }
+
+    Lease lease(*this);
+    return glob_match(str, lease.Get(), budget);
+  }
+
+  template<class Alloc>
+  bool Match(const String<charT>& str, MatchResults<charT, Alloc>& res) const {
+    Lease lease(*this);
+    return glob_match(str, res, lease.Get());
+  }
+
+  // the number of compiled globs in the pool
+  size_t PoolSize() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return globs_.size();
+  }
+
+  // takes a compiled glob from the pool and gives it back at the end of the
+  // match, even when the match throws, callers that match many strings in
+  // one thread take one lease for all of them
+  class Lease {
+   public:
+    Lease(const SharedGlob& shared): shared_{shared} {
+      glob_ = shared_.Acquire();
+    }
+
+    ~Lease() {
+      shared_.Release(glob_);
+    }
+
+    Glob& Get() {
+      return *glob_;
+    }
+
+   private:
+    const SharedGlob& shared_;
+    Glob* glob_;
+  };
+
+ private:
+  Glob* Acquire() const {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_.empty()) {
+        Glob* glob = free_.back();
+        free_.pop_back();
+        return glob;
+      }
+    }
+
+    // the pattern was already compiled once, so it doesn't throw, it is
+    // compiled out of the lock to not block the other threads
+    std::unique_ptr<Glob> glob(new Glob(pattern_, options_));
+    std::lock_guard<std::mutex> lock(mutex_);
+    globs_.push_back(std::move(glob));
+    return globs_.back().get();
+  }
+
+  void Release(Glob* glob) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(glob);
+  }
+
+  String<charT> pattern_;
+  GlobOptions options_;
+  const Glob* first_;
+  mutable std::mutex mutex_;
+  mutable std::vector<std::unique_ptr<Glob>> globs_;
+  mutable std::vector<Glob*> free_;
+};
+
+template<class charT, class globT>
+bool glob_match(const String<charT>& str,
+    const SharedGlob<charT, globT>& glob) {
+  return glob.Match(str);
+}
+
+template<class charT, class globT>
+bool glob_match(const charT* str, const SharedGlob<charT, globT>& glob) {
+  return glob.Match(String<charT>(str));
+}
+
+template<class charT, class Alloc, class globT>
+bool glob_match(const String<charT>& str, MatchResults<charT, Alloc>& res,
+    const SharedGlob<charT, globT>& glob) {
+  return glob.Match(str, res);
+}
+
+template<class charT, class globT>
+MatchStatus glob_match(const String<charT>& str,
+    const SharedGlob<charT, globT>& glob, const MatchBudget& budget) {
+  return glob.Match(str, budget);
+}
+
+// GlobCache keeps the compiled globs of the last patterns, the patterns are
+// spread over shards by hash, each shard has its own lock and evicts with
+// the CLOCK algorithm: a hit marks the entry, and the hand looking for a
+// victim clears the marks it finds, so the entry evicted is one without hits
+// since the last turn of the hand
+//
+// the key is the pattern with the options, the same pattern in path mode is
+// other glob, and each glob type has its own cache, globs are shared, an
+// evicted glob lives while someone holds it
+template<class charT, class globT=extended_glob<charT>>
+class GlobCache {
+ public:
+  using Glob = SharedGlob<charT, globT>;
+  using GlobPtr = std::shared_ptr<const Glob>;
+
+  static constexpr size_t kDefaultCapacity = 1024;
+  static constexpr size_t kDefaultShards = 16;
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t size;
+  };
+
+  GlobCache(size_t capacity = kDefaultCapacity,
+      size_t num_shards = kDefaultShards) {
+    if (num_shards == 0) {
+      num_shards = 1;
+    }
+
+    // the capacity is split over the shards, each shard has at least one
+    // entry
+    shard_capacity_ = std::max<size_t>(1,
+        (capacity + num_shards - 1) / num_shards);
+    for (size_t i = 0; i < num_shards; i++) {
+      shards_.push_back(std::unique_ptr<Shard>(new Shard));
+    }
+  }
+
+  GlobCache(const GlobCache&) = delete;
+  GlobCache& operator=(GlobCache&) = delete;
+
+  // the cache of the process
+  static GlobCache& Default() {
+    static GlobCache cache;
+    return cache;
+  }
+
+  // returns the compiled glob of the pattern, compiling it on a miss, an
+  // invalid pattern throws Error and is not cached
+  GlobPtr Get(const String<charT>& pattern,
+      const GlobOptions& options = GlobOptions()) {
+    Key key{pattern, options.Flags()};
+    Shard& shard = *shards_[KeyHash{}(key) % shards_.size()];
+
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto it = shard.index.find(key);
+      if (it != shard.index.end()) {
+        Slot& slot = shard.slots[it->second];
+        slot.referenced = true;
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return slot.glob;
+      }
+    }
+
+    // the pattern is compiled out of the lock, if other thread compiled the
+    // same pattern meanwhile, its glob is used
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    GlobPtr glob = std::make_shared<const Glob>(pattern, options);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      return shard.slots[it->second].glob;
+    }
+
+    Insert(shard, std::move(key), glob);
+    return glob;
+  }
+
+  Stats GetStats() const {
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    stats.size = 0;
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      stats.size += shard->slots.size();
+    }
+
+    return stats;
+  }
+
+  size_t Capacity() const {
+    return shard_capacity_ * shards_.size();
+  }
+
+  // removes all globs, the counters are kept
+  void Clear() {
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      shard->index.clear();
+      shard->slots.clear();
+      shard->hand = 0;
+    }
+  }
+
+ private:
+  struct Key {
+    String<charT> pattern;
+    uint32_t flags;
+
+    bool operator==(const Key& key) const {
+      return flags == key.flags && pattern == key.pattern;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<String<charT>>{}(key.pattern) ^
+          (std::hash<uint32_t>{}(key.flags) * 0x9e3779b97f4a7c15ull);
+    }
+  };
+
+  struct Slot {
+    Key key;
+    GlobPtr glob;
+    bool referenced;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<Key, size_t, KeyHash> index;
+    std::vector<Slot> slots;
+    size_t hand = 0;
+  };
+
+  // must be called with the lock of the shard
+  void Insert(Shard& shard, Key&& key, GlobPtr glob) {
+    if (shard.slots.size() < shard_capacity_) {
+      shard.index[key] = shard.slots.size();
+      shard.slots.push_back(Slot{std::move(key), std::move(glob), false});
+      return;
+    }
+
+    while (shard.slots[shard.hand].referenced) {
+      shard.slots[shard.hand].referenced = false;
+      shard.hand = (shard.hand + 1) % shard.slots.size();
+    }
+
+    Slot& victim = shard.slots[shard.hand];
+    shard.index.erase(victim.key);
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+
+    shard.index[key] = shard.hand;
+    victim = Slot{std::move(key), std::move(glob), false};
+    shard.hand = (shard.hand + 1) % shard.slots.size();
+  }
+
+  size_t shard_capacity_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> evictions_{0};
+};
+
+// the compiled glob of the pattern from the cache of the process
+template<class charT, class globT=extended_glob<charT>>
+std::shared_ptr<const SharedGlob<charT, globT>> cached_glob(
+    const String<charT>& pattern, const GlobOptions& options = GlobOptions()) {
+  return GlobCache<charT, globT>::Default().Get(pattern, options);
+}
+
+inline std::shared_ptr<const SharedGlob<char>> cached_glob(
+    const char* pattern, const GlobOptions& options = GlobOptions()) {
+  return cached_glob<char>(String<char>(pattern), options);
+}
+
+inline std::shared_ptr<const SharedGlob<wchar_t>> cached_glob(
+    const wchar_t* pattern, const GlobOptions& options = GlobOptions()) {
+  return cached_glob<wchar_t>(String<wchar_t>(pattern), options);
+}
+
+template<class charT, class globT=extended_glob<charT>>
+using shared_glob = SharedGlob<charT, globT>;
+
+using glob_cache = GlobCache<char>;
+using wglob_cache = GlobCache<wchar_t>;
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_GLOB_CACHE_H
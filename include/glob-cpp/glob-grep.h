@@ -0,0 +1,88 @@
+#ifndef GLOB_CPP_GLOB_GREP_H
+#define GLOB_CPP_GLOB_GREP_H
+
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "glob-batch.h"
+#include "literal-search.h"
+#include "mapped-file.h"
+
+namespace glob {
+
+// a line that matched, data points in the buffer that was scanned, so it
+// lives as long as the buffer, offset is the position of the line in the
+// buffer and number counts the lines from 0
+template<class charT>
+struct LineMatch {
+  const charT* data;
+  size_t size;
+  size_t offset;
+  size_t number;
+};
+
+// matches each line of the buffer with the glob in place, and calls
+// on_match(const LineMatch&) for the lines that match, in order, returns the
+// number of matches, a delim at the end of the buffer doesn't start one more
+// line, as in glob_match_packed
+//
+// the lines are not copied and nothing is allocated for each line, only
+// the lines that need the automata are copied to the scratch string of the
+// matcher
+template<class charT, class globT, class OnMatch>
+size_t glob_grep(BasicGlob<charT, globT>& glob, const charT* data,
+    size_t size, OnMatch on_match, charT delim = charT('\n')) {
+  BatchMatcher<charT, globT> matcher(glob);
+  DelimScanner<charT> scanner(data, size, delim);
+  size_t num_matches = 0;
+  size_t number = 0;
+
+  for (size_t begin = 0; begin < size; number++) {
+    size_t end = scanner.Next();
+    size_t len = end - begin;
+    if (matcher.CheckLength(len) && matcher.Match(data + begin, len)) {
+      on_match(LineMatch<charT>{data + begin, len, begin, number});
+      num_matches++;
+    }
+    begin = end + 1;
+  }
+
+  return num_matches;
+}
+
+// maps the file and matches its lines, the LineMatch given to on_match
+// points in the mapped file, it is valid only during the call
+template<class globT, class OnMatch, class = typename std::enable_if<
+    !std::is_base_of<std::ostream, OnMatch>::value>::type>
+size_t glob_grep(BasicGlob<char, globT>& glob, const std::string& path,
+    OnMatch on_match, char delim = '\n') {
+  MappedFile file(path, MappedFile::Access::SEQUENTIAL);
+  return glob_grep(glob, file.Data(), file.Size(), on_match, delim);
+}
+
+// writes the lines of the file that match to out, each one followed by
+// delim
+template<class globT>
+size_t glob_grep(BasicGlob<char, globT>& glob, const std::string& path,
+    std::ostream& out, char delim = '\n') {
+  return glob_grep(glob, path, [&out, delim](const LineMatch<char>& line) {
+    out.write(line.data, static_cast<std::streamsize>(line.size));
+    out.put(delim);
+  }, delim);
+}
+
+// the offsets of the lines of the file that match
+template<class globT>
+std::vector<size_t> glob_grep_offsets(BasicGlob<char, globT>& glob,
+    const std::string& path, char delim = '\n') {
+  std::vector<size_t> offsets;
+  glob_grep(glob, path, [&offsets](const LineMatch<char>& line) {
+    offsets.push_back(line.offset);
+  }, delim);
+  return offsets;
+}
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_GLOB_GREP_H
@@ -0,0 +1,281 @@
+#ifndef GLOB_CPP_GLOB_PARALLEL_H
+#define GLOB_CPP_GLOB_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "glob-batch.h"
+#include "glob-cache.h"
+
+namespace glob {
+
+// ThreadPool runs the tasks of one ParallelFor at a time on its threads, the
+// thread that calls ParallelFor runs tasks as well, so a pool of one thread
+// has no worker and runs everything in the caller
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t num_threads = DefaultNumThreads()) {
+    for (size_t i = 1; i < num_threads; i++) {
+      workers_.push_back(std::thread([this]() { WorkerLoop(); }));
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  // the pool of the process, with one thread for each core
+  static ThreadPool& Default() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  static size_t DefaultNumThreads() {
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+
+  // the workers and the caller
+  size_t NumThreads() const {
+    return workers_.size() + 1;
+  }
+
+  // runs task(i) for each i in [0, num_tasks) and returns when all of them
+  // ended, the first exception of a task is thrown here after the other
+  // tasks end, tasks can't call ParallelFor of the same pool
+  void ParallelFor(size_t num_tasks, std::function<void(size_t)> task) {
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    auto job = std::make_shared<Job>(num_tasks, std::move(task));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = job;
+      generation_++;
+    }
+
+    cv_.notify_all();
+    RunTasks(*job);
+
+    {
+      std::unique_lock<std::mutex> lock(job->mutex);
+      job->done_cv.wait(lock, [&job]() {
+        return job->finished == job->num_tasks;
+      });
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_.reset();
+    }
+
+    if (job->error) {
+      std::rethrow_exception(job->error);
+    }
+  }
+
+ private:
+  // the workers hold the job while they run it, a worker that wakes up late
+  // finds no task left, and never calls the task after ParallelFor returned
+  struct Job {
+    Job(size_t num_tasks, std::function<void(size_t)>&& task)
+      : num_tasks{num_tasks}
+      , task{std::move(task)} {}
+
+    size_t num_tasks;
+    std::function<void(size_t)> task;
+    std::atomic<size_t> next{0};
+
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    size_t finished = 0;
+    std::exception_ptr error;
+  };
+
+  static void RunTasks(Job& job) {
+    while (true) {
+      size_t i = job.next.fetch_add(1, std::memory_order_relaxed);
+      if (i >= job.num_tasks) {
+        return;
+      }
+
+      std::exception_ptr error;
+      try {
+        job.task(i);
+      } catch (...) {
+        error = std::current_exception();
+      }
+
+      std::lock_guard<std::mutex> lock(job.mutex);
+      if (error && !job.error) {
+        job.error = error;
+      }
+
+      if (++job.finished == job.num_tasks) {
+        job.done_cv.notify_all();
+      }
+    }
+  }
+
+  void WorkerLoop() {
+    uint64_t seen = 0;
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this, seen]() {
+          return stop_ || generation_ != seen;
+        });
+
+        if (stop_) {
+          return;
+        }
+
+        seen = generation_;
+        job = job_;
+      }
+
+      if (job) {
+        RunTasks(*job);
+      }
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::shared_ptr<Job> job_;
+  uint64_t generation_ = 0;
+  bool stop_ = false;
+};
+
+// the inputs of a task, small enough to stay in the cache of a core while
+// the task runs, and big enough that taking a task costs nothing
+static const size_t kParallelChunkInputs = 4096;
+static const size_t kParallelChunkBytes = 256 * 1024;
+
+// matches the inputs with the glob on the threads of the pool, returns the
+// indices of the inputs that match, in the order of the inputs, each task
+// takes one compiled glob of the shared glob for all its inputs
+template<class charT, class globT>
+std::vector<size_t> parallel_filter(const SharedGlob<charT, globT>& glob,
+    const String<charT>* inputs, size_t num_inputs,
+    ThreadPool& pool = ThreadPool::Default()) {
+  size_t num_chunks = (num_inputs + kParallelChunkInputs - 1) /
+      kParallelChunkInputs;
+  std::vector<std::vector<size_t>> chunk_matches(num_chunks);
+
+  pool.ParallelFor(num_chunks, [&](size_t chunk) {
+    typename SharedGlob<charT, globT>::Lease lease(glob);
+    BatchMatcher<charT, globT> matcher(lease.Get());
+    size_t first = chunk * kParallelChunkInputs;
+    size_t last = std::min(num_inputs, first + kParallelChunkInputs);
+    for (size_t i = first; i < last; i++) {
+      if (matcher.CheckLength(inputs[i].length()) &&
+          matcher.Match(inputs[i])) {
+        chunk_matches[chunk].push_back(i);
+      }
+    }
+  });
+
+  std::vector<size_t> matches;
+  for (auto& chunk : chunk_matches) {
+    matches.insert(matches.end(), chunk.begin(), chunk.end());
+  }
+
+  return matches;
+}
+
+template<class charT, class globT>
+std::vector<size_t> parallel_filter(const SharedGlob<charT, globT>& glob,
+    const std::vector<String<charT>>& inputs,
+    ThreadPool& pool = ThreadPool::Default()) {
+  return parallel_filter(glob, inputs.data(), inputs.size(), pool);
+}
+
+// matches the strings of a buffer separated by delim, like the lines of a
+// mapped file, the indices are the numbers of the strings in the buffer, as
+// in glob_match_packed
+//
+// the buffer is split in chunks of bytes, a chunk owns the strings that
+// start in it, so a string that crosses the end of a chunk is matched once,
+// the indices of each chunk become global with the number of strings of the
+// chunks before it
+template<class charT, class globT>
+std::vector<size_t> parallel_filter(const SharedGlob<charT, globT>& glob,
+    const charT* data, size_t size, charT delim,
+    ThreadPool& pool = ThreadPool::Default()) {
+  using Traits = std::char_traits<charT>;
+  size_t chunk_size = kParallelChunkBytes / sizeof(charT);
+  size_t num_chunks = (size + chunk_size - 1) / chunk_size;
+  std::vector<std::vector<size_t>> chunk_matches(num_chunks);
+  std::vector<size_t> chunk_strings(num_chunks);
+  const charT* end = data + size;
+
+  pool.ParallelFor(num_chunks, [&](size_t chunk) {
+    const charT* chunk_begin = data + chunk * chunk_size;
+    const charT* chunk_end = std::min(end, chunk_begin + chunk_size);
+
+    // the first string of the chunk starts after the first delim from the
+    // char before the chunk
+    const charT* str = chunk_begin;
+    if (chunk > 0) {
+      str = Traits::find(chunk_begin - 1, chunk_end - chunk_begin + 1, delim);
+      if (str == nullptr) {
+        return;
+      }
+      str++;
+    }
+
+    typename SharedGlob<charT, globT>::Lease lease(glob);
+    BatchMatcher<charT, globT> matcher(lease.Get());
+    size_t num_strings = 0;
+    while (str < chunk_end) {
+      const charT* next = Traits::find(str, end - str, delim);
+      if (next == nullptr) {
+        next = end;
+      }
+
+      size_t len = next - str;
+      if (matcher.CheckLength(len) && matcher.Match(str, len)) {
+        chunk_matches[chunk].push_back(num_strings);
+      }
+
+      num_strings++;
+      str = next + 1;
+    }
+
+    chunk_strings[chunk] = num_strings;
+  });
+
+  std::vector<size_t> matches;
+  size_t first_string = 0;
+  for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+    for (size_t i : chunk_matches[chunk]) {
+      matches.push_back(first_string + i);
+    }
+    first_string += chunk_strings[chunk];
+  }
+
+  return matches;
+}
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_GLOB_PARALLEL_H
@@ -0,0 +1,607 @@
+#ifndef GLOB_CPP_GLOB_SERIALIZE_H
+#define GLOB_CPP_GLOB_SERIALIZE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "glob.h"
+#include "mapped-file.h"
+
+namespace glob {
+
+// the file of compiled globs, all numbers are little endian:
+//
+//   header: magic "GLOBCPP\0", u32 version, u32 size of the char, u32 kind
+//           of glob (0 extended, 1 simple), u32 number of globs
+//   table:  u64 offset and u64 size of each glob, from the start of the file
+//   globs:  the pattern, the u32 flags of the options, the prefilter, the
+//           fast matcher and the automata of each glob
+//
+// strings are a u32 length followed by the chars as u32, the automatas of
+// groups are written inside the state of the group, a glob is loaded from
+// its parts without lexer, parser or optimizer, and each part is validated
+// while it is read, so a corrupted file throws Error instead of building an
+// automata that doesn't end
+static const char kGlobFileMagic[8] = {'G', 'L', 'O', 'B', 'C', 'P', 'P', '\0'};
+static const uint32_t kGlobFileVersion = 2;
+static const size_t kGlobFileHeaderSize = 24;
+
+template<class charT>
+uint32_t GlobFileKind(const ExtendedGlob<charT>*) {
+  return 0;
+}
+
+template<class charT>
+uint32_t GlobFileKind(const SimpleGlob<charT>*) {
+  return 1;
+}
+
+class BinaryWriter {
+ public:
+  void U8(uint8_t v) {
+    data_ += static_cast<char>(v);
+  }
+
+  void U32(uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+      data_ += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+  }
+
+  void U64(uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+      data_ += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+  }
+
+  template<class charT>
+  void Char(charT c) {
+    U32(static_cast<uint32_t>(
+        static_cast<typename std::make_unsigned<charT>::type>(c)));
+  }
+
+  template<class charT>
+  void Str(const String<charT>& str) {
+    U32(static_cast<uint32_t>(str.length()));
+    for (charT c : str) {
+      Char(c);
+    }
+  }
+
+  void Bytes(const std::string& bytes) {
+    data_ += bytes;
+  }
+
+  const std::string& Data() const {
+    return data_;
+  }
+
+ private:
+  std::string data_;
+};
+
+// reads the parts of a file in memory, any read out of the memory throws
+class BinaryReader {
+ public:
+  BinaryReader(const unsigned char* data, size_t size)
+    : data_{data}
+    , size_{size}
+    , pos_{0} {}
+
+  uint8_t U8() {
+    Need(1);
+    return data_[pos_++];
+  }
+
+  uint32_t U32() {
+    Need(4);
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+      v |= static_cast<uint32_t>(data_[pos_++]) << (8 * i);
+    }
+    return v;
+  }
+
+  uint64_t U64() {
+    Need(8);
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+      v |= static_cast<uint64_t>(data_[pos_++]) << (8 * i);
+    }
+    return v;
+  }
+
+  template<class charT>
+  charT Char() {
+    uint32_t v = U32();
+    using UChar = typename std::make_unsigned<charT>::type;
+    if (v > std::numeric_limits<UChar>::max()) {
+      throw Error("invalid char in glob file");
+    }
+    return static_cast<charT>(static_cast<UChar>(v));
+  }
+
+  template<class charT>
+  String<charT> Str() {
+    uint32_t len = Count(4);
+    String<charT> str;
+    str.reserve(len);
+    for (uint32_t i = 0; i < len; i++) {
+      str += Char<charT>();
+    }
+    return str;
+  }
+
+  // a number of elements that follow, each one with at least elem_size
+  // bytes, so a corrupted count can't allocate more than the file has
+  uint32_t Count(size_t elem_size) {
+    uint32_t n = U32();
+    if (n > (size_ - pos_) / elem_size) {
+      throw Error("truncated glob file");
+    }
+    return n;
+  }
+
+  bool End() const {
+    return pos_ == size_;
+  }
+
+ private:
+  void Need(size_t n) {
+    if (size_ - pos_ < n) {
+      throw Error("truncated glob file");
+    }
+  }
+
+  const unsigned char* data_;
+  size_t size_;
+  size_t pos_;
+};
+
+template<class charT>
+void WritePrefilter(BinaryWriter& w, const Prefilter<charT>& prefilter) {
+  w.U64(prefilter.MinLength());
+  w.U64(prefilter.MaxLength());
+  w.U8(prefilter.Exact());
+  w.Str(prefilter.Prefix());
+  w.Str(prefilter.Suffix());
+  w.U32(static_cast<uint32_t>(prefilter.Literals().size()));
+  for (auto& literal : prefilter.Literals()) {
+    w.Str(literal);
+  }
+}
+
+template<class charT>
+Prefilter<charT> ReadPrefilter(BinaryReader& r) {
+  uint64_t min_len = r.U64();
+  uint64_t max_len = r.U64();
+  bool exact = r.U8() != 0;
+  String<charT> prefix = r.template Str<charT>();
+  String<charT> suffix = r.template Str<charT>();
+  std::vector<String<charT>> literals(r.Count(4));
+  for (auto& literal : literals) {
+    literal = r.template Str<charT>();
+  }
+
+  // Check reads the prefix, the suffix and the literals inside a string of
+  // min_len chars, so they must fit in it
+  uint64_t fixed_len = prefix.length() + suffix.length();
+  for (auto& literal : literals) {
+    fixed_len += literal.length();
+  }
+
+  if (min_len > max_len || max_len > std::numeric_limits<size_t>::max() ||
+      min_len < fixed_len) {
+    throw Error("invalid prefilter in glob file");
+  }
+
+  return Prefilter<charT>(static_cast<size_t>(min_len),
+      static_cast<size_t>(max_len), prefix, suffix, std::move(literals), exact);
+}
+
+template<class charT>
+void WriteFastMatcher(BinaryWriter& w, const FastMatcher<charT>* matcher) {
+  if (!matcher) {
+    w.U8(0);
+    return;
+  }
+
+  w.U8(1);
+  w.U32(static_cast<uint32_t>(matcher->Items().size()));
+  for (auto& item : matcher->Items()) {
+    w.U8(static_cast<uint8_t>(item.kind));
+    w.Char(item.c);
+    w.U8(item.neg);
+    w.U32(static_cast<uint32_t>(item.ranges.size()));
+    for (auto& range : item.ranges) {
+      w.Char(range.first);
+      w.Char(range.second);
+    }
+  }
+}
+
+template<class charT>
+std::unique_ptr<FastMatcher<charT>> ReadFastMatcher(BinaryReader& r,
+    bool path_mode) {
+  using Kind = typename ShiftAndItem<charT>::Kind;
+  if (r.U8() == 0) {
+    return nullptr;
+  }
+
+  std::vector<ShiftAndItem<charT>> items(r.Count(10));
+  for (auto& item : items) {
+    uint8_t kind = r.U8();
+    if (kind > static_cast<uint8_t>(Kind::DIRS)) {
+      throw Error("invalid fast matcher in glob file");
+    }
+
+    item.kind = static_cast<Kind>(kind);
+    item.c = r.template Char<charT>();
+    item.neg = r.U8() != 0;
+    item.ranges.resize(r.Count(8));
+    for (auto& range : item.ranges) {
+      range.first = r.template Char<charT>();
+      range.second = r.template Char<charT>();
+    }
+  }
+
+  // the engine must be one that NewShiftAnd can build
+  auto matcher = NewShiftAnd(std::move(items), path_mode);
+  if (!matcher) {
+    throw Error("invalid fast matcher in glob file");
+  }
+
+  return matcher;
+}
+
+template<class charT>
+void WriteAutomata(BinaryWriter& w, const Automata<charT>& automata) {
+  w.U32(static_cast<uint32_t>(automata.GetNumStates()));
+  w.U32(static_cast<uint32_t>(automata.MatchState()));
+  w.U32(static_cast<uint32_t>(automata.FailState()));
+
+  for (size_t i = 0; i < automata.GetNumStates(); i++) {
+    const State<charT>& state = automata.GetState(i);
+    w.U8(static_cast<uint8_t>(state.Type()));
+
+    switch (state.Type()) {
+      case StateType::CHAR:
+        w.Char(static_cast<const StateChar<charT>&>(state).Char());
+        break;
+
+      case StateType::QUESTION:
+        w.U64(static_cast<const StateAny<charT>&>(state).Width());
+        break;
+
+      case StateType::MULT:
+        w.U8(static_cast<uint8_t>(
+            static_cast<const StateStar<charT>&>(state).Kind()));
+        break;
+
+      case StateType::SET: {
+        auto& set = static_cast<const StateSet<charT>&>(state);
+        w.U8(set.Neg());
+        w.U32(static_cast<uint32_t>(set.Ranges().size()));
+        for (auto& range : set.Ranges()) {
+          w.Char(range.first);
+          w.Char(range.second);
+        }
+        break;
+      }
+
+      case StateType::GROUP: {
+        auto& group = static_cast<const StateGroup<charT>&>(state);
+        w.U8(static_cast<uint8_t>(group.GroupType()));
+        w.U32(static_cast<uint32_t>(group.Automatas().size()));
+        for (auto& sub_automata : group.Automatas()) {
+          WriteAutomata(w, *sub_automata);
+        }
+        break;
+      }
+
+      default:
+        break;
+    }
+
+    w.U32(static_cast<uint32_t>(state.GetNextStates().size()));
+    for (size_t next : state.GetNextStates()) {
+      w.U32(static_cast<uint32_t>(next));
+    }
+  }
+}
+
+// the automatas of groups are read recursively, the depth is limited so a
+// corrupted file can't overflow the stack, the states of '?' and sets take
+// the path mode of the options of the glob
+static const size_t kMaxGlobFileDepth = 256;
+
+template<class charT>
+void ReadAutomata(BinaryReader& r, Automata<charT>& automata,
+    bool path_mode, size_t depth = 0) {
+  using GroupType = typename StateGroup<charT>::Type;
+  if (depth > kMaxGlobFileDepth) {
+    throw Error("glob file has groups too deep");
+  }
+
+  uint32_t num_states = r.Count(5);
+  uint32_t match_state = r.U32();
+  uint32_t fail_state = r.U32();
+  if (match_state >= num_states || fail_state >= num_states) {
+    throw Error("invalid automata in glob file");
+  }
+
+  for (uint32_t i = 0; i < num_states; i++) {
+    uint8_t type = r.U8();
+    size_t min_next = 1;
+
+    switch (static_cast<StateType>(type)) {
+      case StateType::MATCH:
+        automata.template NewState<StateMatch<charT>>();
+        min_next = 0;
+        break;
+
+      case StateType::FAIL:
+        automata.template NewState<StateFail<charT>>();
+        min_next = 0;
+        break;
+
+      case StateType::CHAR:
+        automata.template NewState<StateChar<charT>>(r.template Char<charT>());
+        break;
+
+      case StateType::QUESTION: {
+        uint64_t width = r.U64();
+        if (width == 0 || width > std::numeric_limits<size_t>::max()) {
+          throw Error("invalid automata in glob file");
+        }
+        automata.template NewState<StateAny<charT>>(static_cast<size_t>(width),
+            path_mode);
+        break;
+      }
+
+      case StateType::MULT: {
+        uint8_t kind = r.U8();
+        if (kind > static_cast<uint8_t>(StarKind::DIRS)) {
+          throw Error("invalid automata in glob file");
+        }
+        automata.template NewState<StateStar<charT>>(
+            static_cast<StarKind>(kind));
+        min_next = 2;
+        break;
+      }
+
+      case StateType::SET: {
+        bool neg = r.U8() != 0;
+        std::vector<std::pair<charT, charT>> ranges(r.Count(8));
+        for (auto& range : ranges) {
+          charT start = r.template Char<charT>();
+          charT end = r.template Char<charT>();
+          range = start < end ? std::make_pair(start, end) :
+              std::make_pair(end, start);
+        }
+        automata.template NewState<StateSet<charT>>(std::move(ranges), neg,
+            path_mode);
+        break;
+      }
+
+      case StateType::GROUP: {
+        uint8_t group_type = r.U8();
+        if (group_type > static_cast<uint8_t>(GroupType::AT)) {
+          throw Error("invalid automata in glob file");
+        }
+
+        std::vector<std::unique_ptr<Automata<charT>>> automatas(r.Count(12));
+        for (auto& sub_automata : automatas) {
+          sub_automata.reset(new Automata<charT>);
+          ReadAutomata(r, *sub_automata, path_mode, depth + 1);
+        }
+        automata.template NewState<StateGroup<charT>>(
+            static_cast<GroupType>(group_type), std::move(automatas));
+        min_next = 2;
+        break;
+      }
+
+      default:
+        throw Error("invalid automata in glob file");
+    }
+
+    // the automata only goes forward, a state points to itself only as the
+    // first next state, the one of the loops of stars and groups, so there
+    // is no path that doesn't consume the string
+    uint32_t num_next = r.Count(4);
+    if (num_next < min_next || num_next > NextStates::kMaxNextStates) {
+      throw Error("invalid automata in glob file");
+    }
+
+    for (uint32_t j = 0; j < num_next; j++) {
+      uint32_t next = r.U32();
+      if (next >= num_states || next < i || (next == i && j != 0)) {
+        throw Error("invalid automata in glob file");
+      }
+      automata.GetState(i).AddNextState(next);
+    }
+  }
+
+  if (automata.GetState(match_state).Type() != StateType::MATCH ||
+      automata.GetState(fail_state).Type() != StateType::FAIL) {
+    throw Error("invalid automata in glob file");
+  }
+
+  automata.SetMatchState(match_state);
+  automata.SetFailState(fail_state);
+}
+
+// GlobWriter compiles the patterns and writes the file, it is meant to run
+// offline, so the programs that load the file don't compile anything
+template<class charT, class globT=extended_glob<charT>>
+class GlobWriter {
+ public:
+  // compiles the pattern and returns its index in the file, an invalid
+  // pattern throws Error
+  size_t Add(const String<charT>& pattern,
+      const GlobOptions& options = GlobOptions()) {
+    BasicGlob<charT, globT> g(pattern, options);
+    BinaryWriter w;
+    w.Str(pattern);
+    w.U32(options.Flags());
+    WritePrefilter(w, g.GetPrefilter());
+    WriteFastMatcher(w, g.GetFastMatcher());
+    WriteAutomata(w, g.GetAutomata());
+    records_.push_back(w.Data());
+    return records_.size() - 1;
+  }
+
+  size_t Size() const {
+    return records_.size();
+  }
+
+  std::string Data() const {
+    BinaryWriter w;
+    w.Bytes(std::string(kGlobFileMagic, sizeof(kGlobFileMagic)));
+    w.U32(kGlobFileVersion);
+    w.U32(static_cast<uint32_t>(sizeof(charT)));
+    w.U32(GlobFileKind(static_cast<const globT*>(nullptr)));
+    w.U32(static_cast<uint32_t>(records_.size()));
+
+    uint64_t offset = kGlobFileHeaderSize + 16 * records_.size();
+    for (auto& record : records_) {
+      w.U64(offset);
+      w.U64(record.size());
+      offset += record.size();
+    }
+
+    for (auto& record : records_) {
+      w.Bytes(record);
+    }
+
+    return w.Data();
+  }
+
+  void Write(const std::string& path) const {
+    std::string data = Data();
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!file) {
+      throw Error("can't write glob file: " + path);
+    }
+  }
+
+ private:
+  std::vector<std::string> records_;
+};
+
+// GlobFile reads a file of GlobWriter, the file is mapped in memory, so the
+// processes that load the same file share its pages, and each glob is
+// loaded only when it is needed
+template<class charT, class globT=extended_glob<charT>>
+class GlobFile {
+ public:
+  // maps the file and checks the header and the table
+  GlobFile(const std::string& path)
+    : file_{new MappedFile(path)}
+    , data_{reinterpret_cast<const unsigned char*>(file_->Data())}
+    , size_{file_->Size()} {
+    ReadTable();
+  }
+
+  // a file already in memory, the memory must live while the GlobFile
+  // is used
+  GlobFile(const void* data, size_t size)
+    : data_{static_cast<const unsigned char*>(data)}
+    , size_{size} {
+    ReadTable();
+  }
+
+  GlobFile(const GlobFile&) = delete;
+  GlobFile& operator=(GlobFile&) = delete;
+
+  size_t Size() const {
+    return table_.size();
+  }
+
+  String<charT> Pattern(size_t i) const {
+    BinaryReader r = Record(i);
+    return r.template Str<charT>();
+  }
+
+  // builds the glob i from the file
+  BasicGlob<charT, globT> Load(size_t i) const {
+    BinaryReader r = Record(i);
+    String<charT> pattern = r.template Str<charT>();
+    GlobOptions options = GlobOptions::FromFlags(r.U32());
+    Prefilter<charT> prefilter = ReadPrefilter<charT>(r);
+    std::unique_ptr<FastMatcher<charT>> fast_matcher =
+        ReadFastMatcher<charT>(r, options.PathMode());
+    Automata<charT> automata;
+    ReadAutomata(r, automata, options.PathMode());
+    if (!r.End()) {
+      throw Error("invalid glob in glob file");
+    }
+
+    return BasicGlob<charT, globT>(globT(std::move(automata),
+        std::move(prefilter), std::move(fast_matcher), options, pattern));
+  }
+
+  std::vector<BasicGlob<charT, globT>> LoadAll() const {
+    std::vector<BasicGlob<charT, globT>> globs;
+    globs.reserve(table_.size());
+    for (size_t i = 0; i < table_.size(); i++) {
+      globs.push_back(Load(i));
+    }
+    return globs;
+  }
+
+ private:
+  void ReadTable() {
+    BinaryReader r(data_, size_);
+    for (size_t i = 0; i < sizeof(kGlobFileMagic); i++) {
+      if (r.U8() != static_cast<uint8_t>(kGlobFileMagic[i])) {
+        throw Error("not a glob file");
+      }
+    }
+
+    if (r.U32() != kGlobFileVersion) {
+      throw Error("unsupported version of glob file");
+    }
+
+    if (r.U32() != sizeof(charT) ||
+        r.U32() != GlobFileKind(static_cast<const globT*>(nullptr))) {
+      throw Error("glob file has other kind of glob");
+    }
+
+    table_.resize(r.Count(16));
+    for (auto& entry : table_) {
+      uint64_t offset = r.U64();
+      uint64_t size = r.U64();
+      if (offset > size_ || size > size_ - offset) {
+        throw Error("truncated glob file");
+      }
+      entry = std::make_pair(static_cast<size_t>(offset),
+          static_cast<size_t>(size));
+    }
+  }
+
+  BinaryReader Record(size_t i) const {
+    if (i >= table_.size()) {
+      throw Error("glob index out of the file");
+    }
+    return BinaryReader(data_ + table_[i].first, table_[i].second);
+  }
+
+  std::unique_ptr<MappedFile> file_;
+  const unsigned char* data_ = nullptr;
+  size_t size_ = 0;
+  std::vector<std::pair<size_t, size_t>> table_;
+};
+
+using glob_writer = GlobWriter<char>;
+using wglob_writer = GlobWriter<wchar_t>;
+using glob_file = GlobFile<char>;
+using wglob_file = GlobFile<wchar_t>;
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_GLOB_SERIALIZE_H
@@ -0,0 +1,140 @@
+#ifndef GLOB_CPP_GLOB_STREAM_H
+#define GLOB_CPP_GLOB_STREAM_H
+
+#include <algorithm>
+#include <string>
+#include "glob.h"
+
+namespace glob {
+
+// StreamMatcher matches a string that is given in parts, like the names of
+// a path read in a walk or the buffers of a socket, after each part it tells
+// if the string can still match, so the caller can stop reading as soon as
+// the answer is known
+//
+// globs with a fast matcher keep only its bit vector, the parts are not
+// copied, the other globs keep the parts until Finish runs the automata, and
+// until then only the prefix and the max length of the prefilter can find
+// that the string is dead, they never answer WILL_MATCH
+template<class charT, class globT=extended_glob<charT>>
+class StreamMatcher {
+ public:
+  StreamMatcher(BasicGlob<charT, globT>& glob)
+    : glob_(glob)
+    , prefilter_(glob.GetPrefilter())
+    , fast_matcher_(glob.GetFastMatcher()) {
+    Reset();
+  }
+
+  // starts a new string
+  void Reset() {
+    len_ = 0;
+    buffer_.clear();
+    status_ = StreamStatus::CAN_MATCH;
+    if (fast_matcher_) {
+      fast_matcher_->StreamStart(state_);
+      status_ = fast_matcher_->StreamFeed(state_, nullptr, 0);
+    }
+  }
+
+  // reads the next part of the string, once the string is dead or will
+  // match, the next parts don't change the status and are not read
+  StreamStatus Feed(const charT* part, size_t len) {
+    if (status_ != StreamStatus::CAN_MATCH) {
+      len_ += len;
+      return status_;
+    }
+
+    if (fast_matcher_) {
+      len_ += len;
+      status_ = fast_matcher_->StreamFeed(state_, part, len);
+      return status_;
+    }
+
+    // only the chars of the part that fall in the prefix are compared
+    using Traits = std::char_traits<charT>;
+    const String<charT>& prefix = prefilter_.Prefix();
+    if (len_ < prefix.length()) {
+      size_t n = std::min(len, prefix.length() - len_);
+      if (Traits::compare(part, prefix.data() + len_, n) != 0) {
+        status_ = StreamStatus::DEAD;
+      }
+    }
+
+    len_ += len;
+    if (len_ > prefilter_.MaxLength()) {
+      status_ = StreamStatus::DEAD;
+    }
+
+    if (status_ == StreamStatus::DEAD) {
+      buffer_.clear();
+    } else {
+      buffer_.append(part, len);
+    }
+
+    return status_;
+  }
+
+  StreamStatus Feed(const String<charT>& part) {
+    return Feed(part.data(), part.length());
+  }
+
+  StreamStatus Status() const {
+    return status_;
+  }
+
+  // the number of chars given since the start of the string
+  size_t Length() const {
+    return len_;
+  }
+
+  // true if the whole string matches, the matcher keeps the string until
+  // Reset
+  bool Finish() {
+    switch (status_) {
+      case StreamStatus::DEAD:
+        return false;
+
+      case StreamStatus::WILL_MATCH:
+        return true;
+
+      default:
+        if (fast_matcher_) {
+          return fast_matcher_->StreamMatch(state_);
+        }
+
+        return glob_match(buffer_, glob_);
+    }
+  }
+
+ private:
+  BasicGlob<charT, globT>& glob_;
+  const Prefilter<charT>& prefilter_;
+  const FastMatcher<charT>* fast_matcher_;
+  typename FastMatcher<charT>::StreamState state_;
+  StreamStatus status_;
+  size_t len_;
+  String<charT> buffer_;
+};
+
+// tells if strings that start with prefix can match the glob, like the
+// path of a directory in a walk, DEAD means that no string under it matches,
+// so the walk can skip it, the answer comes from the live states of the fast
+// matcher, or only from the prefilter for globs with groups, so CAN_MATCH
+// doesn't mean that a match exists
+template<class charT, class globT>
+StreamStatus glob_match_prefix(const String<charT>& prefix,
+    BasicGlob<charT, globT>& glob) {
+  StreamMatcher<charT, globT> matcher(glob);
+  return matcher.Feed(prefix);
+}
+
+template<class charT, class globT>
+StreamStatus glob_match_prefix(const charT* prefix,
+    BasicGlob<charT, globT>& glob) {
+  return glob_match_prefix(String<charT>(prefix), glob);
+}
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_GLOB_STREAM_H
@@ -0,0 +1,466 @@
+#ifndef GLOB_CPP_GLOB_WATCHER_H
+#define GLOB_CPP_GLOB_WATCHER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "glob.h"
+#include "glob-stream.h"
+#include "dir-source.h"
+
+#ifdef __linux__
+#define GLOB_CPP_HAS_INOTIFY 1
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace glob {
+
+enum class WatchEventType {
+  ADDED,
+  REMOVED,
+  MODIFIED
+};
+
+struct WatchEvent {
+  WatchEventType type;
+  std::string path;
+};
+
+// GlobWatcher keeps the set of paths that match some globs up to date,
+// after a first walk it tells which paths were added, removed or modified,
+// so a process doesn't run the globs again to find the changes
+//
+// the patterns match whole paths as globs in path mode, relative to the
+// working directory or absolute, the walk starts at the directories of the
+// literal prefix of each pattern, or at the deepest one that exists, and
+// enters only the directories that a pattern can match below, see
+// glob_match_prefix, each directory of the walk has an inotify watch, the
+// events of a directory that is created are found by a walk of it
+//
+// the events of one Poll are merged, a path modified many times is one
+// event, if the queue of the kernel overflows, or without inotify, Poll
+// walks the directories again and tells the difference with the last walk,
+// the watcher is used by one thread
+class GlobWatcher {
+ public:
+  explicit GlobWatcher(const std::vector<std::string>& patterns) {
+    GlobOptions options;
+    options.SetPathMode(true);
+    for (auto& pattern : patterns) {
+      std::string normalized = pattern;
+      while (normalized.compare(0, 2, "./") == 0) {
+        normalized.erase(0, 2);
+      }
+
+      globs_.emplace_back(new glob(normalized, options));
+      roots_.push_back(RootOf(normalized));
+    }
+
+#ifdef GLOB_CPP_HAS_INOTIFY
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0) {
+      throw Error("can't init inotify");
+    }
+#endif
+
+    // the destructor doesn't run when the constructor throws, like when the
+    // watches run out
+    std::vector<WatchEvent> events;
+    try {
+      WalkRoots(false, events);
+    } catch (...) {
+#ifdef GLOB_CPP_HAS_INOTIFY
+      close(fd_);
+#endif
+      throw;
+    }
+  }
+
+  GlobWatcher(const GlobWatcher&) = delete;
+  GlobWatcher& operator=(const GlobWatcher&) = delete;
+
+  ~GlobWatcher() {
+#ifdef GLOB_CPP_HAS_INOTIFY
+    close(fd_);
+#endif
+  }
+
+  // the paths that match now, sorted
+  std::vector<std::string> Matches() const {
+    std::vector<std::string> paths;
+    for (auto& match : matches_) {
+      paths.push_back(match.first);
+    }
+    return paths;
+  }
+
+  // the number of directories of the walk
+  size_t NumWatches() const {
+    return dirs_.size();
+  }
+
+  // a descriptor to wait on with poll or epoll, -1 without inotify
+  int Fd() const {
+    return fd_;
+  }
+
+  // without inotify a Poll that waits until there is a change walks the
+  // directories again after each period
+  static constexpr int kRescanPeriodMs = 1000;
+
+  // waits up to timeout_ms for changes, -1 waits until there is one, and
+  // calls on_event(const WatchEvent&) for each one, in order, returns the
+  // number of events
+  //
+  // the events of the kernel for paths that don't match are not changes, so
+  // the wait goes on after them, without inotify the changes are found by a
+  // walk after the timeout, a negative timeout walks each kRescanPeriodMs
+  // until a walk finds changes
+  template<class OnEvent>
+  size_t Poll(int timeout_ms, OnEvent on_event) {
+    std::vector<WatchEvent> events;
+#ifdef GLOB_CPP_HAS_INOTIFY
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point deadline = Clock::now() +
+        std::chrono::milliseconds(std::max(timeout_ms, 0));
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    while (true) {
+      int wait_ms = -1;
+      if (timeout_ms >= 0) {
+        auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - Clock::now()).count();
+        wait_ms = static_cast<int>(std::max<int64_t>(0, (left + 999) / 1000));
+      }
+
+      int ret = ::poll(&pfd, 1, wait_ms);
+      if (ret > 0) {
+        ReadEvents(events);
+      } else if (ret < 0 && errno != EINTR) {
+        throw Error("can't poll inotify");
+      }
+
+      if (!events.empty() || (timeout_ms >= 0 && Clock::now() >= deadline)) {
+        break;
+      }
+    }
+#else
+    do {
+      std::this_thread::sleep_for(std::chrono::milliseconds(
+          timeout_ms < 0 ? kRescanPeriodMs : timeout_ms));
+      Rescan(events);
+    } while (timeout_ms < 0 && events.empty());
+#endif
+
+    for (auto& event : events) {
+      on_event(event);
+    }
+    return events.size();
+  }
+
+  std::vector<WatchEvent> Poll(int timeout_ms) {
+    std::vector<WatchEvent> events;
+    Poll(timeout_ms, [&events](const WatchEvent& event) {
+      events.push_back(event);
+    });
+    return events;
+  }
+
+ private:
+  // the directories of the leading segments of the pattern that have no
+  // wildcard, the last segment is matched in its directory
+  static std::string RootOf(const std::string& pattern) {
+    std::string root = !pattern.empty() && pattern[0] == '/' ? "/" : "";
+    size_t pos = root.length();
+    while (true) {
+      size_t end = pattern.find('/', pos);
+      if (end == std::string::npos) {
+        return root;
+      }
+
+      std::string segment = pattern.substr(pos, end - pos);
+      if (segment.find_first_of("*?[]()|!+@\\") != std::string::npos) {
+        return root;
+      }
+
+      if (!segment.empty()) {
+        root = Join(root, segment);
+      }
+      pos = end + 1;
+    }
+  }
+
+  static std::string Join(const std::string& dir, const std::string& name) {
+    if (dir.empty()) {
+      return name;
+    }
+    return dir == "/" ? dir + name : dir + "/" + name;
+  }
+
+  static std::string SysPath(const std::string& dir) {
+    return dir.empty() ? "." : dir;
+  }
+
+  bool Matches(const std::string& path) {
+    for (auto& g : globs_) {
+      if (glob_match(path, *g)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // a directory can have matches below it when some glob can match a path
+  // that starts with it
+  bool Feasible(const std::string& dir) {
+    std::string prefix = dir == "/" ? dir : dir + "/";
+    for (auto& g : globs_) {
+      if (glob_match_prefix(prefix, *g) != StreamStatus::DEAD) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // the walk of each root starts at its deepest directory that exists, so
+  // a root that is created later is seen
+  void WalkRoots(bool emit, std::vector<WatchEvent>& events) {
+    for (auto& root : roots_) {
+      std::string dir = root;
+      EntryStat stat;
+      while (!dir.empty() && dir != "/" &&
+          !(source_.Stat(dir, stat) && stat.type == EntryType::DIR)) {
+        size_t slash = dir.rfind('/');
+        dir = slash == std::string::npos ? "" :
+            dir.substr(0, slash == 0 ? 1 : slash);
+      }
+
+      Walk(dir, emit, events);
+    }
+  }
+
+  // the watch is added before the listing, so an entry created meanwhile
+  // is in the listing or in the events
+  void Walk(const std::string& dir, bool emit,
+      std::vector<WatchEvent>& events) {
+    if (dirs_.find(dir) != dirs_.end()) {
+      return;
+    }
+
+    int wd = AddWatch(dir);
+    dirs_[dir] = wd;
+    if (wd >= 0) {
+      paths_[wd] = dir;
+    }
+
+    std::vector<DirEntry> entries;
+    if (!source_.List(SysPath(dir), entries)) {
+      return;
+    }
+
+    for (auto& entry : entries) {
+      std::string path = Join(dir, entry.name);
+      if (Matches(path)) {
+        Add(path, emit, events);
+      }
+
+      if (entry.type == EntryType::DIR && Feasible(path)) {
+        Walk(path, emit, events);
+      }
+    }
+  }
+
+  void Add(const std::string& path, bool emit,
+      std::vector<WatchEvent>& events) {
+    EntryStat stat{EntryType::OTHER, 0, 0};
+    source_.Stat(path, stat);
+    if (matches_.emplace(path, stat).second && emit) {
+      events.push_back(WatchEvent{WatchEventType::ADDED, path});
+    }
+  }
+
+  void Remove(const std::string& path, std::vector<WatchEvent>& events) {
+    if (matches_.erase(path) > 0) {
+      events.push_back(WatchEvent{WatchEventType::REMOVED, path});
+    }
+  }
+
+  // the matches and the watches of the directory and below it
+  void RemoveTree(const std::string& dir, std::vector<WatchEvent>& events) {
+    std::string prefix = dir.empty() || dir == "/" ? dir : dir + "/";
+    auto below = [&prefix](const std::string& path) {
+      return path.compare(0, prefix.length(), prefix) == 0;
+    };
+
+    for (auto it = matches_.lower_bound(prefix);
+        it != matches_.end() && below(it->first);) {
+      events.push_back(WatchEvent{WatchEventType::REMOVED, it->first});
+      it = matches_.erase(it);
+    }
+
+    RemoveWatch(dir);
+    for (auto it = dirs_.lower_bound(prefix);
+        it != dirs_.end() && below(it->first);) {
+      RemoveWatch((it++)->first);
+    }
+  }
+
+  void RemoveWatch(const std::string& dir) {
+    auto it = dirs_.find(dir);
+    if (it == dirs_.end()) {
+      return;
+    }
+
+#ifdef GLOB_CPP_HAS_INOTIFY
+    if (it->second >= 0) {
+      inotify_rm_watch(fd_, it->second);
+      paths_.erase(it->second);
+    }
+#endif
+    dirs_.erase(it);
+  }
+
+  // walks again from the roots, and tells the difference with the last
+  // walk, the paths with other mtime or size are modified
+  void Rescan(std::vector<WatchEvent>& events) {
+    std::map<std::string, EntryStat> old_matches = std::move(matches_);
+    matches_.clear();
+    while (!dirs_.empty()) {
+      RemoveWatch(dirs_.begin()->first);
+    }
+
+    WalkRoots(false, events);
+    for (auto& match : old_matches) {
+      auto it = matches_.find(match.first);
+      if (it == matches_.end()) {
+        events.push_back(WatchEvent{WatchEventType::REMOVED, match.first});
+      } else if (it->second.mtime != match.second.mtime ||
+          it->second.size != match.second.size) {
+        events.push_back(WatchEvent{WatchEventType::MODIFIED, match.first});
+      }
+    }
+
+    for (auto& match : matches_) {
+      if (old_matches.find(match.first) == old_matches.end()) {
+        events.push_back(WatchEvent{WatchEventType::ADDED, match.first});
+      }
+    }
+  }
+
+#ifdef GLOB_CPP_HAS_INOTIFY
+  static constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE |
+      IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+  // a directory without a watch would miss its changes, so running out of
+  // watches is an error
+  int AddWatch(const std::string& dir) {
+    int wd = inotify_add_watch(fd_, SysPath(dir).c_str(), kWatchMask);
+    if (wd < 0 && errno == ENOSPC) {
+      throw Error("no inotify watches left for: " + dir);
+    }
+    return wd;
+  }
+
+  void ReadEvents(std::vector<WatchEvent>& events) {
+    alignas(struct inotify_event) char buf[8192];
+    std::unordered_set<std::string> changed;
+    bool overflow = false;
+
+    while (true) {
+      ssize_t len = read(fd_, buf, sizeof(buf));
+      if (len <= 0) {
+        break;
+      }
+
+      for (ssize_t pos = 0; pos < len;) {
+        auto* event = reinterpret_cast<struct inotify_event*>(buf + pos);
+        pos += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+        if (event->mask & IN_Q_OVERFLOW) {
+          overflow = true;
+          continue;
+        }
+
+        auto it = paths_.find(event->wd);
+        if (it != paths_.end()) {
+          std::string dir = it->second;
+          HandleEvent(dir, *event, changed, events);
+        }
+      }
+    }
+
+    if (overflow) {
+      Rescan(events);
+    }
+  }
+
+  // changed has the paths added or modified in this Poll, so each one is
+  // one event
+  void HandleEvent(const std::string& dir, const struct inotify_event& event,
+      std::unordered_set<std::string>& changed,
+      std::vector<WatchEvent>& events) {
+    // the directory was removed or moved, its parent may not be watched,
+    // so the roots are walked again
+    if (event.mask & (IN_IGNORED | IN_MOVE_SELF)) {
+      RemoveTree(dir, events);
+      WalkRoots(true, events);
+      return;
+    }
+
+    std::string path = Join(dir, event.len > 0 ? event.name : "");
+    if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+      size_t num_events = events.size();
+      if (Matches(path)) {
+        Add(path, true, events);
+      }
+      if ((event.mask & IN_ISDIR) && Feasible(path)) {
+        Walk(path, true, events);
+      }
+
+      for (size_t i = num_events; i < events.size(); i++) {
+        changed.insert(events[i].path);
+      }
+    } else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+      Remove(path, events);
+      changed.erase(path);
+      if (event.mask & IN_ISDIR) {
+        RemoveTree(path, events);
+      }
+    } else if (event.mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB)) {
+      auto it = matches_.find(path);
+      if (it != matches_.end() && changed.insert(path).second) {
+        source_.Stat(path, it->second);
+        events.push_back(WatchEvent{WatchEventType::MODIFIED, path});
+      }
+    }
+  }
+#else
+  int AddWatch(const std::string&) {
+    return -1;
+  }
+#endif
+
+  std::vector<std::unique_ptr<glob>> globs_;
+  std::vector<std::string> roots_;
+  SystemDirSource source_;
+  int fd_ = -1;
+
+  // the matches with their stats, and the directories of the walk with
+  // their watches, sorted, so the paths below a directory are a range
+  std::map<std::string, EntryStat> matches_;
+  std::map<std::string, int> dirs_;
+  std::unordered_map<int, std::string> paths_;
+};
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_GLOB_WATCHER_H
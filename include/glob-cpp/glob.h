@@ -1,10 +1,25 @@
 #ifndef GLOB_CPP_H
 #define GLOB_CPP_H
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <ostream>
 #include <string>
 #include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <memory>
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+#include "literal-search.h"
 
 namespace glob {
 
@@ -14,6 +29,12 @@ using String = std::basic_string<charT>;
 template<class charT>
 class Automata;
 
+template<class charT>
+class StateStar;
+
+template<class charT>
+class StateAny;
+
 class Error: public std::exception {
  public:
   Error(const std::string& msg): msg_{msg} {}
@@ -25,6 +46,227 @@ class Error: public std::exception {
   std::string msg_;
 };
 
+// Arena is a monotonic allocator, objects are placed one after the other in
+// blocks, and all blocks are freed at once when the arena is destroyed, the
+// destructors of the objects are not called by the arena
+//
+// the first block can be a buffer of the caller, like a buffer on the stack,
+// so short lived arenas don't allocate at all, an arena with a buffer of the
+// caller can't be moved, only the arenas that own all their memory, like the
+// one of Automata, are moved
+class Arena {
+ public:
+  static constexpr size_t kDefaultBlockSize = 1024;
+
+  explicit Arena(size_t block_size = kDefaultBlockSize)
+    : next_block_size_{block_size} {}
+
+  Arena(void* buffer, size_t size, size_t block_size = kDefaultBlockSize)
+    : ptr_{static_cast<char*>(buffer)}
+    , end_{static_cast<char*>(buffer) + size}
+    , next_block_size_{block_size}
+    , caller_buffer_{true} {}
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  Arena(Arena&& arena)
+    : blocks_{std::move(arena.blocks_)}
+    , ptr_{std::exchange(arena.ptr_, nullptr)}
+    , end_{std::exchange(arena.end_, nullptr)}
+    , next_block_size_{arena.next_block_size_}
+    , allocated_{std::exchange(arena.allocated_, 0)} {
+    assert(!arena.caller_buffer_ && "an arena with a buffer can't be moved");
+  }
+
+  Arena& operator=(Arena&& arena) {
+    assert(!arena.caller_buffer_ && !caller_buffer_ &&
+        "an arena with a buffer can't be moved");
+    blocks_ = std::move(arena.blocks_);
+    ptr_ = std::exchange(arena.ptr_, nullptr);
+    end_ = std::exchange(arena.end_, nullptr);
+    next_block_size_ = arena.next_block_size_;
+    allocated_ = std::exchange(arena.allocated_, 0);
+    return *this;
+  }
+
+  void* Allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    size_t pad = Padding(ptr_, align);
+    if (ptr_ == nullptr || size + pad > static_cast<size_t>(end_ - ptr_)) {
+      NewBlock(size + align);
+      pad = Padding(ptr_, align);
+    }
+
+    char* p = ptr_ + pad;
+    ptr_ = p + size;
+    allocated_ += size;
+    return p;
+  }
+
+  template<class T, typename... Args>
+  T* New(Args&&... args) {
+    void* p = Allocate(sizeof(T), alignof(T));
+    return new (p) T(std::forward<Args>(args)...);
+  }
+
+  // bytes given to objects, without the padding
+  size_t Allocated() const {
+    return allocated_;
+  }
+
+  // blocks allocated from the heap
+  size_t NumBlocks() const {
+    return blocks_.size();
+  }
+
+ private:
+  static size_t Padding(const char* p, size_t align) {
+    return (align - reinterpret_cast<uintptr_t>(p) % align) % align;
+  }
+
+  // each block is twice the size of the last one, so the number of blocks
+  // grows with the log of the memory used
+  void NewBlock(size_t min_size) {
+    size_t size = std::max(next_block_size_, min_size);
+    next_block_size_ = size * 2;
+    blocks_.push_back(std::unique_ptr<char[]>(new char[size]));
+    ptr_ = blocks_.back().get();
+    end_ = ptr_ + size;
+  }
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* ptr_ = nullptr;
+  char* end_ = nullptr;
+  size_t next_block_size_;
+  size_t allocated_ = 0;
+  bool caller_buffer_ = false;
+};
+
+enum class MatchStatus {
+  NO_MATCH,
+  MATCH,
+  BUDGET_EXCEEDED,
+};
+
+// what is known of the match of a string that is given in parts, after the
+// parts given so far, see glob-stream.h
+enum class StreamStatus {
+  // the string can match or not, it depends on the next parts
+  CAN_MATCH,
+  // no string that starts with the parts matches
+  DEAD,
+  // all strings that start with the parts match
+  WILL_MATCH,
+};
+
+// MatchBudget limits the work of one match, when the limit is reached the
+// match stops and glob_match returns MatchStatus::BUDGET_EXCEEDED, the
+// default budget has no limits
+class MatchBudget {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  MatchBudget() = default;
+
+  // limits the number of steps of the automata, counting the steps of the
+  // automatas inside groups
+  MatchBudget& SetMaxSteps(size_t max_steps) {
+    max_steps_ = max_steps;
+    return *this;
+  }
+
+  // limits the time of each match, counted from the start of the match
+  MatchBudget& SetTimeout(Clock::duration timeout) {
+    timeout_ = timeout;
+    return *this;
+  }
+
+  // no match goes beyond this point in time, useful when many matches share
+  // the time of one request
+  MatchBudget& SetDeadline(Clock::time_point deadline) {
+    deadline_ = deadline;
+    return *this;
+  }
+
+  size_t MaxSteps() const {
+    return max_steps_;
+  }
+
+  // the deadline of a match that starts now
+  Clock::time_point Deadline() const {
+    if (timeout_ == Clock::duration::max()) {
+      return deadline_;
+    }
+
+    return std::min(deadline_, Clock::now() + timeout_);
+  }
+
+ private:
+  size_t max_steps_ = std::numeric_limits<size_t>::max();
+  Clock::duration timeout_ = Clock::duration::max();
+  Clock::time_point deadline_ = Clock::time_point::max();
+};
+
+// GlobOptions are the options of the compilation of a pattern, the default
+// options match the pattern against any string
+class GlobOptions {
+ public:
+  GlobOptions() = default;
+
+  // matches the strings as paths: '*', '?' and sets don't match '/', a
+  // segment of the pattern that is "**" matches any number of segments, and
+  // a '.' at the start of a segment is matched only by a '.' of the pattern
+  GlobOptions& SetPathMode(bool path_mode) {
+    path_mode_ = path_mode;
+    return *this;
+  }
+
+  bool PathMode() const {
+    return path_mode_;
+  }
+
+  // the options as bits, for the keys of caches and the files of compiled
+  // globs
+  uint32_t Flags() const {
+    return path_mode_ ? kPathMode : 0;
+  }
+
+  static GlobOptions FromFlags(uint32_t flags) {
+    if ((flags & ~kPathMode) != 0) {
+      throw Error("invalid glob options");
+    }
+
+    return GlobOptions().SetPathMode((flags & kPathMode) != 0);
+  }
+
+  bool operator==(const GlobOptions& options) const {
+    return Flags() == options.Flags();
+  }
+
+  bool operator!=(const GlobOptions& options) const {
+    return !(*this == options);
+  }
+
+ private:
+  static constexpr uint32_t kPathMode = 1;
+
+  bool path_mode_ = false;
+};
+
+// in path mode a segment starts at the start of the string and after each
+// '/'
+template<class charT>
+bool SegmentStart(const charT* str, size_t pos) {
+  return pos == 0 || str[pos - 1] == charT('/');
+}
+
+// true if '*', '?' or a set of a glob in path mode can match the char at pos
+template<class charT>
+bool PathWildcard(const charT* str, size_t pos) {
+  return str[pos] != charT('/') &&
+      !(str[pos] == charT('.') && SegmentStart(str, pos));
+}
+
 enum class StateType {
   MATCH,
   FAIL,
@@ -36,12 +278,62 @@ enum class StateType {
   UNION,
 };
 
+// what a star state consumes
+enum class StarKind {
+  // any char
+  ANY,
+  // the chars of one segment of a path
+  SEGMENT,
+  // whole segments of a path with their '/', the "**" of path mode
+  DIRS,
+};
+
+// the next states of a state, a state goes to itself or to the state after
+// it, so it has at most two next states, they are kept inline to not
+// allocate a vector for each state
+class NextStates {
+ public:
+  static constexpr size_t kMaxNextStates = 2;
+
+  void push_back(size_t state_pos) {
+    if (size_ == kMaxNextStates) {
+      throw Error("too many next states");
+    }
+
+    states_[size_++] = state_pos;
+  }
+
+  size_t operator[](size_t i) const {
+    return states_[i];
+  }
+
+  size_t back() const {
+    return states_[size_ - 1];
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  const size_t* begin() const {
+    return states_;
+  }
+
+  const size_t* end() const {
+    return states_ + size_;
+  }
+
+ private:
+  size_t states_[kMaxNextStates] = {0, 0};
+  size_t size_ = 0;
+};
+
 template <class charT>
 class State {
  public:
   State(StateType type, Automata<charT>& states)
     : type_{type}
-    , states_{states}{}
+    , states_{&states}{}
 
   virtual ~State() = default;
 
@@ -55,14 +347,19 @@ class State {
   }
 
   Automata<charT>& GetAutomata() {
-    return states_;
+    return *states_;
+  }
+
+  // the automata that owns the state, it changes when the automata moves
+  void SetAutomata(Automata<charT>& states) {
+    states_ = &states;
   }
 
   void AddNextState(size_t state_pos) {
     next_states_.push_back(state_pos);
   }
 
-  const std::vector<size_t>& GetNextStates() const {
+  const NextStates& GetNextStates() const {
     return next_states_;
   }
 
@@ -70,6 +367,16 @@ class State {
     return matched_str_;
   }
 
+  void ResetMatchedStr() {
+    matched_str_.clear();
+  }
+
+  // states that can match an empty string can be skipped by the automata
+  // when the string is all consumed
+  virtual bool MatchEmpty() const {
+    return false;
+  }
+
   virtual void ResetState() {}
 
  protected:
@@ -81,10 +388,24 @@ class State {
     matched_str_ = c;
   }
 
+  void SetMatchedStr(const String<charT>& str, size_t pos, size_t len) {
+    matched_str_.assign(str, pos, len);
+  }
+
+  // states that consume the string in many steps append to the matched
+  // string in place, so each step doesn't copy what was matched before
+  void AppendMatchedStr(const String<charT>& str, size_t pos, size_t len) {
+    matched_str_.append(str, pos, len);
+  }
+
+  void AppendMatchedStr(charT c) {
+    matched_str_ += c;
+  }
+
  private:
   StateType type_;
-  Automata<charT>& states_;
-  std::vector<size_t> next_states_;
+  Automata<charT>* states_;
+  NextStates next_states_;
   String<charT> matched_str_;
 };
 
@@ -127,17 +448,27 @@ class Automata {
 
   Automata<charT>& operator=(const Automata<charT>& automata) = delete;
 
+  ~Automata() {
+    DestroyStates();
+  }
+
   Automata(Automata<charT>&& automata)
-    : states_{std::move(automata.states_)}
+    : fail_state_{std::exchange(automata.fail_state_, 0)}
+    , arena_{std::move(automata.arena_)}
+    , states_{std::move(automata.states_)}
     , match_state_{automata.match_state_}
-    , fail_state_{std::exchange(automata.fail_state_, 0)}
-    , start_state_{std::exchange(automata.start_state_, 0)} {}
+    , start_state_{std::exchange(automata.start_state_, 0)} {
+    OwnStates();
+  }
 
   Automata<charT>& operator=(Automata<charT>&& automata) {
+    DestroyStates();
+    arena_ = std::move(automata.arena_);
     states_ = std::move(automata.states_);
     match_state_ = automata.match_state_;
     fail_state_ = automata.fail_state_;
     start_state_ = automata.start_state_;
+    OwnStates();
 
     return *this;
   }
@@ -164,69 +495,245 @@ class Automata {
     return *this;
   }
 
+  size_t MatchState() const {
+    return match_state_;
+  }
+
   size_t GetNumStates() const {
     return states_.size();
   }
 
+  // number of transitions executed by the last Exec, including the
+  // transitions of the automatas inside groups
+  size_t Steps() const {
+    return steps_;
+  }
+
+  // limits the next executions, the automatas of groups receive what is left
+  // of the limits of the automata that runs them
+  void SetLimits(size_t max_steps, MatchBudget::Clock::time_point deadline) {
+    max_steps_ = max_steps;
+    deadline_ = deadline;
+  }
+
+  // true if the last Exec stopped because it reached the limits
+  bool LimitExceeded() const {
+    return exceeded_;
+  }
+
+  // the automata runs from the position start of the string, automatas of
+  // groups use it to run on the rest of the string without copying it
   std::tuple<bool, size_t> Exec(const String<charT>& str,
-      bool comp_end = true) {
-    auto r = ExecAux(str, comp_end);
+      bool comp_end = true, size_t start = 0) {
+    steps_ = 0;
+    clock_steps_ = 0;
+    exceeded_ = false;
+    ResetMatchedStrs(0);
+    auto r = ExecAux(str, comp_end, start);
     ResetStates();
+
+    // a group that stopped in the middle can't be trusted, even when the
+    // rest of the automata reached the match state
+    if (exceeded_) {
+      std::get<0>(r) = false;
+    }
+
+    return r;
+  }
+
+  // runs the automata of a group inside this automata, the steps of the
+  // group are counted as steps of this automata
+  std::tuple<bool, size_t> ExecGroup(Automata<charT>& automata,
+      const String<charT>& str, size_t pos) {
+    automata.SetLimits(max_steps_ - std::min(steps_, max_steps_), deadline_);
+    auto r = automata.Exec(str, false, pos);
+    steps_ += automata.Steps();
+    exceeded_ = exceeded_ || automata.LimitExceeded();
     return r;
   }
 
   std::vector<String<charT>> GetMatchedStrings() const {
     std::vector<String<charT>> vec;
+    AppendMatchedStrings(vec);
+    return vec;
+  }
+
+  // appends the matched strings to vec, the strings are built with the
+  // allocator of vec, so they can live in the memory of the caller
+  template<class Vector>
+  void AppendMatchedStrings(Vector& vec) const {
+    using StringType = typename Vector::value_type;
+    typename StringType::allocator_type alloc(vec.get_allocator());
 
     for (auto& state : states_) {
+      // a run of '?' is one state, but each '?' is still one match
+      if (state->Type() == StateType::QUESTION &&
+          static_cast<const StateAny<charT>&>(*state).Width() > 1) {
+        size_t width = static_cast<const StateAny<charT>&>(*state).Width();
+        const String<charT>& matched_str = state->MatchedStr();
+        for (size_t i = 0; i < width; i++) {
+          vec.push_back(i < matched_str.length() ?
+              StringType(1, matched_str[i], alloc) : StringType(alloc));
+        }
+        continue;
+      }
+
       if (state->Type() == StateType::MULT ||
           state->Type() == StateType::QUESTION ||
           state->Type() == StateType::GROUP ||
           state->Type() == StateType::SET) {
-        vec.push_back(state->MatchedStr());
+        const String<charT>& matched_str = state->MatchedStr();
+        vec.push_back(StringType(matched_str.begin(), matched_str.end(),
+            alloc));
       }
     }
-
-    return vec;
   }
 
+  // the states are placed in the arena of the automata, they live as long
+  // as the automata
   template<class T, typename... Args>
   size_t NewState(Args&&... args) {
     size_t state_pos = states_.size();
-    auto state = std::unique_ptr<State<charT>>(new T(*this,
-        std::forward<Args>(args)...));
+    // the vector grows before the state is built, so a state is never left
+    // out of the vector without its destructor
+    if (states_.size() == states_.capacity()) {
+      states_.reserve(std::max<size_t>(8, states_.size() * 2));
+    }
 
-    states_.push_back(std::move(state));
+    states_.push_back(arena_.New<T>(*this, std::forward<Args>(args)...));
     return state_pos;
   }
 
   size_t fail_state_;
  private:
   std::tuple<bool, size_t> ExecAux(const String<charT>& str,
-      bool comp_end = true) const {
+      bool comp_end, size_t start) {
     size_t state_pos = 0;
-    size_t str_pos = 0;
+    size_t str_pos = start;
+
+    // the last star that passed the string to the next state, and the
+    // position where it happened, if the path after the star fails, the star
+    // consumes one more char and the automata tries again from there
+    bool has_star = false;
+    size_t star_state = 0;
+    size_t star_pos = 0;
+
+    // in path mode the last star can stop at a '/' that it can't consume,
+    // then the last "**" that passed the string is retried
+    bool has_dirs = false;
+    size_t dirs_state = 0;
+    size_t dirs_pos = 0;
+
+    while (true) {
+      // run the state vector until state reaches fail or match state, or
+      // until the string is all consumed
+      while (state_pos != fail_state_ && state_pos != match_state_
+             && str_pos < str.length()) {
+        if (OutOfLimits()) {
+          return std::tuple<bool, size_t>(false, str_pos);
+        }
 
-    // run the state vector until state reaches fail or match state, or
-    // until the string is all consumed
-    while (state_pos != fail_state_ && state_pos != match_state_
-           && str_pos < str.length()) {
-      std::tie(state_pos, str_pos) = states_[state_pos]->Next(str, str_pos);
-    }
+        size_t prev_state = state_pos;
+        size_t prev_pos = str_pos;
+        std::tie(state_pos, str_pos) = states_[state_pos]->Next(str, str_pos);
+        steps_++;
+
+        // once a star consumes a char, it can absorb anything that a star
+        // before it would, so only the last star needs to be retried
+        if (states_[prev_state]->Type() == StateType::MULT) {
+          has_star = state_pos != prev_state;
+          star_state = prev_state;
+          star_pos = prev_pos;
+
+          if (has_star && static_cast<StateStar<charT>&>(
+              *states_[prev_state]).Kind() == StarKind::DIRS) {
+            has_dirs = true;
+            dirs_state = prev_state;
+            dirs_pos = prev_pos;
+          }
+        }
+      }
 
-    // if comp_end is true it matches only if the automata reached the end of
-    // the string
-    if (comp_end) {
-      if ((state_pos == match_state_) && (str_pos == str.length())) {
-        return std::tuple<bool, size_t>(state_pos == match_state_, str_pos);
+      // states like star can match the empty string, so when the string is
+      // all consumed, they are skipped until a state that needs a char
+      while (str_pos == str.length() && state_pos != fail_state_
+             && state_pos != match_state_
+             && states_[state_pos]->MatchEmpty()) {
+        state_pos = states_[state_pos]->GetNextStates().back();
       }
 
-      return std::tuple<bool, size_t>(false, str_pos);
-    } else {
-      // if comp_end is false, compare only if the states reached the
-      // match state
-      return std::tuple<bool, size_t>(state_pos == match_state_, str_pos);
+      // if comp_end is true it matches only if the automata reached the end
+      // of the string, if comp_end is false, compare only if the states
+      // reached the match state
+      if (state_pos == match_state_ &&
+          (!comp_end || str_pos == str.length())) {
+        return std::tuple<bool, size_t>(true, str_pos);
+      }
+
+      if (OutOfLimits()) {
+        return std::tuple<bool, size_t>(false, str_pos);
+      }
+
+      if (has_star && !CanRetry(str, star_state, star_pos)) {
+        has_star = false;
+      }
+
+      if (!has_star) {
+        if (!has_dirs || !CanRetry(str, dirs_state, dirs_pos)) {
+          return std::tuple<bool, size_t>(false, str_pos);
+        }
+
+        star_state = dirs_state;
+        star_pos = dirs_pos;
+      }
+
+      // backtrack: the states after the star are cleaned, and the star
+      // consumes the char that it had passed to the next state
+      has_star = false;
+      if (star_state == dirs_state) {
+        has_dirs = false;
+      }
+
+      ResetMatchedStrs(star_state + 1);
+      for (size_t i = star_state + 1; i < states_.size(); i++) {
+        states_[i]->ResetState();
+      }
+
+      std::tie(state_pos, str_pos) = static_cast<StateStar<charT>&>(
+          *states_[star_state]).Consume(str, star_pos);
+      steps_++;
+    }
+  }
+
+  // true if the star can consume the char that it passed to the next state
+  bool CanRetry(const String<charT>& str, size_t state_pos, size_t pos) {
+    return pos < str.length() && static_cast<StateStar<charT>&>(
+        *states_[state_pos]).CanConsume(str, pos);
+  }
+
+  // the states keep a reference to the automata, so after a move they must
+  // point to the new one
+  void OwnStates() {
+    for (auto& state : states_) {
+      state->SetAutomata(*this);
+    }
+  }
+
+  bool OutOfLimits() {
+    if (exceeded_ || steps_ >= max_steps_) {
+      exceeded_ = true;
+      return true;
+    }
+
+    // reading the clock costs more than a step, so it is read only after a
+    // number of steps
+    if (deadline_ != MatchBudget::Clock::time_point::max() &&
+        steps_ - clock_steps_ >= kClockSteps) {
+      clock_steps_ = steps_;
+      exceeded_ = MatchBudget::Clock::now() >= deadline_;
     }
+
+    return exceeded_;
   }
 
   void ResetStates() {
@@ -235,10 +742,36 @@ class Automata {
     }
   }
 
-  std::vector<std::unique_ptr<State<charT>>> states_;
+  // the arena frees the memory of the states, but their members, like the
+  // matched strings, are freed by their destructors
+  void DestroyStates() {
+    for (auto& state : states_) {
+      state->~State();
+    }
+
+    states_.clear();
+  }
+
+  void ResetMatchedStrs(size_t first) {
+    for (size_t i = first; i < states_.size(); i++) {
+      states_[i]->ResetMatchedStr();
+    }
+  }
+
+  static constexpr size_t kStatesBlockSize = 512;
+  Arena arena_{kStatesBlockSize};
+  std::vector<State<charT>*> states_;
   size_t match_state_;
 
   size_t start_state_;
+  size_t steps_ = 0;
+
+  static constexpr size_t kClockSteps = 256;
+  size_t max_steps_ = std::numeric_limits<size_t>::max();
+  MatchBudget::Clock::time_point deadline_ =
+      MatchBudget::Clock::time_point::max();
+  size_t clock_steps_ = 0;
+  bool exceeded_ = false;
 };
 
 template<class charT>
@@ -264,6 +797,11 @@ class StateChar : public State<charT> {
 
     return std::tuple<size_t, size_t>(GetAutomata().FailState(), pos + 1);
   }
+
+  charT Char() const {
+    return c_;
+  }
+
  private:
   charT c_;
 };
@@ -274,20 +812,55 @@ class StateAny : public State<charT> {
   using State<charT>::GetAutomata;
 
  public:
-  StateAny(Automata<charT>& states)
-    : State<charT>(StateType::QUESTION, states){}
+  // a run of '?' is one state that skips width chars
+  StateAny(Automata<charT>& states, size_t width = 1, bool path_mode = false)
+    : State<charT>(StateType::QUESTION, states)
+    , width_{width}
+    , path_mode_{path_mode} {}
 
-  bool Check(const String<charT>&, size_t) override {
-    // as it match any char, it is always trye
-    return true;
+  bool Check(const String<charT>& str, size_t pos) override {
+    return Fits(str, pos);
   }
 
   std::tuple<size_t, size_t> Next(const String<charT>& str,
       size_t pos) override {
-    this->SetMatchedStr(str[pos]);
-    // state any always match with any char
-    return std::tuple<size_t, size_t>(GetNextStates()[0], pos + 1);
+    if (!Fits(str, pos)) {
+      return std::tuple<size_t, size_t>(GetAutomata().FailState(), pos + 1);
+    }
+
+    this->SetMatchedStr(str, pos, width_);
+    return std::tuple<size_t, size_t>(GetNextStates()[0], pos + width_);
+  }
+
+  size_t Width() const {
+    return width_;
+  }
+
+  bool PathMode() const {
+    return path_mode_;
+  }
+
+ private:
+  // as it match any char, it is true while there are chars enough, in path
+  // mode the chars must be in the segment
+  bool Fits(const String<charT>& str, size_t pos) const {
+    if (pos + width_ > str.length()) {
+      return false;
+    }
+
+    if (path_mode_) {
+      for (size_t i = pos; i < pos + width_; i++) {
+        if (!PathWildcard(str.data(), i)) {
+          return false;
+        }
+      }
+    }
+
+    return true;
   }
+
+  size_t width_;
+  bool path_mode_;
 };
 
 template<class charT>
@@ -296,8 +869,9 @@ class StateStar : public State<charT> {
   using State<charT>::GetAutomata;
 
  public:
-  StateStar(Automata<charT>& states)
-    : State<charT>(StateType::MULT, states){}
+  StateStar(Automata<charT>& states, StarKind kind = StarKind::ANY)
+    : State<charT>(StateType::MULT, states)
+    , kind_{kind} {}
 
   bool Check(const String<charT>&, size_t) override {
     // as it match any char, it is always trye
@@ -309,58 +883,107 @@ class StateStar : public State<charT> {
     // next state vector from StateStar has two elements, the element 0 points
     // to the same state, and the element points to next state if the
     // conditions is satisfied
-    if (GetAutomata().GetState(GetNextStates()[1]).Type() == StateType::MATCH) {
+    State<charT>& next_state = GetAutomata().GetState(GetNextStates()[1]);
+    if (next_state.Type() == StateType::MATCH) {
+      if (kind_ != StarKind::ANY) {
+        return ConsumeSegments(str, pos);
+      }
+
       // this case occurs when star is in the end of the glob, so the pos is
       // the end of the string, because all string is consumed
       this->SetMatchedStr(str.substr(pos));
       return std::tuple<size_t, size_t>(GetNextStates()[1], str.length());
     }
 
-    bool res = GetAutomata().GetState(GetNextStates()[1]).Check(str, pos);
+    // "**" passes the string only at the start of a segment, and a star
+    // can't pass a '.' at the start of a segment, only a '.' at the start
+    // of a segment of the glob matches it
+    bool res = next_state.Check(str, pos);
+    if (kind_ == StarKind::DIRS) {
+      res = res && SegmentStart(str.data(), pos);
+    } else if (kind_ == StarKind::SEGMENT) {
+      res = res && !(str[pos] == charT('.') && SegmentStart(str.data(), pos));
+    }
     // if the next state is satisfied goes to next state
     if (res) {
       return std::tuple<size_t, size_t>(GetNextStates()[1], pos);
     }
 
+    if (!CanConsume(str, pos)) {
+      return std::tuple<size_t, size_t>(GetAutomata().FailState(), pos + 1);
+    }
+
     // while the next state check is false, the string is consumed by star state
-    this->SetMatchedStr(this->MatchedStr() + str[pos]);
-    return std::tuple<size_t, size_t>(GetNextStates()[0], pos + 1);
+    return Consume(str, pos);
   }
-};
 
-template<class charT>
-class SetItem {
- public:
-  SetItem() = default;
+  bool MatchEmpty() const override {
+    return kind_ != StarKind::DIRS || segment_start_;
+  }
 
-  virtual bool Check(charT c) const = 0;
-};
+  void ResetState() override {
+    segment_start_ = true;
+  }
 
-template<class charT>
-class SetItemChar: public SetItem<charT> {
- public:
-  SetItemChar(charT c): c_{c} {}
+  // in path mode a star doesn't consume '/', nor a '.' at the start of a
+  // segment, "**" consumes '/' too
+  bool CanConsume(const String<charT>& str, size_t pos) const {
+    switch (kind_) {
+      case StarKind::SEGMENT:
+        return PathWildcard(str.data(), pos);
+
+      case StarKind::DIRS:
+        return !(str[pos] == charT('.') && SegmentStart(str.data(), pos));
+
+      default:
+        return true;
+    }
+  }
 
-  bool Check(charT c) const override {
-    return c == c_;
+  // consumes the char at pos without checking the next state, the automata
+  // uses it to backtrack when the path after the star fails
+  std::tuple<size_t, size_t> Consume(const String<charT>& str, size_t pos) {
+    this->AppendMatchedStr(str[pos]);
+    segment_start_ = str[pos] == charT('/');
+    return std::tuple<size_t, size_t>(GetNextStates()[0], pos + 1);
+  }
+
+  StarKind Kind() const {
+    return kind_;
   }
+
  private:
-  charT c_;
-};
+  // a star of path mode at the end of the glob consumes what it can, the
+  // rest of the segment, or "**" the segments before the first one that it
+  // can't consume
+  std::tuple<size_t, size_t> ConsumeSegments(const String<charT>& str,
+      size_t pos) {
+    size_t end = pos;
+    if (kind_ == StarKind::SEGMENT) {
+      while (end < str.length() && CanConsume(str, end)) {
+        end++;
+      }
+    } else {
+      for (size_t i = pos; i < str.length() && CanConsume(str, i); i++) {
+        if (str[i] == charT('/')) {
+          end = i + 1;
+        }
+      }
 
-template<class charT>
-class SetItemRange: public SetItem<charT> {
- public:
-  SetItemRange(charT start, charT end)
-    : start_{start < end? start : end}
-    , end_{start < end? end : start} {}
+      if (!SegmentStart(str.data(), end)) {
+        return std::tuple<size_t, size_t>(GetAutomata().FailState(), pos + 1);
+      }
+      segment_start_ = true;
+    }
 
-  bool Check(charT c) const override {
-    return (c >= start_) && (c <= end_);
+    this->AppendMatchedStr(str, pos, end - pos);
+    return std::tuple<size_t, size_t>(GetNextStates()[1], end);
   }
- private:
-  charT start_;
-  charT end_;
+
+  StarKind kind_;
+  // "**" matches the empty string only when it stops at the start of a
+  // segment
+  bool segment_start_ = true;
 };
 
 template<class charT>
@@ -369,17 +992,21 @@ class StateSet : public State<charT> {
   using State<charT>::GetAutomata;
 
  public:
+  // the items of the set are ranges, a char is a range of one char, and
+  // the start of each range is not greater than its end
   StateSet(Automata<charT>& states,
-      std::vector<std::unique_ptr<SetItem<charT>>> items,
-      bool neg = false)
+      std::vector<std::pair<charT, charT>>&& ranges,
+      bool neg = false, bool path_mode = false)
     : State<charT>(StateType::SET, states)
-    , items_{std::move(items)}
-    , neg_{neg} {}
+    , ranges_{std::move(ranges)}
+    , neg_{neg}
+    , path_mode_{path_mode} {}
 
   bool SetCheck(const String<charT>& str, size_t pos) const {
-    for (auto& item : items_) {
+    charT c = str[pos];
+    for (auto& range : ranges_) {
       // if any item match, then the set match with char
-      if (item.get()->Check(str[pos])) {
+      if (c >= range.first && c <= range.second) {
         return true;
       }
     }
@@ -388,6 +1015,10 @@ class StateSet : public State<charT> {
   }
 
   bool Check(const String<charT>& str, size_t pos) override {
+    if (path_mode_ && !PathWildcard(str.data(), pos)) {
+      return false;
+    }
+
     if (neg_) {
       return !SetCheck(str, pos);
     }
@@ -404,14 +1035,28 @@ class StateSet : public State<charT> {
 
     return std::tuple<size_t, size_t>(GetAutomata().FailState(), pos + 1);
   }
- private:
-  std::vector<std::unique_ptr<SetItem<charT>>> items_;
-  bool neg_;
-};
 
-template<class charT>
-class StateGroup: public State<charT> {
-  using State<charT>::GetNextStates;
+  const std::vector<std::pair<charT, charT>>& Ranges() const {
+    return ranges_;
+  }
+
+  bool Neg() const {
+    return neg_;
+  }
+
+  bool PathMode() const {
+    return path_mode_;
+  }
+
+ private:
+  std::vector<std::pair<charT, charT>> ranges_;
+  bool neg_;
+  bool path_mode_;
+};
+
+template<class charT>
+class StateGroup: public State<charT> {
+  using State<charT>::GetNextStates;
   using State<charT>::GetAutomata;
 
  public:
@@ -429,28 +1074,62 @@ class StateGroup: public State<charT> {
     : State<charT>(StateType::GROUP, states)
     , type_{type}
     , automatas_{std::move(automatas)}
-    , match_one_{false} {}
+    , match_one_{false}
+    , empty_alternative_{false} {
+    // an alternative like "?(x)" matches the empty string, so the group can
+    // be skipped at the end of the string
+    for (auto& automata : automatas_) {
+      bool r;
+      std::tie(r, std::ignore) = automata->Exec(String<charT>());
+      empty_alternative_ = empty_alternative_ || r;
+    }
+  }
 
   void ResetState() override {
     match_one_ = false;
   }
 
+  Type GroupType() const {
+    return type_;
+  }
+
+  const std::vector<std::unique_ptr<Automata<charT>>>& Automatas() const {
+    return automatas_;
+  }
+
+  bool MatchEmpty() const override {
+    switch (type_) {
+      case Type::ANY:
+      case Type::STAR:
+        return true;
+
+      case Type::PLUS:
+        return match_one_ || empty_alternative_;
+
+      case Type::BASIC:
+      case Type::AT:
+        return empty_alternative_;
+
+      default:
+        return false;
+    }
+  }
+
   std::tuple<bool, size_t> BasicCheck(const String<charT>& str,
       size_t pos) {
-    String<charT> str_part = str.substr(pos);
     bool r;
-    size_t str_pos;
+    size_t str_pos = pos;
 
     // each automata is a part of a union of the group, in basic check,
     // we want find only if any automata is true
     for (auto& automata : automatas_) {
-      std::tie(r, str_pos) = automata->Exec(str_part, false);
+      std::tie(r, str_pos) = GetAutomata().ExecGroup(*automata, str, pos);
       if (r) {
-        return std::tuple<bool, size_t>(r, pos + str_pos);
+        return std::tuple<bool, size_t>(r, str_pos);
       }
     }
 
-    return std::tuple<bool, size_t>(false, pos + str_pos);
+    return std::tuple<bool, size_t>(false, str_pos);
   }
 
   bool Check(const String<charT>& str, size_t pos) override {
@@ -518,7 +1197,7 @@ class StateGroup: public State<charT> {
     size_t new_pos;
     std::tie(r, new_pos) = BasicCheck(str, pos);
     if (r) {
-      this->SetMatchedStr(this->MatchedStr() + str.substr(pos, new_pos - pos));
+      this->AppendMatchedStr(str, pos, new_pos - pos);
       return std::tuple<size_t, size_t>(GetAutomata().FailState(), new_pos);
     }
 
@@ -530,7 +1209,7 @@ class StateGroup: public State<charT> {
     size_t new_pos;
     std::tie(r, new_pos) = BasicCheck(str, pos);
     if (r) {
-      this->SetMatchedStr(this->MatchedStr() + str.substr(pos, new_pos - pos));
+      this->AppendMatchedStr(str, pos, new_pos - pos);
       return std::tuple<size_t, size_t>(GetNextStates()[1], new_pos);
     }
 
@@ -542,7 +1221,7 @@ class StateGroup: public State<charT> {
     size_t new_pos;
     std::tie(r, new_pos) = BasicCheck(str, pos);
     if (r) {
-      this->SetMatchedStr(this->MatchedStr() + str.substr(pos, new_pos - pos));
+      this->AppendMatchedStr(str, pos, new_pos - pos);
       return std::tuple<size_t, size_t>(GetNextStates()[1], new_pos);
     }
 
@@ -553,8 +1232,11 @@ class StateGroup: public State<charT> {
     bool r;
     size_t new_pos;
     std::tie(r, new_pos) = BasicCheck(str, pos);
-    if (r) {
-      this->SetMatchedStr(this->MatchedStr() + str.substr(pos, new_pos - pos));
+
+    // an iteration that doesn't consume any char would repeat forever, so
+    // it ends the group
+    if (r && new_pos > pos) {
+      this->AppendMatchedStr(str, pos, new_pos - pos);
       if (GetAutomata().GetState(GetNextStates()[1]).Type() == StateType::MATCH
           && new_pos == str.length()) {
         return std::tuple<size_t, size_t>(GetNextStates()[1], new_pos);
@@ -570,9 +1252,17 @@ class StateGroup: public State<charT> {
     bool r;
     size_t new_pos;
     std::tie(r, new_pos) = BasicCheck(str, pos);
+
+    // an empty iteration counts as the one that the group needs, but it
+    // must not repeat forever
+    if (r && new_pos == pos) {
+      match_one_ = true;
+      return std::tuple<size_t, size_t>(GetNextStates()[1], pos);
+    }
+
     if (r) {
       match_one_ = true;
-      this->SetMatchedStr(this->MatchedStr() + str.substr(pos, new_pos - pos));
+      this->AppendMatchedStr(str, pos, new_pos - pos);
 
       // if it matches and the string reached at the end, and the next
       // state is the match state, goes to next state to avoid state mistake
@@ -602,6 +1292,9 @@ class StateGroup: public State<charT> {
   Type type_;
   std::vector<std::unique_ptr<Automata<charT>>> automatas_;
   bool match_one_;
+
+  // true if an alternative matches the empty string
+  bool empty_alternative_;
 };
 
 enum class TokenKind {
@@ -668,10 +1361,17 @@ class Lexer {
  public:
   static const char kEndOfInput = -1;
 
-  Lexer(const String<charT>& str): str_(str), pos_{0}, c_{str[0]} {}
+  // an empty pattern starts at the end of input, so the lexer never reads
+  // after the end of the string
+  Lexer(const String<charT>& str)
+    : str_(str)
+    , pos_{0}
+    , c_{str.empty() ? static_cast<charT>(kEndOfInput) : str[0]} {}
 
   std::vector<Token<charT>> Scanner() {
+    // each char gives at most one token, plus the end of input
     std::vector<Token<charT>> tokens;
+    tokens.reserve(str_.length() + 1);
     while(true) {
       switch (c_) {
         case '?': {
@@ -888,8 +1588,27 @@ class AstNode {
   Type type_;
 };
 
+// the nodes of the AST can be placed in an arena, then the deleter only
+// destroys the node, and its memory is freed with the arena
 template<class charT>
-using AstNodePtr = std::unique_ptr<AstNode<charT>>;
+class AstNodeDeleter {
+ public:
+  AstNodeDeleter(bool in_arena = false): in_arena_{in_arena} {}
+
+  void operator()(AstNode<charT>* node) const {
+    if (in_arena_) {
+      node->~AstNode();
+    } else {
+      delete node;
+    }
+  }
+
+ private:
+  bool in_arena_;
+};
+
+template<class charT>
+using AstNodePtr = std::unique_ptr<AstNode<charT>, AstNodeDeleter<charT>>;
 
 template<class charT>
 class AstVisitor {
@@ -911,7 +1630,7 @@ class CharNode: public AstNode<charT> {
     visitor->VisitCharNode(this);
   }
 
-  char GetValue() const {
+  charT GetValue() const {
     return c_;
   }
 
@@ -1004,23 +1723,46 @@ class NegativeSetNode: public AstNode<charT> {
 template<class charT>
 class StarNode: public AstNode<charT> {
  public:
-  StarNode()
-    : AstNode<charT>(AstNode<charT>::Type::STAR) {}
+  // dirs is the "**" of path mode, it matches whole segments with the '/'
+  // after each one
+  StarNode(bool dirs = false)
+    : AstNode<charT>(AstNode<charT>::Type::STAR)
+    , dirs_{dirs} {}
 
   virtual void Accept(AstVisitor<charT>* visitor) {
     visitor->VisitStarNode(this);
   }
+
+  bool Dirs() const {
+    return dirs_;
+  }
+
+ private:
+  bool dirs_;
 };
 
 template<class charT>
 class AnyNode: public AstNode<charT> {
  public:
-  AnyNode()
-    : AstNode<charT>(AstNode<charT>::Type::ANY) {}
+  AnyNode(size_t width = 1)
+    : AstNode<charT>(AstNode<charT>::Type::ANY)
+    , width_{width} {}
 
   virtual void Accept(AstVisitor<charT>* visitor) {
     visitor->VisitAnyNode(this);
   }
+
+  // number of '?' that this node represents
+  size_t GetWidth() const {
+    return width_;
+  }
+
+  void SetWidth(size_t width) {
+    width_ = width;
+  }
+
+ private:
+  size_t width_;
 };
 
 template<class charT>
@@ -1119,9 +1861,14 @@ class Parser {
  public:
   Parser() = delete;
 
-  Parser(std::vector<Token<charT>>&& tok_vec)
+  // with an arena the nodes are placed in it, so the AST is freed at once,
+  // the arena must live longer than the AST
+  Parser(std::vector<Token<charT>>&& tok_vec, Arena* arena = nullptr,
+      bool path_mode = false)
     : tok_vec_{std::move(tok_vec)}
-    , pos_{0} {}
+    , pos_{0}
+    , arena_{arena}
+    , path_mode_{path_mode} {}
 
   AstNodePtr<charT> GenAst() {
     return ParserGlob();
@@ -1135,7 +1882,7 @@ class Parser {
     }
 
     charT c = tk.Value();
-    return AstNodePtr<charT>(new CharNode<charT>(c));
+    return NewNode<CharNode<charT>>(c);
   }
 
   AstNodePtr<charT> ParserRange() {
@@ -1147,8 +1894,8 @@ class Parser {
     }
 
     AstNodePtr<charT> char_end = ParserChar();
-    return AstNodePtr<charT>(
-        new RangeNode<charT>(std::move(char_start), std::move(char_end)));
+    return NewNode<RangeNode<charT>>(std::move(char_start),
+        std::move(char_end));
   }
 
   AstNodePtr<charT> ParserSetItem() {
@@ -1168,16 +1915,16 @@ class Parser {
 
     Advance();
 
-    return AstNodePtr<charT>(new SetItemsNode<charT>(std::move(items)));
+    return NewNode<SetItemsNode<charT>>(std::move(items));
   }
 
   AstNodePtr<charT> ParserSet() {
     Token<charT>& tk = NextToken();
 
     if (tk == TokenKind::LBRACKET) {
-      return AstNodePtr<charT>(new PositiveSetNode<charT>(ParserSetItems()));
+      return NewNode<PositiveSetNode<charT>>(ParserSetItems());
     } else if (tk == TokenKind::NEGLBRACKET) {
-      return AstNodePtr<charT>(new NegativeSetNode<charT>(ParserSetItems()));
+      return NewNode<NegativeSetNode<charT>>(ParserSetItems());
     } else {
       throw Error("set expected");
     }
@@ -1189,17 +1936,17 @@ class Parser {
     switch (tk.Kind()) {
       case TokenKind::QUESTION:
         Advance();
-        return AstNodePtr<charT>(new AnyNode<charT>());
+        return NewNode<AnyNode<charT>>();
         break;
 
       case TokenKind::STAR:
         Advance();
-        return AstNodePtr<charT>(new StarNode<charT>());
+        return NewNode<StarNode<charT>>();
         break;
 
       case TokenKind::SUB:
         Advance();
-        return AstNodePtr<charT>(new CharNode<charT>('-'));
+        return NewNode<CharNode<charT>>('-');
         break;
 
       case TokenKind::CHAR:
@@ -1239,137 +1986,1085 @@ class Parser {
         type = GroupNode<charT>::GroupType::ANY;
         break;
 
-      case TokenKind::STARLPAREN:
-        type = GroupNode<charT>::GroupType::STAR;
-        break;
+      case TokenKind::STARLPAREN:
+        type = GroupNode<charT>::GroupType::STAR;
+        break;
+
+      case TokenKind::PLUSLPAREN:
+        type = GroupNode<charT>::GroupType::PLUS;
+        break;
+
+      case TokenKind::NEGLPAREN:
+        type = GroupNode<charT>::GroupType::NEG;
+        break;
+
+      case TokenKind::ATLPAREN:
+        type = GroupNode<charT>::GroupType::AT;
+        break;
+
+      default:
+        throw Error("Not valid group");
+        break;
+    }
+
+    AstNodePtr<charT> group_glob = ParserUnion();
+    tk = NextToken();
+    if (tk != TokenKind::RPAREN) {
+      throw Error("Expected ')' at and of group");
+    }
+
+    return NewNode<GroupNode<charT>>(type, std::move(group_glob));
+  }
+
+  AstNodePtr<charT> ParserConcat() {
+    auto check_end = [&]() -> bool {
+      Token<charT>& tk = GetToken();
+
+      switch (tk.Kind()) {
+        case TokenKind::EOS:
+        case TokenKind::RPAREN:
+        case TokenKind::UNION:
+          return true;
+          break;
+
+        default:
+          return false;
+          break;
+      }
+    };
+
+    std::vector<AstNodePtr<charT>> parts;
+
+    while (!check_end()) {
+      parts.push_back(ParserBasicGlob());
+    }
+
+    return NewNode<ConcatNode<charT>>(std::move(parts));
+  }
+
+  AstNodePtr<charT> ParserUnion() {
+    std::vector<AstNodePtr<charT>> items;
+    items.push_back(ParserConcat());
+
+    while (GetToken() == TokenKind::UNION) {
+      Advance();
+      items.push_back(ParserConcat());
+    }
+
+    return NewNode<UnionNode<charT>>(std::move(items));
+  }
+
+  AstNodePtr<charT> ParserGlob() {
+    AstNodePtr<charT> glob = ParserConcat();
+
+    if (GetToken() != TokenKind::EOS) {
+      throw Error("Expected the end of glob");
+    }
+
+    if (path_mode_) {
+      MarkDirs(glob.get());
+    }
+
+    return NewNode<GlobNode<charT>>(std::move(glob));
+  }
+
+  // in path mode a segment of the glob that is only stars, like in
+  // "src/**/*.cc", matches any number of segments, the star takes the '/'
+  // after it, so the glob matches "src/a.cc", and a "**" at the end of the
+  // glob is followed by a star for the last segment, stars inside groups
+  // are always stars of one segment
+  void MarkDirs(AstNode<charT>* node) {
+    auto is_star = [](const AstNodePtr<charT>& part) {
+      return part->GetType() == AstNode<charT>::Type::STAR;
+    };
+
+    auto is_slash = [](const AstNodePtr<charT>& part) {
+      return part->GetType() == AstNode<charT>::Type::CHAR &&
+          static_cast<CharNode<charT>*>(part.get())->GetValue() == '/';
+    };
+
+    std::vector<AstNodePtr<charT>>& parts =
+        static_cast<ConcatNode<charT>*>(node)->GetBasicGlobs();
+    std::vector<AstNodePtr<charT>> marked;
+    size_t i = 0;
+    while (i < parts.size()) {
+      bool segment_start = marked.empty() || is_slash(marked.back()) ||
+          (is_star(marked.back()) &&
+          static_cast<StarNode<charT>*>(marked.back().get())->Dirs());
+      size_t end = i;
+      while (segment_start && end < parts.size() && is_star(parts[end])) {
+        end++;
+      }
+
+      if (end - i < 2 || (end < parts.size() && !is_slash(parts[end]))) {
+        marked.push_back(std::move(parts[i++]));
+        continue;
+      }
+
+      marked.push_back(NewNode<StarNode<charT>>(/*dirs*/true));
+      if (end == parts.size()) {
+        marked.push_back(NewNode<StarNode<charT>>());
+      }
+      i = std::min(end + 1, parts.size());
+    }
+
+    parts = std::move(marked);
+  }
+
+  inline const Token<charT>& GetToken() const {
+    return tok_vec_.at(pos_);
+  }
+
+  inline Token<charT>& GetToken() {
+    return tok_vec_.at(pos_);
+  }
+
+  inline const Token<charT>& PeekAhead() const {
+    if (pos_ >= (tok_vec_.size() - 1))
+      return tok_vec_.back();
+
+    return tok_vec_.at(pos_ + 1);
+  }
+
+  inline Token<charT>& NextToken() {
+    if (pos_ >= (tok_vec_.size() - 1))
+      return tok_vec_.back();
+
+    Token<charT>& tk = tok_vec_.at(pos_);
+    pos_++;
+    return tk;
+  }
+
+  inline bool Advance() {
+    if (pos_ == tok_vec_.size() - 1)
+      return false;
+
+    ++pos_;
+    return true;
+  }
+
+  inline size_t Size() const noexcept {
+    return tok_vec_.size();
+  }
+
+  template<class T, typename... Args>
+  AstNodePtr<charT> NewNode(Args&&... args) {
+    if (arena_) {
+      return AstNodePtr<charT>(arena_->New<T>(std::forward<Args>(args)...),
+          AstNodeDeleter<charT>(/*in_arena*/true));
+    }
+
+    return AstNodePtr<charT>(new T(std::forward<Args>(args)...));
+  }
+
+  std::vector<Token<charT>> tok_vec_;
+  size_t pos_;
+  Arena* arena_;
+  bool path_mode_;
+};
+
+// AstOptimizer rewrites the AST from the Parser before AstConsumer generates
+// the automata, the rewritten AST matches the same strings with fewer and
+// simpler states, but the captures of the rewritten parts change: collapsed
+// stars and lowered sets are one capture less, and flattened groups are
+// captured by their parts, so the matches with captures run an automata of
+// the AST that is not rewritten, see ExtendedGlob
+template<class charT>
+class AstOptimizer {
+ public:
+  AstOptimizer() = default;
+
+  void Optimize(AstNode<charT>* root_node) {
+    AstNode<charT>* concat_node = static_cast<GlobNode<charT>*>(root_node)
+        ->GetConcat();
+    OptimizeConcat(concat_node);
+  }
+
+ private:
+  using NodeVec = std::vector<AstNodePtr<charT>>;
+
+  void OptimizeConcat(AstNode<charT>* node) {
+    ConcatNode<charT>* concat_node = static_cast<ConcatNode<charT>*>(node);
+    NodeVec& basic_globs = concat_node->GetBasicGlobs();
+    NodeVec parts;
+
+    for (auto& basic_glob : basic_globs) {
+      switch (basic_glob->GetType()) {
+        case AstNode<charT>::Type::GROUP:
+          OptimizeGroup(std::move(basic_glob), parts);
+          break;
+
+        case AstNode<charT>::Type::POS_SET:
+          parts.push_back(LowerSet(std::move(basic_glob)));
+          break;
+
+        default:
+          parts.push_back(std::move(basic_glob));
+          break;
+      }
+    }
+
+    basic_globs = MergeRuns(std::move(parts));
+  }
+
+  void OptimizeGroup(AstNodePtr<charT>&& node, NodeVec& parts) {
+    GroupNode<charT>* group_node = static_cast<GroupNode<charT>*>(node.get());
+    NodeVec& items = static_cast<UnionNode<charT>*>(group_node->GetGlob())
+        ->GetItems();
+
+    for (auto& item : items) {
+      OptimizeConcat(item.get());
+    }
+
+    // only groups that match exactly once can be rewritten, the others
+    // repeat or negate the whole alternative
+    if (group_node->GetGroupType() != GroupNode<charT>::GroupType::BASIC &&
+        group_node->GetGroupType() != GroupNode<charT>::GroupType::AT) {
+      parts.push_back(std::move(node));
+      return;
+    }
+
+    if (items.size() == 1) {
+      NodeVec& item_globs = BasicGlobs(items[0]);
+      if (CanFlatten(item_globs)) {
+        for (auto& basic_glob : item_globs) {
+          parts.push_back(std::move(basic_glob));
+        }
+        return;
+      }
+
+      parts.push_back(std::move(node));
+      return;
+    }
+
+    size_t prefix = CommonPrefix(items);
+    size_t suffix = CommonSuffix(items, prefix);
+
+    NodeVec& first = BasicGlobs(items[0]);
+    for (size_t i = 0; i < prefix; i++) {
+      parts.push_back(std::move(first[i]));
+    }
+
+    NodeVec suffix_nodes;
+    for (size_t i = first.size() - suffix; i < first.size(); i++) {
+      suffix_nodes.push_back(std::move(first[i]));
+    }
+
+    for (auto& item : items) {
+      NodeVec& item_globs = BasicGlobs(item);
+      item_globs.erase(item_globs.end() - suffix, item_globs.end());
+      item_globs.erase(item_globs.begin(), item_globs.begin() + prefix);
+    }
+
+    parts.push_back(std::move(node));
+    for (auto& suffix_node : suffix_nodes) {
+      parts.push_back(std::move(suffix_node));
+    }
+  }
+
+  // a group doesn't backtrack into its alternative, so only alternatives of
+  // fixed width, that can't be matched in more than one way, are flattened
+  bool CanFlatten(const NodeVec& basic_globs) const {
+    return FixedWidth(basic_globs, 0) > 0;
+  }
+
+  // number of chars in the beginning of all alternatives, each alternative
+  // keeps at least one node, so no alternative becomes empty
+  size_t CommonPrefix(NodeVec& items) const {
+    size_t prefix = 0;
+    while (true) {
+      for (auto& item : items) {
+        NodeVec& basic_globs = BasicGlobs(item);
+        if (prefix + 1 >= basic_globs.size() ||
+            !SameChar(basic_globs[prefix].get(),
+                BasicGlobs(items[0])[prefix].get())) {
+          return prefix;
+        }
+      }
+      prefix++;
+    }
+  }
+
+  // the suffix is hoisted only when what is left of every alternative has the
+  // same fixed width, otherwise the group could stop in a different position
+  // of the string and the suffix would be checked in another place
+  size_t CommonSuffix(NodeVec& items, size_t prefix) const {
+    size_t width = FixedWidth(BasicGlobs(items[0]), prefix);
+    if (width == 0) {
+      return 0;
+    }
+
+    for (auto& item : items) {
+      if (FixedWidth(BasicGlobs(item), prefix) != width) {
+        return 0;
+      }
+    }
+
+    size_t suffix = 0;
+    while (true) {
+      NodeVec& first = BasicGlobs(items[0]);
+      for (auto& item : items) {
+        NodeVec& basic_globs = BasicGlobs(item);
+        if (prefix + suffix + 1 >= basic_globs.size() ||
+            !SameChar(basic_globs[basic_globs.size() - suffix - 1].get(),
+                first[first.size() - suffix - 1].get())) {
+          return suffix;
+        }
+      }
+      suffix++;
+    }
+  }
+
+  // width of the nodes after the prefix, or 0 if the width is not fixed
+  size_t FixedWidth(const NodeVec& basic_globs, size_t prefix) const {
+    size_t width = 0;
+    for (size_t i = prefix; i < basic_globs.size(); i++) {
+      switch (basic_globs[i]->GetType()) {
+        case AstNode<charT>::Type::CHAR:
+        case AstNode<charT>::Type::POS_SET:
+        case AstNode<charT>::Type::NEG_SET:
+          width++;
+          break;
+
+        case AstNode<charT>::Type::ANY:
+          width += static_cast<AnyNode<charT>*>(basic_globs[i].get())
+              ->GetWidth();
+          break;
+
+        default:
+          return 0;
+      }
+    }
+
+    return width;
+  }
+
+  bool SameChar(AstNode<charT>* a, AstNode<charT>* b) const {
+    return a->GetType() == AstNode<charT>::Type::CHAR &&
+        b->GetType() == AstNode<charT>::Type::CHAR &&
+        static_cast<CharNode<charT>*>(a)->GetValue() ==
+        static_cast<CharNode<charT>*>(b)->GetValue();
+  }
+
+  // a set that matches only one char is the same as the char
+  AstNodePtr<charT> LowerSet(AstNodePtr<charT>&& node) {
+    PositiveSetNode<charT>* set_node =
+        static_cast<PositiveSetNode<charT>*>(node.get());
+    NodeVec& items = static_cast<SetItemsNode<charT>*>(set_node->GetSet())
+        ->GetItems();
+
+    charT c = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+      charT start;
+      charT end;
+      if (items[i]->GetType() == AstNode<charT>::Type::CHAR) {
+        start = end = static_cast<CharNode<charT>*>(items[i].get())
+            ->GetValue();
+      } else {
+        RangeNode<charT>* range_node =
+            static_cast<RangeNode<charT>*>(items[i].get());
+        start = static_cast<CharNode<charT>*>(range_node->GetStart())
+            ->GetValue();
+        end = static_cast<CharNode<charT>*>(range_node->GetEnd())
+            ->GetValue();
+      }
+
+      if (start != end || (i > 0 && start != c)) {
+        return std::move(node);
+      }
+      c = start;
+    }
+
+    return AstNodePtr<charT>(new CharNode<charT>(c));
+  }
+
+  // consecutive stars are the same as one star, and consecutive '?' become
+  // one state that skips many chars
+  NodeVec MergeRuns(NodeVec&& parts) {
+    NodeVec merged;
+    for (auto& part : parts) {
+      if (!merged.empty() &&
+          merged.back()->GetType() == part->GetType()) {
+        if (part->GetType() == AstNode<charT>::Type::STAR &&
+            static_cast<StarNode<charT>*>(merged.back().get())->Dirs() ==
+            static_cast<StarNode<charT>*>(part.get())->Dirs()) {
+          continue;
+        }
+
+        if (part->GetType() == AstNode<charT>::Type::ANY) {
+          AnyNode<charT>* any_node =
+              static_cast<AnyNode<charT>*>(merged.back().get());
+          any_node->SetWidth(any_node->GetWidth() +
+              static_cast<AnyNode<charT>*>(part.get())->GetWidth());
+          continue;
+        }
+      }
+
+      merged.push_back(std::move(part));
+    }
+
+    return merged;
+  }
+
+  NodeVec& BasicGlobs(AstNodePtr<charT>& concat_node) const {
+    return static_cast<ConcatNode<charT>*>(concat_node.get())->GetBasicGlobs();
+  }
+};
+
+// Prefilter holds what every match of a glob needs: the range of lengths,
+// the literal prefix and suffix, and the literals between them in order, so
+// most strings that don't match are rejected before the automata runs, when
+// the glob is only literals separated by stars, like "*foo*bar*.log", the
+// prefilter is exact and the automata doesn't run at all
+template<class charT>
+class Prefilter {
+ public:
+  static constexpr size_t kUnbounded = std::numeric_limits<size_t>::max();
+
+  Prefilter() = default;
+
+  // a prefilter with the parts given by the getters of other prefilter
+  Prefilter(size_t min_len, size_t max_len, const String<charT>& prefix,
+      const String<charT>& suffix, std::vector<String<charT>>&& literals,
+      bool exact)
+    : min_len_{min_len}
+    , max_len_{max_len}
+    , prefix_{prefix}
+    , suffix_{suffix}
+    , literals_{std::move(literals)}
+    , exact_{exact} {}
+
+  // builds the prefilter from the concat in the root of the AST, in path
+  // mode the stars don't match all strings, so the prefilter is not exact
+  void Build(AstNode<charT>* root_node, bool path_mode = false) {
+    ConcatNode<charT>* concat_node = static_cast<ConcatNode<charT>*>(
+        static_cast<GlobNode<charT>*>(root_node)->GetConcat());
+
+    for (auto& basic_glob : concat_node->GetBasicGlobs()) {
+      if (basic_glob->GetType() == AstNode<charT>::Type::CHAR) {
+        AddChar(static_cast<CharNode<charT>*>(basic_glob.get())->GetValue());
+      } else if (basic_glob->GetType() == AstNode<charT>::Type::STAR &&
+          !path_mode) {
+        AddStar();
+      } else {
+        size_t min_len;
+        size_t max_len;
+        std::tie(min_len, max_len) = Width(basic_glob.get());
+        AddWidth(min_len, max_len);
+      }
+    }
+
+    Finish();
+  }
+
+  // the prefilter can also be built part by part, for globs that don't
+  // have an AST
+  void AddChar(charT c) {
+    run_ += c;
+    AddLength(1, 1);
+  }
+
+  void AddStar() {
+    AddGap(0, kUnbounded);
+  }
+
+  // any part that is not a char or a star, the prefilter is not exact anymore
+  void AddWidth(size_t min_len, size_t max_len) {
+    exact_ = false;
+    AddGap(min_len, max_len);
+  }
+
+  void Finish() {
+    if (!has_gap_) {
+      prefix_ = std::move(run_);
+    } else {
+      suffix_ = std::move(run_);
+    }
+
+    run_.clear();
+  }
+
+  bool Check(const String<charT>& str) const {
+    return Check(str.data(), str.length());
+  }
+
+  // the string doesn't need to be a String, like a string in a packed
+  // buffer, see glob-batch.h
+  bool Check(const charT* str, size_t len) const {
+    using Traits = std::char_traits<charT>;
+    if (len < min_len_ || len > max_len_) {
+      return false;
+    }
+
+    if (Traits::compare(str, prefix_.data(), prefix_.length()) != 0) {
+      return false;
+    }
+
+    if (Traits::compare(str + len - suffix_.length(), suffix_.data(),
+        suffix_.length()) != 0) {
+      return false;
+    }
+
+    // min_len_ counts the prefix and the suffix, so they don't overlap here,
+    // each literal is searched only between the end of the last one and the
+    // suffix, the first occurrence is the best one, it leaves more string
+    // for the next literals
+    size_t pos = prefix_.length();
+    size_t end = len - suffix_.length();
+    for (auto& literal : literals_) {
+      size_t found = FindLiteral(str + pos, end - pos, literal.data(),
+          literal.length());
+      if (found == String<charT>::npos) {
+        return false;
+      }
+      pos += found + literal.length();
+    }
+
+    return true;
+  }
+
+  // true if Check is the whole answer of the glob
+  bool Exact() const {
+    return exact_;
+  }
+
+  size_t MinLength() const {
+    return min_len_;
+  }
+
+  // kUnbounded if the glob matches strings of any length
+  size_t MaxLength() const {
+    return max_len_;
+  }
+
+  const String<charT>& Prefix() const {
+    return prefix_;
+  }
+
+  const String<charT>& Suffix() const {
+    return suffix_;
+  }
+
+  const std::vector<String<charT>>& Literals() const {
+    return literals_;
+  }
+
+ private:
+  // ends the run of chars, the first run is the prefix, the others must be
+  // found in the string
+  void AddGap(size_t min_len, size_t max_len) {
+    if (!has_gap_) {
+      prefix_ = std::move(run_);
+      has_gap_ = true;
+    } else if (!run_.empty()) {
+      literals_.push_back(std::move(run_));
+    }
+
+    run_.clear();
+    AddLength(min_len, max_len);
+  }
+
+  void AddLength(size_t min_len, size_t max_len) {
+    min_len_ += min_len;
+    max_len_ = (max_len_ == kUnbounded || max_len == kUnbounded) ?
+        kUnbounded : max_len_ + max_len;
+  }
+
+  // the range of lengths that a node of the AST can match
+  static std::tuple<size_t, size_t> Width(AstNode<charT>* node) {
+    switch (node->GetType()) {
+      case AstNode<charT>::Type::CHAR:
+      case AstNode<charT>::Type::POS_SET:
+      case AstNode<charT>::Type::NEG_SET:
+        return std::tuple<size_t, size_t>(1, 1);
+
+      case AstNode<charT>::Type::ANY: {
+        size_t width = static_cast<AnyNode<charT>*>(node)->GetWidth();
+        return std::tuple<size_t, size_t>(width, width);
+      }
+
+      case AstNode<charT>::Type::GROUP:
+        return GroupWidth(static_cast<GroupNode<charT>*>(node));
+
+      default:
+        return std::tuple<size_t, size_t>(0, kUnbounded);
+    }
+  }
+
+  static std::tuple<size_t, size_t> GroupWidth(GroupNode<charT>* node) {
+    size_t min_len = kUnbounded;
+    size_t max_len = 0;
+    auto& items = static_cast<UnionNode<charT>*>(node->GetGlob())->GetItems();
+    for (auto& item : items) {
+      size_t item_min = 0;
+      size_t item_max = 0;
+      for (auto& basic_glob :
+          static_cast<ConcatNode<charT>*>(item.get())->GetBasicGlobs()) {
+        size_t part_min;
+        size_t part_max;
+        std::tie(part_min, part_max) = Width(basic_glob.get());
+        item_min += part_min;
+        item_max = (item_max == kUnbounded || part_max == kUnbounded) ?
+            kUnbounded : item_max + part_max;
+      }
+
+      min_len = std::min(min_len, item_min);
+      max_len = std::max(max_len, item_max);
+    }
+
+    switch (node->GetGroupType()) {
+      case GroupNode<charT>::GroupType::BASIC:
+      case GroupNode<charT>::GroupType::AT:
+        return std::tuple<size_t, size_t>(min_len, max_len);
+
+      case GroupNode<charT>::GroupType::ANY:
+        return std::tuple<size_t, size_t>(0, max_len);
+
+      case GroupNode<charT>::GroupType::STAR:
+        return std::tuple<size_t, size_t>(0,
+            max_len == 0 ? 0 : kUnbounded);
+
+      case GroupNode<charT>::GroupType::PLUS:
+        return std::tuple<size_t, size_t>(min_len,
+            max_len == 0 ? 0 : kUnbounded);
+
+      default:
+        return std::tuple<size_t, size_t>(0, kUnbounded);
+    }
+  }
+
+  size_t min_len_ = 0;
+  size_t max_len_ = 0;
+  String<charT> prefix_;
+  String<charT> suffix_;
+  std::vector<String<charT>> literals_;
+
+  // the chars added since the last part that is not a char
+  String<charT> run_;
+  bool has_gap_ = false;
+  bool exact_ = true;
+};
+
+template<class charT>
+struct ShiftAndItem;
+
+// FastMatcher is an engine that answers only if a string matches, without
+// captures, for the patterns that it supports it is faster than the automata
+template<class charT>
+class FastMatcher {
+ public:
+  virtual ~FastMatcher() = default;
+
+  bool Match(const String<charT>& str) const {
+    return Match(str.data(), str.length());
+  }
+
+  virtual bool Match(const charT* str, size_t len) const = 0;
+
+  // the state of a match that reads the string in parts, big enough for the
+  // bit vector of any engine
+  struct StreamState {
+    alignas(16) unsigned char mask[16];
+    // in path mode, if the next char starts a segment
+    bool segment_start;
+  };
+
+  virtual void StreamStart(StreamState& state) const = 0;
+
+  // reads the chars of the next part of the string
+  virtual StreamStatus StreamFeed(StreamState& state, const charT* str,
+      size_t len) const = 0;
+
+  // true if the string read so far matches
+  virtual bool StreamMatch(const StreamState& state) const = 0;
+
+  // the items that the engine was built from, NewShiftAnd builds it again
+  virtual const std::vector<ShiftAndItem<charT>>& Items() const = 0;
+};
+
+// one part of a pattern for the bit-parallel engine: a char, any char, a set
+// or a star, or the "**" of path mode
+template<class charT>
+struct ShiftAndItem {
+  enum class Kind {
+    CHAR,
+    ANY,
+    SET,
+    STAR,
+    DIRS
+  };
+
+  Kind kind;
+  charT c;
+
+  // ranges of the set, a single char is a range with start == end
+  std::vector<std::pair<charT, charT>> ranges;
+  bool neg;
+
+  bool Check(charT ch) const {
+    switch (kind) {
+      case Kind::CHAR:
+        return ch == c;
+
+      case Kind::SET: {
+        bool r = false;
+        for (auto& range : ranges) {
+          r = r || (ch >= range.first && ch <= range.second);
+        }
+        return neg ? !r : r;
+      }
+
+      default:
+        return true;
+    }
+  }
+};
+
+// ShiftAnd runs the position automaton of the pattern as a bit vector: bit i
+// is set when the first i chars of the pattern matched, each char of the
+// string shifts the vector and masks it with the positions that accept the
+// char, stars keep their bit set with a self loop mask
+//
+// in path mode '/' is only in the masks of the chars '/' of the pattern and
+// only the loops of "**" keep their bits on it, a '.' at the start of a
+// segment is matched only by a '.' at the start of a segment of the pattern,
+// and the bits of "**" alone leave their position only at the start of a
+// segment
+template<class charT, class maskT>
+class ShiftAnd: public FastMatcher<charT> {
+ public:
+  static constexpr size_t kMaxPositions = sizeof(maskT) * 8 - 1;
+
+  ShiftAnd(std::vector<ShiftAndItem<charT>>&& items, bool path_mode = false)
+    : items_{std::move(items)}
+    , path_mode_{path_mode}
+    , self_loop_{0}
+    , dirs_loop_{0}
+    , dirs_only_{0}
+    , dots_{0}
+    , accept_{0} {
+    using Kind = typename ShiftAndItem<charT>::Kind;
+    using UChar = typename std::make_unsigned<charT>::type;
+
+    // the table is filled item by item, chars set one entry and only sets
+    // walk the whole table, the bits of '?' go to all entries at the end
+    maskT any = 0;
+    maskT star_loop = 0;
+    size_t pos = 0;
+    // if the next item starts a segment of the pattern
+    bool segment_start = true;
+    std::fill(masks_, masks_ + kTableSize, maskT(0));
+    for (auto& item : items_) {
+      if (item.kind == Kind::STAR || item.kind == Kind::DIRS) {
+        self_loop_ |= maskT(1) << pos;
+        (item.kind == Kind::DIRS ? dirs_loop_ : star_loop) |=
+            maskT(1) << pos;
+        segment_start = item.kind == Kind::DIRS;
+        continue;
+      }
+
+      maskT bit = maskT(1) << ++pos;
+      switch (item.kind) {
+        case Kind::CHAR:
+          if (static_cast<UChar>(item.c) < kTableSize) {
+            masks_[static_cast<UChar>(item.c)] |= bit;
+          }
+          if (item.c == charT('.') && segment_start) {
+            dots_ |= bit;
+          }
+          break;
+
+        case Kind::SET:
+          for (size_t i = 0; i < kTableSize; i++) {
+            if (item.Check(static_cast<charT>(i)) &&
+                !(path_mode_ && i == '/')) {
+              masks_[i] |= bit;
+            }
+          }
+          break;
+
+        default:
+          any |= bit;
+          break;
+      }
+      segment_start = item.kind == Kind::CHAR && item.c == charT('/');
+    }
+
+    accept_ = maskT(1) << pos;
+    dirs_only_ = dirs_loop_ & ~star_loop;
+    for (size_t i = 0; i < kTableSize; i++) {
+      if (!(path_mode_ && i == '/')) {
+        masks_[i] |= any;
+      }
+    }
+  }
+
+  using FastMatcher<charT>::Match;
+  using StreamState = typename FastMatcher<charT>::StreamState;
+
+  bool Match(const charT* str, size_t len) const override {
+    if (path_mode_) {
+      return MatchPath(str, len);
+    }
+
+    maskT d = 1;
+    for (size_t i = 0; i < len; i++) {
+      d = Step(d, str[i]);
+      if (d == 0) {
+        return false;
+      }
+    }
+
+    return (d & accept_) != 0;
+  }
+
+  // the bit vector is the whole state of the match, so a string in parts
+  // is read with the same steps of a whole string
+  void StreamStart(StreamState& state) const override {
+    Store(state, maskT(1));
+    state.segment_start = true;
+  }
+
+  StreamStatus StreamFeed(StreamState& state, const charT* str,
+      size_t len) const override {
+    maskT d = Load(state);
+    if (path_mode_) {
+      for (size_t i = 0; i < len && d != 0; i++) {
+        d = StepPath(d, str[i], state.segment_start);
+        state.segment_start = str[i] == charT('/');
+      }
+    } else {
+      for (size_t i = 0; i < len && d != 0; i++) {
+        d = Step(d, str[i]);
+      }
+    }
+
+    Store(state, d);
+    if (d == 0) {
+      return StreamStatus::DEAD;
+    }
+
+    // the accept position with a self loop is a star at the end of the
+    // pattern, once reached it stays set for any char, in path mode a '/'
+    // or a '.' can still clear it
+    if (!path_mode_ && (d & accept_ & self_loop_) != 0) {
+      return StreamStatus::WILL_MATCH;
+    }
+
+    return StreamStatus::CAN_MATCH;
+  }
 
-      case TokenKind::PLUSLPAREN:
-        type = GroupNode<charT>::GroupType::PLUS;
-        break;
+  bool StreamMatch(const StreamState& state) const override {
+    return Accepts(Load(state), state.segment_start);
+  }
 
-      case TokenKind::NEGLPAREN:
-        type = GroupNode<charT>::GroupType::NEG;
-        break;
+  const std::vector<ShiftAndItem<charT>>& Items() const override {
+    return items_;
+  }
 
-      case TokenKind::ATLPAREN:
-        type = GroupNode<charT>::GroupType::AT;
-        break;
+  bool PathMode() const {
+    return path_mode_;
+  }
 
-      default:
-        throw Error("Not valid group");
-        break;
-    }
+ private:
+  static constexpr size_t kTableSize = 256;
 
-    AstNodePtr<charT> group_glob = ParserUnion();
-    tk = NextToken();
-    if (tk != TokenKind::RPAREN) {
-      throw Error("Expected ')' at and of group");
-    }
+  static_assert(sizeof(maskT) <= sizeof(StreamState::mask),
+      "the stream state must fit the mask");
 
-    return AstNodePtr<charT>(new GroupNode<charT>(type, std::move(group_glob)));
+  maskT Step(maskT d, charT c) const {
+    return ((d << 1) & Mask(c)) | (d & self_loop_);
   }
 
-  AstNodePtr<charT> ParserConcat() {
-    auto check_end = [&]() -> bool {
-      Token<charT>& tk = GetToken();
+  maskT StepPath(maskT d, charT c, bool segment_start) const {
+    maskT shift = (segment_start ? d : d & ~dirs_only_) << 1;
+    if (segment_start && c == charT('.')) {
+      return shift & dots_;
+    }
 
-      switch (tk.Kind()) {
-        case TokenKind::EOS:
-        case TokenKind::RPAREN:
-        case TokenKind::UNION:
-          return true;
-          break;
+    return (shift & Mask(c)) |
+        (d & (c == charT('/') ? dirs_loop_ : self_loop_));
+  }
 
-        default:
-          return false;
-          break;
+  bool MatchPath(const charT* str, size_t len) const {
+    maskT d = 1;
+    bool segment_start = true;
+    for (size_t i = 0; i < len; i++) {
+      d = StepPath(d, str[i], segment_start);
+      if (d == 0) {
+        return false;
       }
-    };
+      segment_start = str[i] == charT('/');
+    }
 
-    std::vector<AstNodePtr<charT>> parts;
+    return Accepts(d, segment_start);
+  }
 
-    while (!check_end()) {
-      parts.push_back(ParserBasicGlob());
-    }
+  // a "**" at the end of the pattern ends at the start of a segment
+  bool Accepts(maskT d, bool segment_start) const {
+    return (d & accept_) != 0 &&
+        (segment_start || (accept_ & dirs_only_) == 0);
+  }
 
-    return AstNodePtr<charT>(new ConcatNode<charT>(std::move(parts)));
+  static maskT Load(const StreamState& state) {
+    maskT d;
+    std::memcpy(&d, state.mask, sizeof(d));
+    return d;
   }
 
-  AstNodePtr<charT> ParserUnion() {
-    std::vector<AstNodePtr<charT>> items;
-    items.push_back(ParserConcat());
+  static void Store(StreamState& state, maskT d) {
+    std::memcpy(state.mask, &d, sizeof(d));
+  }
 
-    while (GetToken() == TokenKind::UNION) {
-      Advance();
-      items.push_back(ParserConcat());
+  maskT Mask(charT c) const {
+    using UChar = typename std::make_unsigned<charT>::type;
+    if (static_cast<UChar>(c) < kTableSize) {
+      return masks_[static_cast<UChar>(c)];
     }
 
-    return AstNodePtr<charT>(new UnionNode<charT>(std::move(items)));
+    return SlowMask(c);
   }
 
-  AstNodePtr<charT> ParserGlob() {
-    AstNodePtr<charT> glob = ParserConcat();
+  // wide chars out of the table check each position of the pattern
+  maskT SlowMask(charT c) const {
+    maskT mask = 0;
+    size_t pos = 0;
+    for (auto& item : items_) {
+      if (item.kind == ShiftAndItem<charT>::Kind::STAR ||
+          item.kind == ShiftAndItem<charT>::Kind::DIRS) {
+        continue;
+      }
 
-    if (GetToken() != TokenKind::EOS) {
-      throw Error("Expected the end of glob");
+      pos++;
+      if (item.Check(c)) {
+        mask |= maskT(1) << pos;
+      }
     }
 
-    return AstNodePtr<charT>(new GlobNode<charT>(std::move(glob)));
+    return mask;
   }
 
-  inline const Token<charT>& GetToken() const {
-    return tok_vec_.at(pos_);
-  }
+  std::vector<ShiftAndItem<charT>> items_;
+  maskT masks_[kTableSize];
+  bool path_mode_;
+  maskT self_loop_;
+  maskT dirs_loop_;
+  maskT dirs_only_;
+  maskT dots_;
+  maskT accept_;
+};
 
-  inline Token<charT>& GetToken() {
-    return tok_vec_.at(pos_);
+// chooses the smallest mask that fits the positions of the items, returns
+// nullptr when the pattern is too big for the bit-parallel engine
+template<class charT>
+std::unique_ptr<FastMatcher<charT>> NewShiftAnd(
+    std::vector<ShiftAndItem<charT>>&& items, bool path_mode = false) {
+  using Kind = typename ShiftAndItem<charT>::Kind;
+  size_t positions = 0;
+  for (auto& item : items) {
+    positions += item.kind != Kind::STAR && item.kind != Kind::DIRS;
   }
 
-  inline const Token<charT>& PeekAhead() const {
-    if (pos_ >= (tok_vec_.size() - 1))
-      return tok_vec_.back();
+  if (positions <= ShiftAnd<charT, uint64_t>::kMaxPositions) {
+    return std::unique_ptr<FastMatcher<charT>>(
+        new ShiftAnd<charT, uint64_t>(std::move(items), path_mode));
+  }
 
-    return tok_vec_.at(pos_ + 1);
+#ifdef __SIZEOF_INT128__
+  if (positions <= ShiftAnd<charT, unsigned __int128>::kMaxPositions) {
+    return std::unique_ptr<FastMatcher<charT>>(
+        new ShiftAnd<charT, unsigned __int128>(std::move(items), path_mode));
   }
+#endif
 
-  inline Token<charT>& NextToken() {
-    if (pos_ >= (tok_vec_.size() - 1))
-      return tok_vec_.back();
+  return nullptr;
+}
 
-    Token<charT>& tk = tok_vec_.at(pos_);
-    pos_++;
-    return tk;
+// the ranges of the items of a set of the AST
+template<class charT>
+std::vector<std::pair<charT, charT>> SetRanges(AstNode<charT>* node) {
+  std::vector<std::pair<charT, charT>> ranges;
+  for (auto& item : static_cast<SetItemsNode<charT>*>(node)->GetItems()) {
+    if (item->GetType() == AstNode<charT>::Type::CHAR) {
+      charT c = static_cast<CharNode<charT>*>(item.get())->GetValue();
+      ranges.push_back(std::make_pair(c, c));
+    } else {
+      // the automata accepts ranges like "z-a" as "a-z", see SetItemRange
+      RangeNode<charT>* range_node = static_cast<RangeNode<charT>*>(item.get());
+      charT start =
+          static_cast<CharNode<charT>*>(range_node->GetStart())->GetValue();
+      charT end = static_cast<CharNode<charT>*>(range_node->GetEnd())->GetValue();
+      ranges.push_back(std::make_pair(std::min(start, end),
+          std::max(start, end)));
+    }
   }
 
-  inline bool Advance() {
-    if (pos_ == tok_vec_.size() - 1)
-      return false;
+  return ranges;
+}
 
-    ++pos_;
-    return true;
-  }
+// the fast engine for the AST, patterns with groups are left to the automata
+template<class charT>
+std::unique_ptr<FastMatcher<charT>> NewFastMatcher(AstNode<charT>* root_node,
+    bool path_mode = false) {
+  using Kind = typename ShiftAndItem<charT>::Kind;
+  ConcatNode<charT>* concat_node = static_cast<ConcatNode<charT>*>(
+      static_cast<GlobNode<charT>*>(root_node)->GetConcat());
+  std::vector<ShiftAndItem<charT>> items;
+
+  for (auto& basic_glob : concat_node->GetBasicGlobs()) {
+    AstNode<charT>* node = basic_glob.get();
+    switch (node->GetType()) {
+      case AstNode<charT>::Type::CHAR:
+        items.push_back(ShiftAndItem<charT>{Kind::CHAR,
+            static_cast<CharNode<charT>*>(node)->GetValue(), {}, false});
+        break;
 
-  inline size_t Size() const noexcept {
-    return tok_vec_.size();
+      case AstNode<charT>::Type::ANY: {
+        size_t width = static_cast<AnyNode<charT>*>(node)->GetWidth();
+        for (size_t i = 0; i < width; i++) {
+          items.push_back(ShiftAndItem<charT>{Kind::ANY, 0, {}, false});
+        }
+        break;
+      }
+
+      case AstNode<charT>::Type::STAR:
+        items.push_back(ShiftAndItem<charT>{
+            static_cast<StarNode<charT>*>(node)->Dirs() ? Kind::DIRS :
+            Kind::STAR, 0, {}, false});
+        break;
+
+      case AstNode<charT>::Type::POS_SET:
+        items.push_back(ShiftAndItem<charT>{Kind::SET, 0, SetRanges(
+            static_cast<PositiveSetNode<charT>*>(node)->GetSet()), false});
+        break;
+
+      case AstNode<charT>::Type::NEG_SET:
+        items.push_back(ShiftAndItem<charT>{Kind::SET, 0, SetRanges(
+            static_cast<NegativeSetNode<charT>*>(node)->GetSet()), true});
+        break;
+
+      default:
+        return nullptr;
+    }
   }
 
-  std::vector<Token<charT>> tok_vec_;
-  size_t pos_;
-};
+  return NewShiftAnd(std::move(items), path_mode);
+}
 
 template<class charT>
 class AstConsumer {
  public:
-  AstConsumer() = default;
+  AstConsumer(bool path_mode = false)
+    : path_mode_{path_mode} {}
 
   void GenAutomata(AstNode<charT>* root_node, Automata<charT>& automata) {
     AstNode<charT>* concat_node = static_cast<GlobNode<charT>*>(root_node)
         ->GetConcat();
     ExecConcat(concat_node, automata);
 
-    size_t match_state = automata.template NewState<StateMatch<charT>>();
-    automata.GetState(preview_state_).AddNextState(match_state);
-    automata.SetMatchState(match_state);
+    // the match state of an empty pattern is the start state
+    NewState<StateMatch<charT>>(automata);
+    automata.SetMatchState(current_state_);
 
     size_t fail_state = automata.template NewState<StateFail<charT>>();
     automata.SetFailState(fail_state);
@@ -1418,16 +3113,24 @@ class AstConsumer {
 
   void ExecChar(AstNode<charT>* node, Automata<charT>& automata) {
     CharNode<charT>* char_node = static_cast<CharNode<charT>*>(node);
-    char c = char_node->GetValue();
+    charT c = char_node->GetValue();
     NewState<StateChar<charT>>(automata, c);
   }
 
-  void ExecAny(AstNode<charT>*, Automata<charT>& automata) {
-    NewState<StateAny<charT>>(automata);
+  void ExecAny(AstNode<charT>* node, Automata<charT>& automata) {
+    AnyNode<charT>* any_node = static_cast<AnyNode<charT>*>(node);
+    NewState<StateAny<charT>>(automata, any_node->GetWidth(), path_mode_);
   }
 
-  void ExecStar(AstNode<charT>*, Automata<charT>& automata) {
-    NewState<StateStar<charT>>(automata);
+  void ExecStar(AstNode<charT>* node, Automata<charT>& automata) {
+    StarKind kind = StarKind::ANY;
+    if (static_cast<StarNode<charT>*>(node)->Dirs()) {
+      kind = StarKind::DIRS;
+    } else if (path_mode_) {
+      kind = StarKind::SEGMENT;
+    }
+
+    NewState<StateStar<charT>>(automata, kind);
     automata.GetState(current_state_).AddNextState(current_state_);
   }
 
@@ -1435,50 +3138,16 @@ class AstConsumer {
     PositiveSetNode<charT>* pos_set_node =
         static_cast<PositiveSetNode<charT>*>(node);
 
-    auto items = ProcessSetItems(pos_set_node->GetSet());
-    NewState<StateSet<charT>>(automata, std::move(items));
+    NewState<StateSet<charT>>(automata, SetRanges(pos_set_node->GetSet()),
+        /*neg*/false, path_mode_);
   }
 
   void ExecNegativeSet(AstNode<charT>* node, Automata<charT>& automata) {
     NegativeSetNode<charT>* pos_set_node =
         static_cast<NegativeSetNode<charT>*>(node);
 
-    auto items = ProcessSetItems(pos_set_node->GetSet());
-    NewState<StateSet<charT>>(automata, std::move(items), /*neg*/true);
-  }
-
-  std::vector<std::unique_ptr<SetItem<charT>>> ProcessSetItems(
-      AstNode<charT>* node) {
-    SetItemsNode<charT>* set_node = static_cast<SetItemsNode<charT>*>(node);
-    std::vector<std::unique_ptr<SetItem<charT>>> vec;
-    auto& items = set_node->GetItems();
-    for (auto& item : items) {
-      vec.push_back(std::move(ProcessSetItem(item.get())));
-    }
-
-    return vec;
-  }
-
-  std::unique_ptr<SetItem<charT>> ProcessSetItem(AstNode<charT>* node) {
-    if (node->GetType() == AstNode<charT>::Type::CHAR) {
-      CharNode<charT>* char_node = static_cast<CharNode<charT>*>(node);
-      char c = char_node->GetValue();
-      return std::unique_ptr<SetItem<charT>>(new SetItemChar<charT>(c));
-    } else if (node->GetType() == AstNode<charT>::Type::RANGE) {
-      RangeNode<charT>* range_node = static_cast<RangeNode<charT>*>(node);
-      CharNode<charT>* start_node = static_cast<CharNode<charT>*>(
-          range_node->GetStart());
-
-      CharNode<charT>* end_node = static_cast<CharNode<charT>*>(
-          range_node->GetEnd());
-
-      char start_char = start_node->GetValue();
-      char end_char = end_node->GetValue();
-      return std::unique_ptr<SetItem<charT>>(new SetItemRange<charT>(start_char,
-          end_char));
-    } else {
-      throw Error("Not valid set item");
-    }
+    NewState<StateSet<charT>>(automata, SetRanges(pos_set_node->GetSet()),
+        /*neg*/true, path_mode_);
   }
 
   void ExecGroup(AstNode<charT>* node, Automata<charT>& automata) {
@@ -1526,13 +3195,11 @@ class AstConsumer {
     std::vector<std::unique_ptr<Automata<charT>>> vec_automatas;
     for (auto& item : items) {
       std::unique_ptr<Automata<charT>> automata_ptr(new Automata<charT>);
-      AstConsumer ast_consumer;
+      AstConsumer ast_consumer(path_mode_);
       ast_consumer.ExecConcat(item.get(), *automata_ptr);
 
-      size_t match_state = automata_ptr->template NewState<StateMatch<charT>>();
-      automata_ptr->GetState(ast_consumer.preview_state_)
-          .AddNextState(match_state);
-      automata_ptr->SetMatchState(match_state);
+      ast_consumer.template NewState<StateMatch<charT>>(*automata_ptr);
+      automata_ptr->SetMatchState(ast_consumer.current_state_);
 
       size_t fail_state = automata_ptr->template NewState<StateFail<charT>>();
       automata_ptr->SetFailState(fail_state);
@@ -1553,87 +3220,290 @@ class AstConsumer {
   }
 
  private:
+  bool path_mode_;
   int preview_state_ = -1;
   size_t current_state_ = 0;
 };
 
+// the prefilter and the fast matcher don't change while they run, so
+// ExecConstEngines can be called from many threads at once, it returns false
+// when the answer needs the automata
+template<class charT>
+bool ExecConstEngines(const Prefilter<charT>& prefilter,
+    const FastMatcher<charT>* fast_matcher, const charT* str, size_t len,
+    const MatchBudget& budget, bool capture, MatchStatus& status) {
+  if (!prefilter.Check(str, len)) {
+    status = MatchStatus::NO_MATCH;
+    return true;
+  }
+
+  if (prefilter.Exact() && !capture) {
+    status = MatchStatus::MATCH;
+    return true;
+  }
+
+  if (fast_matcher && !capture && len <= budget.MaxSteps()) {
+    status = fast_matcher->Match(str, len) ? MatchStatus::MATCH :
+        MatchStatus::NO_MATCH;
+    return true;
+  }
+
+  return false;
+}
+
+template<class charT>
+bool ExecConstEngines(const Prefilter<charT>& prefilter,
+    const FastMatcher<charT>* fast_matcher, const String<charT>& str,
+    const MatchBudget& budget, bool capture, MatchStatus& status) {
+  return ExecConstEngines(prefilter, fast_matcher, str.data(), str.length(),
+      budget, capture, status);
+}
+
+// runs the engines of a glob: the prefilter rejects what it can, and answers
+// when it is exact, the fast matcher answers when the glob has one, and the
+// automata answers the rest with the limits of the budget, only the automata
+// has captures, the fast matcher takes one step for each char, so it runs
+// only if the string fits the budget
+template<class charT>
+MatchStatus ExecGlob(Automata<charT>& automata,
+    const Prefilter<charT>& prefilter, const FastMatcher<charT>* fast_matcher,
+    const String<charT>& str, const MatchBudget& budget, bool capture) {
+  MatchStatus status;
+  if (ExecConstEngines(prefilter, fast_matcher, str, budget, capture,
+      status)) {
+    return status;
+  }
+
+  automata.SetLimits(budget.MaxSteps(), budget.Deadline());
+
+  bool r;
+  std::tie(r, std::ignore) = automata.Exec(str);
+  if (automata.LimitExceeded()) {
+    return MatchStatus::BUDGET_EXCEEDED;
+  }
+
+  return r ? MatchStatus::MATCH : MatchStatus::NO_MATCH;
+}
+
 template<class charT>
 class ExtendedGlob {
  public:
-  ExtendedGlob(const String<charT>& pattern) {
-    Lexer<charT> l(pattern);
-    std::vector<Token<charT>> tokens = l.Scanner();
-    Parser<charT> p(std::move(tokens));
-    AstNodePtr<charT> ast_ptr = p.GenAst();
-
-    AstConsumer<charT> ast_consumer;
+  ExtendedGlob(const String<charT>& pattern,
+      const GlobOptions& options = GlobOptions())
+    : options_{options}
+    , pattern_{pattern} {
+    // the AST is only used to build the engines, its nodes are placed in a
+    // buffer on the stack, and only long patterns take blocks from the heap,
+    // the AST is destroyed before the arena
+    alignas(std::max_align_t) char ast_buffer[kAstBufferSize];
+    Arena arena(ast_buffer, sizeof(ast_buffer));
+
+    bool path_mode = options.PathMode();
+    AstNodePtr<charT> ast_ptr = GenAst(pattern, path_mode, &arena);
+
+    AstOptimizer<charT> ast_optimizer;
+    ast_optimizer.Optimize(ast_ptr.get());
+    prefilter_.Build(ast_ptr.get(), path_mode);
+    fast_matcher_ = NewFastMatcher<charT>(ast_ptr.get(), path_mode);
+
+    AstConsumer<charT> ast_consumer(path_mode);
     ast_consumer.GenAutomata(ast_ptr.get(), automata_);
   }
 
   ExtendedGlob(const ExtendedGlob&) = delete;
   ExtendedGlob& operator=(ExtendedGlob&) = delete;
 
-  ExtendedGlob(ExtendedGlob&& glob): automata_{std::move(glob.automata_)} {}
+  // a glob from the engines of a compiled glob, see glob-serialize.h, the
+  // pattern builds the automata of the captures
+  ExtendedGlob(Automata<charT>&& automata, Prefilter<charT>&& prefilter,
+      std::unique_ptr<FastMatcher<charT>>&& fast_matcher,
+      const GlobOptions& options = GlobOptions(),
+      const String<charT>& pattern = String<charT>())
+    : options_{options}
+    , pattern_{pattern}
+    , automata_{std::move(automata)}
+    , prefilter_{std::move(prefilter)}
+    , fast_matcher_{std::move(fast_matcher)} {}
+
+  ExtendedGlob(ExtendedGlob&& glob)
+    : options_{glob.options_}
+    , pattern_{std::move(glob.pattern_)}
+    , automata_{std::move(glob.automata_)}
+    , capture_automata_{std::move(glob.capture_automata_)}
+    , prefilter_{std::move(glob.prefilter_)}
+    , fast_matcher_{std::move(glob.fast_matcher_)} {}
 
   ExtendedGlob& operator=(ExtendedGlob&& glob) {
+    options_ = glob.options_;
+    pattern_ = std::move(glob.pattern_);
     automata_ = std::move(glob.automata_);
+    capture_automata_ = std::move(glob.capture_automata_);
+    prefilter_ = std::move(glob.prefilter_);
+    fast_matcher_ = std::move(glob.fast_matcher_);
     return *this;
   }
 
   bool Exec(const String<charT>& str) {
-    bool r;
-    std::tie(r, std::ignore) = automata_.Exec(str);
-    return r;
+    return Exec(str, MatchBudget{}) == MatchStatus::MATCH;
+  }
+
+  // captures come only from the automata, so capture skips the fast matcher
+  // and runs the automata of the captures
+  MatchStatus Exec(const String<charT>& str, const MatchBudget& budget,
+      bool capture = false) {
+    Automata<charT>& automata = capture ? CaptureAutomata() : automata_;
+    return ExecGlob(automata, prefilter_, fast_matcher_.get(), str, budget,
+        capture);
   }
 
   const Automata<charT>& GetAutomata() const {
     return automata_;
   }
 
+  // the automata of the last match with captures
+  const Automata<charT>& GetCaptureAutomata() const {
+    return capture_automata_ ? *capture_automata_ : automata_;
+  }
+
+  const Prefilter<charT>& GetPrefilter() const {
+    return prefilter_;
+  }
+
+  // nullptr when the pattern runs only on the automata
+  const FastMatcher<charT>* GetFastMatcher() const {
+    return fast_matcher_.get();
+  }
+
+  const GlobOptions& GetOptions() const {
+    return options_;
+  }
+
  private:
+  static constexpr size_t kAstBufferSize = 2048;
+
+  static AstNodePtr<charT> GenAst(const String<charT>& pattern,
+      bool path_mode, Arena* arena) {
+    Lexer<charT> l(pattern);
+    std::vector<Token<charT>> tokens = l.Scanner();
+    Parser<charT> p(std::move(tokens), arena, path_mode);
+    return p.GenAst();
+  }
+
+  // the captures are the ones of the pattern as written, so their automata
+  // is built from the AST before the AstOptimizer, on the first match with
+  // captures, a glob without its pattern captures with the optimized one
+  Automata<charT>& CaptureAutomata() {
+    if (!capture_automata_ && !pattern_.empty()) {
+      alignas(std::max_align_t) char ast_buffer[kAstBufferSize];
+      Arena arena(ast_buffer, sizeof(ast_buffer));
+      bool path_mode = options_.PathMode();
+      AstNodePtr<charT> ast_ptr = GenAst(pattern_, path_mode, &arena);
+
+      std::unique_ptr<Automata<charT>> automata(new Automata<charT>);
+      AstConsumer<charT> ast_consumer(path_mode);
+      ast_consumer.GenAutomata(ast_ptr.get(), *automata);
+      capture_automata_ = std::move(automata);
+    }
+
+    return capture_automata_ ? *capture_automata_ : automata_;
+  }
+
+  GlobOptions options_;
+  String<charT> pattern_;
   Automata<charT> automata_;
+  std::unique_ptr<Automata<charT>> capture_automata_;
+  Prefilter<charT> prefilter_;
+  std::unique_ptr<FastMatcher<charT>> fast_matcher_;
 };
 
 template<class charT>
 class SimpleGlob {
  public:
-  SimpleGlob(const String<charT>& pattern) {
+  SimpleGlob(const String<charT>& pattern,
+      const GlobOptions& options = GlobOptions())
+    : options_{options} {
     Parser(pattern);
   }
 
   SimpleGlob(const SimpleGlob&) = delete;
   SimpleGlob& operator=(SimpleGlob&) = delete;
 
-  SimpleGlob(SimpleGlob&& glob): automata_{std::move(glob.automata_)} {}
+  // a glob from the engines of a compiled glob, see glob-serialize.h, the
+  // automata has no rewrites, so the pattern is not needed for captures
+  SimpleGlob(Automata<charT>&& automata, Prefilter<charT>&& prefilter,
+      std::unique_ptr<FastMatcher<charT>>&& fast_matcher,
+      const GlobOptions& options = GlobOptions(),
+      const String<charT>& = String<charT>())
+    : options_{options}
+    , automata_{std::move(automata)}
+    , prefilter_{std::move(prefilter)}
+    , fast_matcher_{std::move(fast_matcher)} {}
+
+  SimpleGlob(SimpleGlob&& glob)
+    : options_{glob.options_}
+    , automata_{std::move(glob.automata_)}
+    , prefilter_{std::move(glob.prefilter_)}
+    , fast_matcher_{std::move(glob.fast_matcher_)} {}
 
   SimpleGlob& operator=(SimpleGlob&& glob) {
+    options_ = glob.options_;
     automata_ = std::move(glob.automata_);
+    prefilter_ = std::move(glob.prefilter_);
+    fast_matcher_ = std::move(glob.fast_matcher_);
     return *this;
   }
 
   void Parser(const String<charT>& pattern) {
+    using Kind = typename ShiftAndItem<charT>::Kind;
+    bool path_mode = options_.PathMode();
     size_t pos = 0;
     int preview_state = -1;
+    std::vector<ShiftAndItem<charT>> items;
 
     while(pos < pattern.length()) {
       size_t current_state = 0;
-      char c = pattern[pos];
+      charT c = pattern[pos];
       switch (c) {
         case '?': {
-          current_state = automata_.template NewState<StateAny<charT>>();
+          current_state = automata_.template NewState<StateAny<charT>>(1,
+              path_mode);
+          prefilter_.AddWidth(1, 1);
+          items.push_back(ShiftAndItem<charT>{Kind::ANY, 0, {}, false});
           ++pos;
           break;
         }
 
         case '*': {
-          current_state = automata_.template NewState<StateStar<charT>>();
+          size_t end = DirsEnd(pattern, pos);
+          if (end == pos) {
+            current_state = automata_.template NewState<StateStar<charT>>(
+                path_mode ? StarKind::SEGMENT : StarKind::ANY);
+            items.push_back(ShiftAndItem<charT>{Kind::STAR, 0, {}, false});
+            ++pos;
+          } else if (items.empty() || items.back().kind != Kind::DIRS) {
+            current_state = automata_.template NewState<StateStar<charT>>(
+                StarKind::DIRS);
+            items.push_back(ShiftAndItem<charT>{Kind::DIRS, 0, {}, false});
+            pos = end;
+          } else {
+            // "**/**/" is the same as "**/"
+            pos = end;
+            continue;
+          }
+
           automata_.GetState(current_state).AddNextState(current_state);
-          ++pos;
+          if (path_mode) {
+            prefilter_.AddWidth(0, Prefilter<charT>::kUnbounded);
+          } else {
+            prefilter_.AddStar();
+          }
           break;
         }
 
         default: {
           current_state = automata_.template NewState<StateChar<charT>>(c);
+          prefilter_.AddChar(c);
+          items.push_back(ShiftAndItem<charT>{Kind::CHAR, c, {}, false});
           ++pos;
           break;
         }
@@ -1646,25 +3516,79 @@ class SimpleGlob {
     }
 
     size_t match_state = automata_.template NewState<StateMatch<charT>>();
-    automata_.GetState(preview_state).AddNextState(match_state);
+    if (preview_state >= 0) {
+      automata_.GetState(preview_state).AddNextState(match_state);
+    }
     automata_.SetMatchState(match_state);
 
     size_t fail_state = automata_.template NewState<StateFail<charT>>();
     automata_.SetFailState(fail_state);
+    prefilter_.Finish();
+    fast_matcher_ = NewShiftAnd(std::move(items), path_mode);
   }
 
-  bool Exec(const String<charT>& str) const {
-    bool r;
-    std::tie(r, std::ignore) = automata_.Exec(str);
-    return r;
+  // in path mode a segment of the pattern that is only stars matches any
+  // number of segments, it takes the '/' after it, returns the position
+  // after the segment or pos if it isn't one, the last star of a "**" at the
+  // end of the pattern is left to match the last segment
+  size_t DirsEnd(const String<charT>& pattern, size_t pos) const {
+    if (!options_.PathMode() || !SegmentStart(pattern.data(), pos)) {
+      return pos;
+    }
+
+    size_t end = pos;
+    while (end < pattern.length() && pattern[end] == '*') {
+      end++;
+    }
+
+    if (end - pos < 2) {
+      return pos;
+    }
+
+    if (end == pattern.length()) {
+      return end - 1;
+    }
+
+    return pattern[end] == '/' ? end + 1 : pos;
+  }
+
+  bool Exec(const String<charT>& str) {
+    return Exec(str, MatchBudget{}) == MatchStatus::MATCH;
+  }
+
+  // captures come only from the automata, so capture skips the fast matcher
+  MatchStatus Exec(const String<charT>& str, const MatchBudget& budget,
+      bool capture = false) {
+    return ExecGlob(automata_, prefilter_, fast_matcher_.get(), str, budget,
+        capture);
   }
 
   const Automata<charT>& GetAutomata() const {
     return automata_;
   }
 
+  const Automata<charT>& GetCaptureAutomata() const {
+    return automata_;
+  }
+
+  const Prefilter<charT>& GetPrefilter() const {
+    return prefilter_;
+  }
+
+  // nullptr when the pattern runs only on the automata
+  const FastMatcher<charT>* GetFastMatcher() const {
+    return fast_matcher_.get();
+  }
+
+  const GlobOptions& GetOptions() const {
+    return options_;
+  }
+
  private:
+  GlobOptions options_;
   Automata<charT> automata_;
+  Prefilter<charT> prefilter_;
+  std::unique_ptr<FastMatcher<charT>> fast_matcher_;
 };
 
 template<class charT>
@@ -1673,13 +3597,22 @@ using extended_glob = ExtendedGlob<charT>;
 template<class charT>
 using no_extended_glob = SimpleGlob<charT>;
 
-template<class charT>
+// the allocator of an allocator-aware type, rebound to other value type
+template<class Alloc, class T>
+using RebindAlloc = typename std::allocator_traits<Alloc>::template
+    rebind_alloc<T>;
+
+template<class charT, class Alloc=std::allocator<charT>>
 class MatchResults;
 
 template<class charT, class globT=extended_glob<charT>>
 class BasicGlob {
  public:
-  BasicGlob(const String<charT>& pattern): glob_{pattern} {}
+  BasicGlob(const String<charT>& pattern,
+      const GlobOptions& options = GlobOptions())
+    : glob_{pattern, options} {}
+
+  BasicGlob(globT&& glob): glob_{std::move(glob)} {}
 
   BasicGlob(const BasicGlob&) = delete;
   BasicGlob& operator=(BasicGlob&) = delete;
@@ -1695,11 +3628,33 @@ class BasicGlob {
     return glob_.GetAutomata();
   }
 
+  // the automata that has the captures of the last match with captures
+  const Automata<charT>& GetCaptureAutomata() const {
+    return glob_.GetCaptureAutomata();
+  }
+
+  const Prefilter<charT>& GetPrefilter() const {
+    return glob_.GetPrefilter();
+  }
+
+  const FastMatcher<charT>* GetFastMatcher() const {
+    return glob_.GetFastMatcher();
+  }
+
+  const GlobOptions& GetOptions() const {
+    return glob_.GetOptions();
+  }
+
  private:
   bool Exec(const String<charT>& str) {
     return glob_.Exec(str);
   }
 
+  MatchStatus Exec(const String<charT>& str, const MatchBudget& budget,
+      bool capture = false) {
+    return glob_.Exec(str, budget, capture);
+  }
+
   template<class charU, class globU>
   friend bool glob_match(const String<charU>& str,
       BasicGlob<charU, globU>& glob);
@@ -1707,27 +3662,54 @@ class BasicGlob {
   template<class charU, class globU>
   friend bool glob_match(const charU* str, BasicGlob<charU, globU>& glob);
 
-  template<class charU, class globU>
-  friend bool glob_match(const String<charU>& str, MatchResults<charU>& res,
+  template<class charU, class allocU, class globU>
+  friend bool glob_match(const String<charU>& str,
+      MatchResults<charU, allocU>& res, BasicGlob<charU, globU>& glob);
+
+  template<class charU, class allocU, class globU>
+  friend bool glob_match(const charU* str, MatchResults<charU, allocU>& res,
       BasicGlob<charU, globU>& glob);
 
   template<class charU, class globU>
-  friend bool glob_match(const charU* str, MatchResults<charU>& res,
-    BasicGlob<charU, globU>& glob);
+  friend MatchStatus glob_match(const String<charU>& str,
+      BasicGlob<charU, globU>& glob, const MatchBudget& budget);
+
+  template<class charU, class allocU, class globU>
+  friend MatchStatus glob_match(const String<charU>& str,
+      MatchResults<charU, allocU>& res, BasicGlob<charU, globU>& glob,
+      const MatchBudget& budget);
 
   globT glob_;
 };
 
-template<class charT>
+// MatchResults is allocator-aware, the matched strings and the vector that
+// holds them use the allocator, so with std::pmr::polymorphic_allocator the
+// results of many matches can live in one memory resource and be freed at
+// once, see pmr::cmatch
+template<class charT, class Alloc>
 class MatchResults {
  public:
-  using const_iterator = typename std::vector<String<charT>>::const_iterator;
+  using allocator_type = Alloc;
+  using string_type = std::basic_string<charT, std::char_traits<charT>,
+      Alloc>;
+  using const_iterator = typename std::vector<string_type,
+      RebindAlloc<Alloc, string_type>>::const_iterator;
 
   MatchResults() = default;
 
+  explicit MatchResults(const Alloc& alloc): results_(alloc) {}
+
   MatchResults(const MatchResults& m): results_{m.results_} {}
 
-  MatchResults(MatchResults&& m): results_{std::move(m.results_)} {}
+  MatchResults(MatchResults&& m) noexcept: results_{std::move(m.results_)} {}
+
+  // the copies built by containers with uses-allocator construction take
+  // the allocator of the container
+  MatchResults(const MatchResults& m, const Alloc& alloc)
+    : results_(m.results_, alloc) {}
+
+  MatchResults(MatchResults&& m, const Alloc& alloc)
+    : results_(std::move(m.results_), alloc) {}
 
   MatchResults& operator=(const MatchResults& m) {
     results_ = m.results_;
@@ -1765,13 +3747,22 @@ class MatchResults {
     return results_.cend();
   }
 
-  String<charT>& operator[] (size_t n) const {
+  const string_type& operator[] (size_t n) const {
     return results_[n];
   }
 
+  allocator_type get_allocator() const {
+    return allocator_type(results_.get_allocator());
+  }
+
  private:
-  void SetResults(std::vector<String<charT>>&& results) {
-    results_ = std::move(results);
+  // the strings are copied from the automata, the capacity of the vector is
+  // kept from the last match
+  void SetResults(bool matched, const Automata<charT>& automata) {
+    results_.clear();
+    if (matched) {
+      automata.AppendMatchedStrings(results_);
+    }
   }
 
   template<class charU, class globU>
@@ -1781,15 +3772,24 @@ class MatchResults {
   template<class charU, class globU>
   friend bool glob_match(const charU* str, BasicGlob<charU, globU>& glob);
 
-  template<class charU, class globU>
-  friend bool glob_match(const String<charU>& str, MatchResults<charU>& res,
+  template<class charU, class allocU, class globU>
+  friend bool glob_match(const String<charU>& str,
+      MatchResults<charU, allocU>& res, BasicGlob<charU, globU>& glob);
+
+  template<class charU, class allocU, class globU>
+  friend bool glob_match(const charU* str, MatchResults<charU, allocU>& res,
       BasicGlob<charU, globU>& glob);
 
   template<class charU, class globU>
-  friend bool glob_match(const charU* str, MatchResults<charU>& res,
-    BasicGlob<charU, globU>& glob);
+  friend MatchStatus glob_match(const String<charU>& str,
+      BasicGlob<charU, globU>& glob, const MatchBudget& budget);
 
-  std::vector<String<charT>> results_;
+  template<class charU, class allocU, class globU>
+  friend MatchStatus glob_match(const String<charU>& str,
+      MatchResults<charU, allocU>& res, BasicGlob<charU, globU>& glob,
+      const MatchBudget& budget);
+
+  std::vector<string_type, RebindAlloc<Alloc, string_type>> results_;
 };
 
 template<class charT, class globT=extended_glob<charT>>
@@ -1802,22 +3802,53 @@ bool glob_match(const charT* str, BasicGlob<charT, globT>& glob) {
   return glob.Exec(str);
 }
 
-template<class charT, class globT=extended_glob<charT>>
-bool glob_match(const String<charT>& str, MatchResults<charT>& res,
+template<class charT, class Alloc, class globT=extended_glob<charT>>
+bool glob_match(const String<charT>& str, MatchResults<charT, Alloc>& res,
     BasicGlob<charT, globT>& glob) {
-  bool r = glob.Exec(str);
-  res.SetResults(glob.GetAutomata().GetMatchedStrings());
+  bool r = glob.Exec(str, MatchBudget{}, /*capture*/true) ==
+      MatchStatus::MATCH;
+  res.SetResults(r, glob.GetCaptureAutomata());
   return r;
 }
 
-template<class charT, class globT=extended_glob<charT>>
-bool glob_match(const charT* str, MatchResults<charT>& res,
+template<class charT, class Alloc, class globT=extended_glob<charT>>
+bool glob_match(const charT* str, MatchResults<charT, Alloc>& res,
     BasicGlob<charT, globT>& glob) {
-  bool r = glob.Exec(str);
-  res.SetResults(glob.GetAutomata().GetMatchedStrings());
+  bool r = glob.Exec(str, MatchBudget{}, /*capture*/true) ==
+      MatchStatus::MATCH;
+  res.SetResults(r, glob.GetCaptureAutomata());
+  return r;
+}
+
+// matches with a budget, when the budget is exceeded the result is
+// MatchStatus::BUDGET_EXCEEDED, no matter what the rest of the string is
+template<class charT, class globT=extended_glob<charT>>
+MatchStatus glob_match(const String<charT>& str, BasicGlob<charT, globT>& glob,
+    const MatchBudget& budget) {
+  return glob.Exec(str, budget);
+}
+
+template<class charT, class globT=extended_glob<charT>>
+MatchStatus glob_match(const charT* str, BasicGlob<charT, globT>& glob,
+    const MatchBudget& budget) {
+  return glob_match(String<charT>(str), glob, budget);
+}
+
+template<class charT, class Alloc, class globT=extended_glob<charT>>
+MatchStatus glob_match(const String<charT>& str,
+    MatchResults<charT, Alloc>& res, BasicGlob<charT, globT>& glob,
+    const MatchBudget& budget) {
+  MatchStatus r = glob.Exec(str, budget, /*capture*/true);
+  res.SetResults(r == MatchStatus::MATCH, glob.GetCaptureAutomata());
   return r;
 }
 
+template<class charT, class Alloc, class globT=extended_glob<charT>>
+MatchStatus glob_match(const charT* str, MatchResults<charT, Alloc>& res,
+    BasicGlob<charT, globT>& glob, const MatchBudget& budget) {
+  return glob_match(String<charT>(str), res, glob, budget);
+}
+
 template<class charT, class globT=extended_glob<charT>>
 using basic_glob = BasicGlob<charT, globT>;
 
@@ -1829,6 +3860,19 @@ using cmatch = MatchResults<char>;
 
 using wmatch = MatchResults<wchar_t>;
 
+#if __cplusplus >= 201703L
+namespace pmr {
+
+// results in a std::pmr::memory_resource, like a monotonic buffer of a
+// request
+using cmatch = MatchResults<char, std::pmr::polymorphic_allocator<char>>;
+
+using wmatch = MatchResults<wchar_t,
+    std::pmr::polymorphic_allocator<wchar_t>>;
+
+}  // namespace pmr
+#endif
+
 } // namespace glob
 
 #endif  // GLOB_CPP_H
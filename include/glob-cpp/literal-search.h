@@ -0,0 +1,260 @@
+#ifndef GLOB_CPP_LITERAL_SEARCH_H
+#define GLOB_CPP_LITERAL_SEARCH_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define GLOB_CPP_HAS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace glob {
+
+enum class SearchImpl {
+  SCALAR,
+  SSE2,
+  AVX2,
+};
+
+// returns the position of the first occurrence of needle in haystack, or
+// npos, for any char type it compares the first char with traits find and
+// the rest of the needle in place
+template<class charT>
+size_t FindLiteralScalar(const charT* haystack, size_t haystack_len,
+    const charT* needle, size_t needle_len) {
+  using Traits = std::char_traits<charT>;
+  if (needle_len == 0) {
+    return 0;
+  }
+
+  size_t pos = 0;
+  while (pos + needle_len <= haystack_len) {
+    const charT* p = Traits::find(haystack + pos,
+        haystack_len - pos - needle_len + 1, needle[0]);
+    if (!p) {
+      return std::basic_string<charT>::npos;
+    }
+
+    pos = static_cast<size_t>(p - haystack);
+    if (Traits::compare(p + 1, needle + 1, needle_len - 1) == 0) {
+      return pos;
+    }
+    pos++;
+  }
+
+  return std::basic_string<charT>::npos;
+}
+
+// the number of zero bits below the lowest set bit, mask is not 0, the
+// compilers without the builtin shift the bits one at a time
+inline unsigned CountTrailingZeros(uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_ctzll(mask));
+#else
+  unsigned n = 0;
+  while ((mask & 1) == 0) {
+    mask >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+#ifdef GLOB_CPP_HAS_X86_SIMD
+
+// the first and the last char of the needle are compared with 16 positions
+// of the haystack at once, only the positions where both match are compared
+// with the whole needle
+inline size_t FindLiteralSse2(const char* haystack, size_t haystack_len,
+    const char* needle, size_t needle_len) {
+  if (needle_len < 2) {
+    return FindLiteralScalar(haystack, haystack_len, needle, needle_len);
+  }
+
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+  size_t i = 0;
+
+  for (; i + needle_len - 1 + 16 <= haystack_len; i += 16) {
+    __m128i block_first = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(haystack + i));
+    __m128i block_last = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(haystack + i + needle_len - 1));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last))));
+
+    while (mask != 0) {
+      unsigned bit = CountTrailingZeros(static_cast<uint64_t>(mask));
+      if (std::memcmp(haystack + i + bit + 1, needle + 1, needle_len - 2) == 0) {
+        return i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  size_t pos = FindLiteralScalar(haystack + i, haystack_len - i, needle,
+      needle_len);
+  return pos == std::string::npos ? pos : i + pos;
+}
+
+// the same of FindLiteralSse2 with 32 positions at once, it is compiled for
+// AVX2 even when the rest of the program is not, and runs only if the cpu
+// supports it
+__attribute__((target("avx2")))
+inline size_t FindLiteralAvx2(const char* haystack, size_t haystack_len,
+    const char* needle, size_t needle_len) {
+  if (needle_len < 2) {
+    return FindLiteralScalar(haystack, haystack_len, needle, needle_len);
+  }
+
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+  size_t i = 0;
+
+  for (; i + needle_len - 1 + 32 <= haystack_len; i += 32) {
+    __m256i block_first = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(haystack + i));
+    __m256i block_last = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(haystack + i + needle_len - 1));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+            _mm256_cmpeq_epi8(last, block_last))));
+
+    while (mask != 0) {
+      unsigned bit = CountTrailingZeros(static_cast<uint64_t>(mask));
+      if (std::memcmp(haystack + i + bit + 1, needle + 1, needle_len - 2) == 0) {
+        return i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  size_t pos = FindLiteralSse2(haystack + i, haystack_len - i, needle,
+      needle_len);
+  return pos == std::string::npos ? pos : i + pos;
+}
+
+#endif  // GLOB_CPP_HAS_X86_SIMD
+
+// the best implementation for the cpu, checked once
+inline SearchImpl BestSearchImpl() {
+#ifdef GLOB_CPP_HAS_X86_SIMD
+  static const SearchImpl impl = __builtin_cpu_supports("avx2") ?
+      SearchImpl::AVX2 : SearchImpl::SSE2;
+  return impl;
+#else
+  return SearchImpl::SCALAR;
+#endif
+}
+
+inline size_t FindLiteral(const char* haystack, size_t haystack_len,
+    const char* needle, size_t needle_len,
+    SearchImpl impl = BestSearchImpl()) {
+  switch (impl) {
+#ifdef GLOB_CPP_HAS_X86_SIMD
+    case SearchImpl::AVX2:
+      return FindLiteralAvx2(haystack, haystack_len, needle, needle_len);
+
+    case SearchImpl::SSE2:
+      return FindLiteralSse2(haystack, haystack_len, needle, needle_len);
+#endif
+
+    default:
+      return FindLiteralScalar(haystack, haystack_len, needle, needle_len);
+  }
+}
+
+// wide chars don't have a vectorized search, they use the scalar one
+template<class charT>
+size_t FindLiteral(const charT* haystack, size_t haystack_len,
+    const charT* needle, size_t needle_len,
+    SearchImpl = SearchImpl::SCALAR) {
+  return FindLiteralScalar(haystack, haystack_len, needle, needle_len);
+}
+
+// the bits of the chars equal to delim in the 64 chars from data, bit i is
+// the char i
+template<class charT>
+uint64_t DelimMask64(const charT* data, charT delim) {
+  uint64_t mask = 0;
+  for (unsigned i = 0; i < 64; i++) {
+    mask |= static_cast<uint64_t>(data[i] == delim) << i;
+  }
+  return mask;
+}
+
+#ifdef GLOB_CPP_HAS_X86_SIMD
+
+// SSE2 is in all x86-64 cpus, so it doesn't need a check of the cpu
+inline uint64_t DelimMask64(const char* data, char delim) {
+  const __m128i d = _mm_set1_epi8(delim);
+  uint64_t mask = 0;
+  for (unsigned i = 0; i < 4; i++) {
+    __m128i block = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(data + 16 * i));
+    mask |= static_cast<uint64_t>(static_cast<unsigned>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(block, d)))) << (16 * i);
+  }
+  return mask;
+}
+
+#endif  // GLOB_CPP_HAS_X86_SIMD
+
+// DelimScanner gives the positions of delim in a buffer, in order, the chars
+// are compared 64 at a time into a mask of bits, and each position is the
+// next bit of the mask, so short lines cost one bit scan and not one call of
+// a search
+template<class charT>
+class DelimScanner {
+ public:
+  DelimScanner(const charT* data, size_t size, charT delim)
+    : data_{data}
+    , size_{size}
+    , delim_{delim} {
+    LoadMask();
+  }
+
+  // the position of the next delim, or the size of the buffer when there
+  // are no more
+  size_t Next() {
+    while (mask_ == 0) {
+      if (block_ + 64 >= size_) {
+        return size_;
+      }
+
+      block_ += 64;
+      LoadMask();
+    }
+
+    size_t pos = block_ + CountTrailingZeros(mask_);
+    mask_ &= mask_ - 1;
+    return pos;
+  }
+
+ private:
+  // the last block can be shorter than 64 chars, it is compared one char at
+  // a time so the scanner never reads after the end of the buffer
+  void LoadMask() {
+    if (block_ + 64 <= size_) {
+      mask_ = DelimMask64(data_ + block_, delim_);
+      return;
+    }
+
+    mask_ = 0;
+    for (size_t i = block_; i < size_; i++) {
+      mask_ |= static_cast<uint64_t>(data_[i] == delim_) << (i - block_);
+    }
+  }
+
+  const charT* data_;
+  size_t size_;
+  charT delim_;
+  size_t block_ = 0;
+  uint64_t mask_ = 0;
+};
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_LITERAL_SEARCH_H
@@ -0,0 +1,101 @@
+#ifndef GLOB_CPP_MAPPED_FILE_H
+#define GLOB_CPP_MAPPED_FILE_H
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include "glob.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define GLOB_CPP_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace glob {
+
+// MappedFile maps a whole file read only, the processes that map the same
+// file share its pages, without mmap the file is read in memory
+class MappedFile {
+ public:
+  enum class Access {
+    RANDOM,
+    // the file is read from the start to the end once, the kernel can read
+    // ahead and drop the pages already read
+    SEQUENTIAL
+  };
+
+  explicit MappedFile(const std::string& path,
+      Access access = Access::RANDOM) {
+#ifdef GLOB_CPP_HAS_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw Error("can't open file: " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw Error("can't open file: " + path);
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      void* addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+      if (addr == MAP_FAILED) {
+        close(fd);
+        throw Error("can't map file: " + path);
+      }
+
+      if (access == Access::SEQUENTIAL) {
+        madvise(addr, size_, MADV_SEQUENTIAL);
+      }
+
+      data_ = static_cast<const char*>(addr);
+      mapped_ = true;
+    }
+    close(fd);
+#else
+    (void)access;
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      throw Error("can't open file: " + path);
+    }
+    buffer_.assign(std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+#ifdef GLOB_CPP_HAS_MMAP
+    if (mapped_) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+  }
+
+  const char* Data() const {
+    return data_;
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  std::string buffer_;
+};
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_MAPPED_FILE_H
@@ -0,0 +1,529 @@
+#ifndef GLOB_CPP_PATH_INDEX_H
+#define GLOB_CPP_PATH_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+#include "glob-batch.h"
+#include "literal-search.h"
+
+namespace glob {
+
+// PathIndex is a trie of the components of a list of paths, like a manifest
+// or the members of an archive, it is built once and then globbed many times
+// without a filesystem, each glob walks only the subtrees that its segments
+// can reach
+//
+// the nodes are kept in one vector, the children of a node are contiguous
+// and sorted by name, and the names are in one buffer, so a literal segment
+// is a binary search in the children, a segment with wildcards scans only the
+// children that start with its literal prefix, and "**" expands to the
+// subtrees below it
+//
+// the paths are split by '/', empty and "." components are dropped, so
+// "/a//b/" and "./a/b" are the entry "a/b", the directories of the paths are
+// entries too, the patterns match like globs in path mode, see GlobOptions
+template<class charT, class globT=extended_glob<charT>>
+class PathIndex {
+ public:
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+  // the root has no name, the entries are 1 to Size()
+  static constexpr size_t kRoot = 0;
+
+  PathIndex() {
+    nodes_.push_back(Node{0, 0, kNoNode, 1, 0, false});
+  }
+
+  explicit PathIndex(const std::vector<String<charT>>& paths) {
+    std::vector<String<charT>> normalized;
+    normalized.reserve(paths.size());
+    for (auto& path : paths) {
+      normalized.push_back(Normalize(path.data(), path.length()));
+    }
+
+    Build(std::move(normalized));
+  }
+
+  // a packed list of paths, like a manifest file, separated by delim
+  PathIndex(const charT* data, size_t size, charT delim = charT('\n')) {
+    std::vector<String<charT>> normalized;
+    DelimScanner<charT> scanner(data, size, delim);
+    for (size_t begin = 0; begin < size;) {
+      size_t end = scanner.Next();
+      normalized.push_back(Normalize(data + begin, end - begin));
+      begin = end + 1;
+    }
+
+    Build(std::move(normalized));
+  }
+
+  // the number of entries, with the directories that are only in the paths
+  // of other entries
+  size_t Size() const {
+    return nodes_.size() - 1;
+  }
+
+  // the entry of the path, or npos
+  size_t Find(const String<charT>& path) const {
+    String<charT> normalized = Normalize(path.data(), path.length());
+    size_t node = kRoot;
+    ForEachComponent(normalized, [&](size_t pos, size_t len) {
+      if (node != npos) {
+        node = FindChild(node, normalized.data() + pos, len);
+      }
+    });
+
+    return node == kRoot ? npos : node;
+  }
+
+  String<charT> Path(size_t entry) const {
+    std::vector<size_t> components;
+    for (size_t node = entry; node != kRoot; node = nodes_[node].parent) {
+      components.push_back(node);
+    }
+
+    String<charT> path;
+    for (size_t i = components.size(); i > 0; i--) {
+      if (i != components.size()) {
+        path += charT('/');
+      }
+      size_t node = components[i - 1];
+      path.append(NameData(node), nodes_[node].size);
+    }
+
+    return path;
+  }
+
+  String<charT> Name(size_t entry) const {
+    return String<charT>(NameData(entry), nodes_[entry].size);
+  }
+
+  size_t Parent(size_t entry) const {
+    return nodes_[entry].parent;
+  }
+
+  size_t NumChildren(size_t entry) const {
+    return nodes_[entry].num_children;
+  }
+
+  // the children are sorted by name, i is from 0 to NumChildren(entry)
+  size_t Child(size_t entry, size_t i) const {
+    return nodes_[entry].first_child + i;
+  }
+
+  // false for the directories that were not in the list, only in the paths
+  // of other entries
+  bool Listed(size_t entry) const {
+    return nodes_[entry].listed;
+  }
+
+  // calls on_match(size_t entry) for each entry that matches the pattern,
+  // each entry once, in the order of the walk, returns the number of
+  // matches, an invalid segment throws Error
+  template<class OnMatch>
+  size_t Glob(const String<charT>& pattern, OnMatch on_match) const {
+    Query query(pattern);
+    size_t num_matches = 0;
+    if (!query.segments.empty()) {
+      Walk(query, kRoot, 0, on_match, num_matches);
+    }
+
+    return num_matches;
+  }
+
+  std::vector<size_t> Glob(const String<charT>& pattern) const {
+    std::vector<size_t> entries;
+    Glob(pattern, [&entries](size_t entry) {
+      entries.push_back(entry);
+    });
+    return entries;
+  }
+
+  std::vector<String<charT>> GlobPaths(const String<charT>& pattern) const {
+    std::vector<String<charT>> paths;
+    Glob(pattern, [this, &paths](size_t entry) {
+      paths.push_back(Path(entry));
+    });
+    return paths;
+  }
+
+ private:
+  static constexpr uint32_t kNoNode = std::numeric_limits<uint32_t>::max();
+
+  // the numbers of a node are 32 bits, so an index holds up to 4G entries
+  // and 4G chars of names
+  struct Node {
+    uint32_t name;
+    uint32_t size;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t num_children;
+    bool listed;
+  };
+
+  struct Segment {
+    enum class Kind {
+      LITERAL,
+      GLOB,
+      DIRS
+    };
+
+    Kind kind;
+    String<charT> text;
+    std::unique_ptr<BasicGlob<charT, globT>> glob;
+    std::unique_ptr<BatchMatcher<charT, globT>> matcher;
+  };
+
+  // the segments of a pattern, each one compiled once for the walk, a
+  // "**" at the end is followed by a star for the last component, as in
+  // path mode, with a "**" the node and segment of each step are marked,
+  // so the walk doesn't repeat a subtree that two ways of splitting the
+  // path reach, and no entry matches twice, the marks are kept in a set,
+  // so a query pays only for the nodes it walks
+  struct Query {
+    explicit Query(const String<charT>& pattern) {
+      ForEachComponent(pattern, [&](size_t pos, size_t len) {
+        String<charT> text = pattern.substr(pos, len);
+        if (IsDirs(text)) {
+          if (segments.empty() ||
+              segments.back().kind != Segment::Kind::DIRS) {
+            segments.push_back(Segment{Segment::Kind::DIRS, text, nullptr,
+                nullptr});
+          }
+        } else {
+          segments.push_back(NewSegment(text));
+        }
+      });
+
+      if (!segments.empty() &&
+          segments.back().kind == Segment::Kind::DIRS) {
+        segments.push_back(NewSegment(String<charT>(1, charT('*'))));
+      }
+
+      for (auto& segment : segments) {
+        has_dirs = has_dirs || segment.kind == Segment::Kind::DIRS;
+      }
+    }
+
+    // the node and segment of a step as one key
+    bool MarkWalked(size_t node, size_t i) {
+      return walked.insert(static_cast<uint64_t>(node) *
+          (segments.size() + 1) + i).second;
+    }
+
+    static Segment NewSegment(const String<charT>& text) {
+      if (IsLiteral(text)) {
+        return Segment{Segment::Kind::LITERAL, text, nullptr, nullptr};
+      }
+
+      Segment segment{Segment::Kind::GLOB, text,
+          std::unique_ptr<BasicGlob<charT, globT>>(new BasicGlob<charT, globT>(
+          text, GlobOptions().SetPathMode(true))), nullptr};
+      segment.matcher.reset(new BatchMatcher<charT, globT>(*segment.glob));
+      return segment;
+    }
+
+    std::vector<Segment> segments;
+    bool has_dirs = false;
+    std::unordered_set<uint64_t> walked;
+  };
+
+  template<class OnMatch>
+  void Walk(Query& query, size_t node, size_t i, OnMatch& on_match,
+      size_t& num_matches) const {
+    if (query.has_dirs && !query.MarkWalked(node, i)) {
+      return;
+    }
+
+    if (i == query.segments.size()) {
+      on_match(node);
+      num_matches++;
+      return;
+    }
+
+    Segment& segment = query.segments[i];
+    const Node& n = nodes_[node];
+    switch (segment.kind) {
+      case Segment::Kind::LITERAL: {
+        size_t child = FindChild(node, segment.text.data(),
+            segment.text.length());
+        if (child != npos) {
+          Walk(query, child, i + 1, on_match, num_matches);
+        }
+        break;
+      }
+
+      case Segment::Kind::GLOB: {
+        // the children are sorted, so the ones that start with the literal
+        // prefix of the segment are one range
+        const String<charT>& prefix = segment.glob->GetPrefilter().Prefix();
+        size_t child = LowerBound(node, prefix.data(), prefix.length());
+        size_t end = n.first_child + n.num_children;
+        for (; child < end; child++) {
+          const Node& c = nodes_[child];
+          if (!StartsWith(child, prefix)) {
+            break;
+          }
+
+          if (segment.matcher->CheckLength(c.size) &&
+              segment.matcher->Match(NameData(child), c.size)) {
+            Walk(query, child, i + 1, on_match, num_matches);
+          }
+        }
+        break;
+      }
+
+      case Segment::Kind::DIRS: {
+        // "**" takes no component, or one more that is not hidden, a
+        // segment always follows it, so the leaves are not walked
+        Walk(query, node, i + 1, on_match, num_matches);
+        for (size_t child = n.first_child;
+            child < n.first_child + n.num_children; child++) {
+          if (nodes_[child].num_children > 0 &&
+              NameData(child)[0] != charT('.')) {
+            Walk(query, child, i, on_match, num_matches);
+          }
+        }
+        break;
+      }
+    }
+  }
+
+  // sorts the paths, the order puts '/' before any other char, so the
+  // paths come in the order of their components, and the nodes are created
+  // depth first with the children of each node in order, then they are
+  // grouped by parent, so the children of a node are contiguous
+  void Build(std::vector<String<charT>>&& paths) {
+    using UChar = typename std::make_unsigned<charT>::type;
+    auto less = [](const String<charT>& a, const String<charT>& b) {
+      auto key = [](charT c) -> uint64_t {
+        return c == charT('/') ? 0 : uint64_t(static_cast<UChar>(c)) + 1;
+      };
+
+      size_t len = std::min(a.length(), b.length());
+      auto diff = std::mismatch(a.begin(), a.begin() + len, b.begin());
+      if (diff.first != a.begin() + len) {
+        return key(*diff.first) < key(*diff.second);
+      }
+      return a.length() < b.length();
+    };
+
+    std::sort(paths.begin(), paths.end(), less);
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+    // depth first nodes, the stack has the nodes of the last path and the
+    // end of their components in it
+    std::vector<Node> dfs{Node{0, 0, kNoNode, 0, 0, false}};
+    dfs.reserve(paths.size() + 1);
+    std::vector<std::pair<size_t, size_t>> stack;
+    String<charT> last;
+    for (auto& path : paths) {
+      if (path.empty()) {
+        continue;
+      }
+
+      // the components shared with the last path are already nodes
+      size_t depth = 0;
+      while (depth < stack.size() && stack[depth].second <= path.length() &&
+          path.compare(0, stack[depth].second, last, 0,
+          stack[depth].second) == 0 &&
+          (stack[depth].second == path.length() ||
+          path[stack[depth].second] == charT('/'))) {
+        depth++;
+      }
+      stack.resize(depth);
+
+      size_t pos = depth == 0 ? 0 : stack.back().second + 1;
+      while (pos < path.length()) {
+        size_t end = path.find(charT('/'), pos);
+        if (end == String<charT>::npos) {
+          end = path.length();
+        }
+
+        size_t parent = stack.empty() ? 0 : stack.back().first;
+        dfs.push_back(Node{Check32(names_.length()), Check32(end - pos),
+            Check32(parent), 0, 0, false});
+        names_.append(path, pos, end - pos);
+        stack.push_back(std::make_pair(dfs.size() - 1, end));
+        pos = end + 1;
+      }
+
+      dfs[stack.back().first].listed = true;
+      last = std::move(path);
+    }
+
+    // counting sort by parent keeps the order of the siblings
+    std::vector<size_t> group(dfs.size() + 1, 0);
+    for (size_t i = 1; i < dfs.size(); i++) {
+      group[dfs[i].parent + 1]++;
+    }
+    for (size_t i = 1; i < group.size(); i++) {
+      group[i] += group[i - 1];
+    }
+
+    std::vector<uint32_t> id(dfs.size());
+    std::vector<size_t> next(group.begin(), group.end() - 1);
+    id[0] = 0;
+    for (size_t i = 1; i < dfs.size(); i++) {
+      id[i] = Check32(1 + next[dfs[i].parent]++);
+    }
+
+    nodes_.resize(dfs.size());
+    for (size_t i = 0; i < dfs.size(); i++) {
+      Node node = dfs[i];
+      node.parent = i == 0 ? kNoNode : id[node.parent];
+      node.first_child = Check32(1 + group[i]);
+      node.num_children = Check32(group[i + 1] - group[i]);
+      nodes_[id[i]] = node;
+    }
+  }
+
+  static uint32_t Check32(size_t n) {
+    if (n >= kNoNode) {
+      throw Error("path index too big");
+    }
+    return static_cast<uint32_t>(n);
+  }
+
+  const charT* NameData(size_t node) const {
+    return names_.data() + nodes_[node].name;
+  }
+
+  int CompareName(size_t node, const charT* str, size_t len) const {
+    using Traits = std::char_traits<charT>;
+    size_t size = nodes_[node].size;
+    int r = Traits::compare(NameData(node), str, std::min<size_t>(size, len));
+    if (r != 0) {
+      return r;
+    }
+    return size < len ? -1 : (size > len ? 1 : 0);
+  }
+
+  bool StartsWith(size_t node, const String<charT>& prefix) const {
+    using Traits = std::char_traits<charT>;
+    return nodes_[node].size >= prefix.length() &&
+        Traits::compare(NameData(node), prefix.data(), prefix.length()) == 0;
+  }
+
+  // the first child not less than str
+  size_t LowerBound(size_t node, const charT* str, size_t len) const {
+    size_t first = nodes_[node].first_child;
+    size_t count = nodes_[node].num_children;
+    while (count > 0) {
+      size_t step = count / 2;
+      if (CompareName(first + step, str, len) < 0) {
+        first += step + 1;
+        count -= step + 1;
+      } else {
+        count = step;
+      }
+    }
+    return first;
+  }
+
+  size_t FindChild(size_t node, const charT* str, size_t len) const {
+    size_t child = LowerBound(node, str, len);
+    if (child < nodes_[node].first_child + nodes_[node].num_children &&
+        CompareName(child, str, len) == 0) {
+      return child;
+    }
+    return npos;
+  }
+
+  // calls f(pos, len) for each component of the path that is not empty
+  // or "."
+  template<class F>
+  static void ForEachComponent(const String<charT>& path, F f) {
+    size_t pos = 0;
+    while (pos <= path.length()) {
+      size_t end = path.find(charT('/'), pos);
+      if (end == String<charT>::npos) {
+        end = path.length();
+      }
+
+      size_t len = end - pos;
+      if (len > 0 && !(len == 1 && path[pos] == charT('.'))) {
+        f(pos, len);
+      }
+      pos = end + 1;
+    }
+  }
+
+  static String<charT> Normalize(const charT* data, size_t size) {
+    String<charT> path(data, size);
+    if (IsNormal(path)) {
+      return path;
+    }
+
+    String<charT> normalized;
+    ForEachComponent(path, [&](size_t pos, size_t len) {
+      if (!normalized.empty()) {
+        normalized += charT('/');
+      }
+      normalized.append(path, pos, len);
+    });
+    return normalized;
+  }
+
+  // no empty or "." component, like most paths of a manifest
+  static bool IsNormal(const String<charT>& path) {
+    size_t pos = 0;
+    while (pos <= path.length()) {
+      size_t end = path.find(charT('/'), pos);
+      if (end == String<charT>::npos) {
+        end = path.length();
+      }
+
+      if (end == pos || (end == pos + 1 && path[pos] == charT('.'))) {
+        return path.empty();
+      }
+      pos = end + 1;
+    }
+    return true;
+  }
+
+  static bool IsDirs(const String<charT>& segment) {
+    return segment.length() >= 2 &&
+        segment.find_first_not_of(charT('*')) == String<charT>::npos;
+  }
+
+  // a segment without the chars of wildcards and groups is found by name
+  static bool IsLiteral(const String<charT>& segment) {
+    for (charT c : segment) {
+      switch (c) {
+        case '*':
+        case '?':
+        case '[':
+        case ']':
+        case '(':
+        case ')':
+        case '|':
+        case '!':
+        case '+':
+        case '@':
+        case '\\':
+          return false;
+
+        default:
+          break;
+      }
+    }
+    return true;
+  }
+
+  std::vector<Node> nodes_;
+  String<charT> names_;
+};
+
+using path_index = PathIndex<char>;
+using wpath_index = PathIndex<wchar_t>;
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_PATH_INDEX_H
@@ -0,0 +1,365 @@
+#ifndef GLOB_CPP_STATIC_GLOB_H
+#define GLOB_CPP_STATIC_GLOB_H
+
+#include "glob.h"
+
+// static globs need string literals as template parameters
+#if __cplusplus >= 202002L
+
+#include <array>
+#include <string_view>
+
+namespace glob {
+
+// FixedString holds a string literal used as template parameter
+template<class charT, size_t N>
+struct FixedString {
+  using char_type = charT;
+
+  constexpr FixedString(const charT (&str)[N]) {
+    for (size_t i = 0; i < N; i++) {
+      value[i] = str[i];
+    }
+  }
+
+  constexpr size_t size() const {
+    return N - 1;
+  }
+
+  constexpr charT operator[](size_t i) const {
+    return value[i];
+  }
+
+  charT value[N]{};
+};
+
+// static globs report syntax errors when the pattern is parsed at compile
+// time, as this function is not constexpr, calling it is a compile error
+inline void StaticGlobError(const char* msg) {
+  throw Error(msg);
+}
+
+template<class charT>
+struct StaticItem {
+  enum class Kind {
+    CHAR,
+    ANY,
+    STAR,
+    SET,
+    NEG_SET
+  };
+
+  Kind kind = Kind::CHAR;
+  charT c = 0;
+
+  // the ranges of a set are [ranges_begin, ranges_end) in the ranges array
+  size_t ranges_begin = 0;
+  size_t ranges_end = 0;
+};
+
+// StaticProgram is the compiled form of the pattern, it follows the grammar
+// of grammar.ebnf without groups, the lexer rules are the same of Lexer: '\'
+// escapes special chars, "[!" starts a negative set, and special chars in
+// sets must be escaped
+template<class charT, size_t kNumItems, size_t kNumRanges>
+struct StaticProgram {
+  std::array<StaticItem<charT>, kNumItems> items{};
+  std::array<std::pair<charT, charT>, kNumRanges> ranges{};
+};
+
+// '+', '!' and '@' are chars when they don't start a group, as in Lexer
+template<class charT>
+constexpr bool IsStaticSpecialChar(charT c) {
+  return c == '?' || c == '*' || c == '(' || c == ')' || c == '[' ||
+      c == ']' || c == '|' || c == '\\';
+}
+
+// parses the pattern, when items and ranges are nullptr it only counts them,
+// so the same function gives the size of the arrays and fills them
+template<class charT, size_t N>
+constexpr void ParseStaticGlob(const FixedString<charT, N>& pattern,
+    size_t& num_items, size_t& num_ranges, StaticItem<charT>* items,
+    std::pair<charT, charT>* ranges) {
+  using Kind = typename StaticItem<charT>::Kind;
+  num_items = 0;
+  num_ranges = 0;
+  size_t pos = 0;
+  size_t len = pattern.size();
+  bool last_star = false;
+
+  // reads one char, escaped or not, the special chars are accepted only
+  // escaped
+  auto read_char = [&]() -> charT {
+    charT c = pattern[pos];
+    if (c == '\\') {
+      if (++pos == len) {
+        StaticGlobError("No valid char after '\\'");
+      }
+      c = pattern[pos];
+    } else if (IsStaticSpecialChar(c)) {
+      StaticGlobError("char expected");
+    }
+    pos++;
+    return c;
+  };
+
+  auto add_item = [&](Kind kind, charT c) {
+    last_star = kind == Kind::STAR;
+    if (items) {
+      items[num_items].kind = kind;
+      items[num_items].c = c;
+      items[num_items].ranges_begin = num_ranges;
+      items[num_items].ranges_end = num_ranges;
+    }
+    num_items++;
+  };
+
+  while (pos < len) {
+    charT c = pattern[pos];
+    if ((c == '?' || c == '*' || c == '+' || c == '!' || c == '@') &&
+        pos + 1 < len && pattern[pos + 1] == '(') {
+      StaticGlobError("static_glob doesn't support extended globs");
+    }
+
+    switch (c) {
+      case '?':
+        add_item(Kind::ANY, 0);
+        pos++;
+        break;
+
+      case '*':
+        // a run of stars is the same as one star
+        if (!last_star) {
+          add_item(Kind::STAR, 0);
+        }
+        pos++;
+        break;
+
+      case '[': {
+        bool neg = ++pos < len && pattern[pos] == '!';
+        pos += neg;
+        add_item(neg ? Kind::NEG_SET : Kind::SET, 0);
+
+        do {
+          // '-' is only the separator of ranges
+          if (pos >= len || pattern[pos] == '-') {
+            StaticGlobError("char expected");
+          }
+
+          charT start = read_char();
+          charT end = start;
+          if (pos < len && pattern[pos] == '-') {
+            if (++pos >= len) {
+              StaticGlobError("char expected");
+            }
+            end = read_char();
+          }
+
+          // ranges like "z-a" are the same of "a-z", as in SetRanges
+          if (ranges) {
+            ranges[num_ranges] = start < end ?
+                std::pair<charT, charT>(start, end) :
+                std::pair<charT, charT>(end, start);
+            items[num_items - 1].ranges_end = num_ranges + 1;
+          }
+          num_ranges++;
+        } while (pos >= len || pattern[pos] != ']');
+
+        pos++;
+        break;
+      }
+
+      case '(':
+      case ')':
+      case '|':
+      case ']':
+        StaticGlobError("static_glob doesn't support groups");
+        break;
+
+      // these are chars when they don't start a group
+      case '+':
+      case '!':
+      case '@':
+        add_item(Kind::CHAR, c);
+        pos++;
+        break;
+
+      default: {
+        charT ch = read_char();
+        add_item(Kind::CHAR, ch);
+        break;
+      }
+    }
+  }
+}
+
+template<class charT, size_t N>
+constexpr std::pair<size_t, size_t> StaticGlobSize(
+    const FixedString<charT, N>& pattern) {
+  size_t num_items = 0;
+  size_t num_ranges = 0;
+  ParseStaticGlob<charT, N>(pattern, num_items, num_ranges, nullptr, nullptr);
+  return std::pair<size_t, size_t>(num_items, num_ranges);
+}
+
+template<FixedString Pattern>
+constexpr auto CompileStaticGlob() {
+  using charT = typename decltype(Pattern)::char_type;
+  constexpr auto size = StaticGlobSize(Pattern);
+  StaticProgram<charT, size.first, size.second> program;
+  size_t num_items = 0;
+  size_t num_ranges = 0;
+  ParseStaticGlob(Pattern, num_items, num_ranges, program.items.data(),
+      program.ranges.data());
+  return program;
+}
+
+enum class StaticShape {
+  LITERAL,
+  STAR_SUFFIX,
+  PREFIX_STAR,
+  GENERIC
+};
+
+// patterns with only chars and one star at one of the ends have a match
+// without loop
+template<class Program>
+constexpr StaticShape FindStaticShape(const Program& program) {
+  using Kind = typename std::decay_t<decltype(program.items[0])>::Kind;
+  size_t num_items = program.items.size();
+  size_t num_chars = 0;
+  for (auto& item : program.items) {
+    num_chars += item.kind == Kind::CHAR;
+  }
+
+  if (num_chars == num_items) {
+    return StaticShape::LITERAL;
+  }
+
+  if (num_chars + 1 == num_items) {
+    if (program.items[0].kind == Kind::STAR) {
+      return StaticShape::STAR_SUFFIX;
+    }
+
+    if (program.items[num_items - 1].kind == Kind::STAR) {
+      return StaticShape::PREFIX_STAR;
+    }
+  }
+
+  return StaticShape::GENERIC;
+}
+
+// StaticGlob is a glob parsed at compile time, the program is a constant, so
+// the compiler can inline the whole match, patterns with one star and
+// literals, like "*.cc", don't even loop over the program
+template<FixedString Pattern>
+class StaticGlob {
+ public:
+  using char_type = typename decltype(Pattern)::char_type;
+  using StringView = std::basic_string_view<char_type>;
+
+  static constexpr bool Match(StringView str) {
+    if constexpr (kShape == StaticShape::LITERAL) {
+      return str == Literal(0, kNumItems);
+    } else if constexpr (kShape == StaticShape::STAR_SUFFIX) {
+      return str.size() >= kNumItems - 1 &&
+          str.substr(str.size() - (kNumItems - 1)) == Literal(1, kNumItems);
+    } else if constexpr (kShape == StaticShape::PREFIX_STAR) {
+      return str.substr(0, kNumItems - 1) == Literal(0, kNumItems - 1);
+    } else {
+      return MatchProgram(str);
+    }
+  }
+
+  static constexpr size_t NumItems() {
+    return kNumItems;
+  }
+
+ private:
+  using Item = StaticItem<char_type>;
+  using Kind = typename Item::Kind;
+
+  static constexpr auto kProgram = CompileStaticGlob<Pattern>();
+  static constexpr size_t kNumItems = kProgram.items.size();
+  static constexpr StaticShape kShape = FindStaticShape(kProgram);
+
+  // the chars of the items [first, last), only for items that are chars
+  static constexpr std::array<char_type, kNumItems> kChars = [] {
+    std::array<char_type, kNumItems> chars{};
+    for (size_t i = 0; i < kNumItems; i++) {
+      chars[i] = kProgram.items[i].c;
+    }
+    return chars;
+  }();
+
+  static constexpr StringView Literal(size_t first, size_t last) {
+    return StringView(kChars.data() + first, last - first);
+  }
+
+  static constexpr bool ItemMatch(const Item& item, char_type c) {
+    switch (item.kind) {
+      case Kind::CHAR:
+        return item.c == c;
+
+      case Kind::SET:
+      case Kind::NEG_SET: {
+        bool r = false;
+        for (size_t i = item.ranges_begin; i < item.ranges_end; i++) {
+          r = r || (c >= kProgram.ranges[i].first &&
+              c <= kProgram.ranges[i].second);
+        }
+        return item.kind == Kind::SET ? r : !r;
+      }
+
+      default:
+        return true;
+    }
+  }
+
+  // when the items after a star fail, the star takes one more char and the
+  // items after it run again, only the last star is retried
+  static constexpr bool MatchProgram(StringView str) {
+    size_t item = 0;
+    size_t pos = 0;
+    size_t star_item = kNumItems;
+    size_t star_pos = 0;
+
+    while (pos < str.size()) {
+      if (item < kNumItems && kProgram.items[item].kind == Kind::STAR) {
+        star_item = item++;
+        star_pos = pos;
+      } else if (item < kNumItems &&
+          ItemMatch(kProgram.items[item], str[pos])) {
+        item++;
+        pos++;
+      } else if (star_item != kNumItems) {
+        item = star_item + 1;
+        pos = ++star_pos;
+      } else {
+        return false;
+      }
+    }
+
+    while (item < kNumItems && kProgram.items[item].kind == Kind::STAR) {
+      item++;
+    }
+
+    return item == kNumItems;
+  }
+};
+
+template<FixedString Pattern>
+using static_glob = StaticGlob<Pattern>;
+
+template<FixedString Pattern>
+constexpr bool glob_match(
+    std::basic_string_view<typename decltype(Pattern)::char_type> str,
+    const StaticGlob<Pattern>&) {
+  return StaticGlob<Pattern>::Match(str);
+}
+
+}  // namespace glob
+
+#endif  // __cplusplus >= 202002L
+
+#endif  // GLOB_CPP_STATIC_GLOB_H
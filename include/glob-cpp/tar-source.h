@@ -0,0 +1,466 @@
+#ifndef GLOB_CPP_TAR_SOURCE_H
+#define GLOB_CPP_TAR_SOURCE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <string>
+#include <vector>
+#include "glob.h"
+#include "dir-source.h"
+
+#ifdef GLOB_CPP_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+namespace glob {
+
+// TarInput reads the bytes of a tar archive from a stream, gzip archives
+// are inflated on the fly when glob-cpp is built with zlib, the offsets are
+// the ones of the tar stream, after the inflate
+class TarInput {
+ public:
+  explicit TarInput(std::istream& in): in_{in} {
+    head_.resize(4);
+    in_.read(&head_[0], 4);
+    head_.resize(static_cast<size_t>(in_.gcount()));
+
+    if (head_.compare(0, 2, "\x1f\x8b") == 0) {
+#ifdef GLOB_CPP_WITH_ZLIB
+      gzip_ = true;
+      std::memset(&zs_, 0, sizeof(zs_));
+      if (inflateInit2(&zs_, 15 + 16) != Z_OK) {
+        throw Error("can't inflate tar archive");
+      }
+#else
+      throw Error("gzip tar archives need GLOB_CPP_WITH_ZLIB");
+#endif
+    } else if (head_.compare(0, 4, "\x28\xb5\x2f\xfd") == 0) {
+      throw Error("zstd tar archives are not supported");
+    }
+  }
+
+  ~TarInput() {
+#ifdef GLOB_CPP_WITH_ZLIB
+    if (gzip_) {
+      inflateEnd(&zs_);
+    }
+#endif
+  }
+
+  TarInput(const TarInput&) = delete;
+  TarInput& operator=(const TarInput&) = delete;
+
+  // reads up to n bytes, less only at the end of the archive
+  size_t Read(char* buf, size_t n) {
+    size_t len = 0;
+    while (len < n) {
+      size_t r = gzip_ ? Inflate(buf + len, n - len) :
+          ReadRaw(buf + len, n - len);
+      if (r == 0) {
+        break;
+      }
+      len += r;
+    }
+
+    offset_ += len;
+    return len;
+  }
+
+  // the data of the members that are not read is skipped with a seek when
+  // the stream can seek, a seek past the end doesn't fail, so the end of
+  // the stream is found once, gzip archives are inflated anyway
+  void Skip(uint64_t n) {
+    // the first bytes were read to find the format, the seek starts after
+    // them
+    if (!gzip_ && !head_.empty() && n > 0) {
+      size_t len = static_cast<size_t>(
+          std::min<uint64_t>(n, head_.length()));
+      head_.erase(0, len);
+      offset_ += len;
+      n -= len;
+    }
+
+    if (!gzip_ && n > 0) {
+      std::streampos pos = in_.tellg();
+      if (pos != std::streampos(-1) && FindEnd(pos)) {
+        if (n > static_cast<uint64_t>(end_ - std::streamoff(pos))) {
+          throw Error("truncated tar archive");
+        }
+
+        if (in_.seekg(static_cast<std::streamoff>(n), std::ios::cur)) {
+          offset_ += n;
+          return;
+        }
+      }
+      in_.clear();
+    }
+
+    char buf[4096];
+    while (n > 0) {
+      size_t r = Read(buf, static_cast<size_t>(
+          std::min<uint64_t>(n, sizeof(buf))));
+      if (r == 0) {
+        throw Error("truncated tar archive");
+      }
+      n -= r;
+    }
+  }
+
+  uint64_t Offset() const {
+    return offset_;
+  }
+
+ private:
+  // end_ is -1 when the stream can't seek to its end
+  bool FindEnd(std::streampos pos) {
+    if (!end_found_) {
+      end_found_ = true;
+      if (in_.seekg(0, std::ios::end)) {
+        end_ = std::streamoff(in_.tellg());
+      }
+      in_.clear();
+      if (!in_.seekg(pos)) {
+        throw Error("can't seek in tar archive");
+      }
+    }
+    return end_ >= std::streamoff(pos);
+  }
+
+  // the first bytes read to find the format come before the stream
+  size_t ReadRaw(char* buf, size_t n) {
+    if (!head_.empty()) {
+      size_t len = std::min(n, head_.length());
+      std::memcpy(buf, head_.data(), len);
+      head_.erase(0, len);
+      return len;
+    }
+
+    in_.read(buf, static_cast<std::streamsize>(n));
+    return static_cast<size_t>(in_.gcount());
+  }
+
+#ifdef GLOB_CPP_WITH_ZLIB
+  // the members of a gzip file that has many of them are inflated one
+  // after the other, as gzip does
+  size_t Inflate(char* buf, size_t n) {
+    uInt len = static_cast<uInt>(std::min<size_t>(n, 1 << 30));
+    zs_.next_out = reinterpret_cast<Bytef*>(buf);
+    zs_.avail_out = len;
+    while (zs_.avail_out == len) {
+      if (zs_.avail_in == 0) {
+        in_buf_.resize(64 * 1024);
+        size_t r = ReadRaw(&in_buf_[0], in_buf_.size());
+        if (r == 0) {
+          break;
+        }
+        zs_.next_in = reinterpret_cast<Bytef*>(&in_buf_[0]);
+        zs_.avail_in = static_cast<uInt>(r);
+      }
+
+      int ret = inflate(&zs_, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END) {
+        inflateReset(&zs_);
+      } else if (ret != Z_OK) {
+        throw Error("invalid gzip data in tar archive");
+      }
+    }
+
+    return len - zs_.avail_out;
+  }
+#else
+  size_t Inflate(char*, size_t) {
+    return 0;
+  }
+#endif
+
+  std::istream& in_;
+  std::string head_;
+  uint64_t offset_ = 0;
+  std::streamoff end_ = -1;
+  bool end_found_ = false;
+  bool gzip_ = false;
+#ifdef GLOB_CPP_WITH_ZLIB
+  z_stream zs_;
+  std::string in_buf_;
+#endif
+};
+
+// the fields of a tar header are padded with '\0'
+inline std::string TarString(const char* field, size_t len) {
+  return std::string(field, std::find(field, field + len, '\0'));
+}
+
+// numbers are octal, or base 256 when the first bit is set, for the sizes
+// that don't fit in 11 octal digits, a negative base 256 number or one that
+// doesn't fit in 64 bits is invalid
+inline uint64_t TarNumber(const char* field, size_t len) {
+  uint64_t n = 0;
+  if (static_cast<unsigned char>(field[0]) & 0x80) {
+    if (static_cast<unsigned char>(field[0]) & 0x40) {
+      throw Error("invalid tar header");
+    }
+
+    n = static_cast<unsigned char>(field[0]) & 0x7f;
+    for (size_t i = 1; i < len; i++) {
+      if (n >> 56 != 0) {
+        throw Error("invalid tar header");
+      }
+      n = (n << 8) | static_cast<unsigned char>(field[i]);
+    }
+    return n;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    if (field[i] >= '0' && field[i] <= '7') {
+      n = (n << 3) | static_cast<uint64_t>(field[i] - '0');
+    } else if (field[i] != ' ' || n != 0) {
+      break;
+    }
+  }
+  return n;
+}
+
+// the checksum is the sum of the bytes of the header, with the field of
+// the checksum as spaces, old archives sum signed chars
+inline bool TarChecksumValid(const char* block) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(block);
+  uint32_t sum = 8 * ' ';
+  for (size_t i = 0; i < 512; i++) {
+    sum += bytes[i];
+  }
+  for (size_t i = 148; i < 156; i++) {
+    sum -= bytes[i];
+  }
+
+  uint64_t checksum = TarNumber(block + 148, 8);
+  if (sum == checksum) {
+    return true;
+  }
+
+  int32_t signed_sum = 8 * ' ';
+  for (size_t i = 0; i < 512; i++) {
+    if (i < 148 || i >= 156) {
+      signed_sum += static_cast<signed char>(block[i]);
+    }
+  }
+  return static_cast<uint64_t>(signed_sum) == checksum;
+}
+
+// the records of a pax header are "<len> <key>=<value>\n", only the path
+// and the size of the next member are read
+inline void ReadPaxRecords(const std::string& data, std::string& path,
+    int64_t& size) {
+  size_t pos = 0;
+  while (pos < data.length()) {
+    size_t space = data.find(' ', pos);
+    if (space == std::string::npos) {
+      break;
+    }
+
+    // a record has its length, a space, at least one byte and a newline
+    size_t len = static_cast<size_t>(std::strtoull(data.c_str() + pos,
+        nullptr, 10));
+    if (len < space - pos + 2 || len > data.length() - pos ||
+        data[pos + len - 1] != '\n') {
+      throw Error("invalid pax header");
+    }
+
+    std::string record = data.substr(space + 1, pos + len - space - 2);
+    size_t eq = record.find('=');
+    if (eq != std::string::npos) {
+      std::string key = record.substr(0, eq);
+      if (key == "path") {
+        path = record.substr(eq + 1);
+      } else if (key == "size") {
+        uint64_t n = std::strtoull(record.c_str() + eq + 1, nullptr, 10);
+        if (n > static_cast<uint64_t>(INT64_MAX)) {
+          throw Error("invalid pax header");
+        }
+        size = static_cast<int64_t>(n);
+      }
+    }
+    pos += len;
+  }
+}
+
+// long names and pax records are read in memory, they are not bigger
+// than a path
+constexpr uint64_t kMaxTarMetadata = 1 << 20;
+
+// reads the headers of a tar archive in one pass, the data of the members
+// is skipped, the offset of each member is the offset of its data in the
+// tar stream, ustar, GNU long names and pax paths and sizes are read,
+// an invalid header throws Error
+inline std::vector<ArchiveMember> ReadTarMembers(std::istream& in) {
+  TarInput input(in);
+  std::vector<ArchiveMember> members;
+  std::string long_name;
+  std::string pax_path;
+  int64_t pax_size = -1;
+  char block[512];
+
+  while (true) {
+    size_t r = input.Read(block, sizeof(block));
+    if (r == 0) {
+      break;
+    } else if (r != sizeof(block)) {
+      throw Error("truncated tar archive");
+    }
+
+    // the archive ends with zero blocks, their checksum is not valid
+    if (!TarChecksumValid(block)) {
+      if (std::all_of(block, block + sizeof(block),
+          [](char c) { return c == 0; })) {
+        break;
+      }
+      throw Error("invalid tar header");
+    }
+
+    // a pax size is for the sizes that don't fit in the header, a size
+    // that can't be padded or seeked to is invalid
+    char type = block[156];
+    uint64_t size = TarNumber(block + 124, 12);
+    if (pax_size >= 0 && type != 'L' && type != 'x') {
+      size = static_cast<uint64_t>(pax_size);
+    }
+    if (size > static_cast<uint64_t>(INT64_MAX) - 511) {
+      throw Error("invalid tar header");
+    }
+    uint64_t offset = input.Offset();
+    uint64_t padded = (size + 511) / 512 * 512;
+
+    // the entries of metadata tell about the next member
+    if (type == 'L' || type == 'x') {
+      if (size > kMaxTarMetadata) {
+        throw Error("invalid tar header");
+      }
+
+      std::string data(static_cast<size_t>(size), '\0');
+      if (input.Read(&data[0], data.size()) != data.size()) {
+        throw Error("truncated tar archive");
+      }
+      input.Skip(padded - size);
+
+      if (type == 'L') {
+        long_name = data.substr(0, data.find('\0'));
+      } else {
+        ReadPaxRecords(data, pax_path, pax_size);
+      }
+      continue;
+    }
+
+    // the link names and global headers tell nothing of the path or the
+    // size, the other vendor entries, like volume labels, are not members,
+    // and the metadata read before them is not of the next member, a GNU
+    // sparse file is a member, its size is the one stored in the archive
+    input.Skip(padded);
+    if (type == 'K' || type == 'g') {
+      continue;
+    } else if (type >= 'A' && type <= 'Z' && type != 'S') {
+      long_name.clear();
+      pax_path.clear();
+      pax_size = -1;
+      continue;
+    }
+
+    std::string path;
+    if (!pax_path.empty()) {
+      path = std::move(pax_path);
+    } else if (!long_name.empty()) {
+      path = std::move(long_name);
+    } else {
+      // GNU headers have the magic "ustar  ", and the bytes of the prefix
+      // are their atime and ctime
+      path = TarString(block, 100);
+      std::string prefix = TarString(block + 345, 155);
+      if (std::memcmp(block + 257, "ustar\0", 6) == 0 && !prefix.empty()) {
+        path = prefix + "/" + path;
+      }
+    }
+
+    EntryType entry_type;
+    switch (type) {
+      case '\0':
+      case '0':
+      case '1':
+      case '7':
+      case 'S':
+        entry_type = EntryType::FILE;
+        break;
+
+      case '2':
+        entry_type = EntryType::SYMLINK;
+        break;
+
+      case '5':
+        entry_type = EntryType::DIR;
+        break;
+
+      default:
+        entry_type = EntryType::OTHER;
+        break;
+    }
+
+    int64_t mtime = static_cast<int64_t>(TarNumber(block + 136, 12)) *
+        1000000000;
+    members.push_back(ArchiveMember{std::move(path), entry_type, offset,
+        size, mtime});
+    long_name.clear();
+    pax_path.clear();
+    pax_size = -1;
+  }
+
+  return members;
+}
+
+inline std::vector<ArchiveMember> ReadTarMembers(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw Error("can't open file: " + path);
+  }
+
+  return ReadTarMembers(in);
+}
+
+// reads the data of a member, a plain archive seeks to it, a gzip archive
+// is inflated up to it
+inline std::string ReadTarMember(std::istream& in,
+    const ArchiveMember& member) {
+  TarInput input(in);
+  input.Skip(member.offset);
+  std::string data(static_cast<size_t>(member.size), '\0');
+  if (input.Read(&data[0], data.size()) != data.size()) {
+    throw Error("truncated tar archive");
+  }
+
+  return data;
+}
+
+inline std::string ReadTarMember(const std::string& path,
+    const ArchiveMember& member) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw Error("can't open file: " + path);
+  }
+
+  return ReadTarMember(in, member);
+}
+
+// TarDirSource globs the members of a tar archive without extracting it,
+// the archive is read once when the source is built
+class TarDirSource: public ArchiveDirSource {
+ public:
+  explicit TarDirSource(const std::string& path)
+      : ArchiveDirSource(ReadTarMembers(path)) {}
+
+  explicit TarDirSource(std::istream& in)
+      : ArchiveDirSource(ReadTarMembers(in)) {}
+};
+
+}  // namespace glob
+
+#endif  // GLOB_CPP_TAR_SOURCE_H
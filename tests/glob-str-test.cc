@@ -1,8 +1,23 @@
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory_resource>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <gtest/gtest.h>
 #include "glob-cpp/glob.h"
+#include "glob-cpp/glob-batch.h"
+#include "glob-cpp/glob-cache.h"
+#include "glob-cpp/glob-grep.h"
+#include "glob-cpp/glob-parallel.h"
+#include "glob-cpp/glob-stream.h"
+#include "glob-cpp/glob-serialize.h"
 #include "glob-cpp/file-glob.h"
+#include "glob-cpp/dir-cache.h"
+#include "glob-cpp/glob-watcher.h"
+#include "glob-cpp/path-index.h"
+#include "glob-cpp/tar-source.h"
 #include "traversal.h"
 
 bool GlobMatch(const std::string& pattern, const std::string& str) {
@@ -284,3 +299,1410 @@ TEST(GlobString, group_union) {
   ASSERT_FALSE(glob_match("FILE.jpg", g));
   ASSERT_FALSE(glob_match("FF.sdf", g));
 }
+
+TEST(GlobString, star_backtrack) {
+  glob::glob g("*.gz");
+  ASSERT_TRUE(glob_match("file.tar.gz", g));
+  ASSERT_TRUE(glob_match("a.gz.gz", g));
+  ASSERT_FALSE(glob_match("file.gz.tar", g));
+
+  glob::glob g2("*ab*cd");
+  ASSERT_TRUE(glob_match("aabxcd", g2));
+  ASSERT_TRUE(glob_match("abcdcd", g2));
+  ASSERT_FALSE(glob_match("aabxcdx", g2));
+}
+
+TEST(GlobString, star_empty) {
+  glob::glob g("*");
+  ASSERT_TRUE(glob_match("", g));
+  ASSERT_TRUE(glob_match("abc", g));
+
+  glob::glob g2("file*");
+  ASSERT_TRUE(glob_match("file", g2));
+  ASSERT_TRUE(glob_match("file.txt", g2));
+  ASSERT_FALSE(glob_match("fil", g2));
+}
+
+TEST(GlobString, match_results) {
+  glob::glob g("*.pdf");
+  glob::cmatch m;
+  ASSERT_TRUE(glob_match("test.pdf", m, g));
+  ASSERT_EQ(m.size(), 1u);
+  ASSERT_EQ(*m.begin(), "test");
+
+  // the results of one match must not leak into the next one
+  ASSERT_TRUE(glob_match("a.b.pdf", m, g));
+  ASSERT_EQ(m.size(), 1u);
+  ASSERT_EQ(*m.begin(), "a.b");
+}
+
+TEST(GlobString, match_budget) {
+  glob::glob g("*.p?f");
+  glob::cmatch m;
+  auto budget = glob::MatchBudget{}.SetMaxSteps(64);
+  ASSERT_EQ(glob_match("test.pdf", m, g, budget), glob::MatchStatus::MATCH);
+  ASSERT_EQ(*m.begin(), "test");
+  ASSERT_EQ(glob_match(std::string(100, 'a') + ".pdf", g, budget),
+      glob::MatchStatus::BUDGET_EXCEEDED);
+}
+
+// a memory resource that counts the bytes it gives
+class CountingResource: public std::pmr::memory_resource {
+ public:
+  size_t bytes = 0;
+
+ private:
+  void* do_allocate(size_t size, size_t align) override {
+    bytes += size;
+    return std::pmr::new_delete_resource()->allocate(size, align);
+  }
+
+  void do_deallocate(void* p, size_t size, size_t align) override {
+    std::pmr::new_delete_resource()->deallocate(p, size, align);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const
+      noexcept override {
+    return this == &other;
+  }
+};
+
+TEST(GlobString, pmr_results) {
+  CountingResource resource;
+  glob::glob g("*-+([0-9]).pdf");
+  glob::pmr::cmatch m(&resource);
+  std::string name = "a name longer than the small string buffer";
+  ASSERT_TRUE(glob_match(name + "-42.pdf", m, g));
+  ASSERT_EQ(m.size(), 2u);
+  ASSERT_EQ(m[0].c_str(), name);
+  ASSERT_STREQ(m[1].c_str(), "42");
+
+  // the vector and the long string are in the resource
+  ASSERT_GE(resource.bytes, name.size() + 2 * sizeof(m[0]));
+
+  // the copies made by pmr containers stay in the resource of the container
+  std::pmr::vector<glob::pmr::cmatch> vec(&resource);
+  vec.push_back(m);
+  ASSERT_EQ(vec[0].get_allocator().resource(), &resource);
+  ASSERT_EQ(vec[0][0].c_str(), name);
+}
+
+TEST(FileGlob, pmr_results) {
+  CountingResource resource;
+  glob::pmr::file_glob fglob("*", &resource);
+  auto results = fglob.Exec();
+  auto expected = glob::file_glob{"*"}.Exec();
+  ASSERT_EQ(results.size(), expected.size());
+  ASSERT_GT(resource.bytes, 0u);
+
+  for (size_t i = 0; i < results.size(); i++) {
+    ASSERT_EQ(results[i].path(), expected[i].path());
+    ASSERT_EQ(results[i].get_allocator().resource(), &resource);
+  }
+}
+
+TEST(FileGlob, cancellation) {
+  glob::CancellationToken token;
+  glob::file_glob fglob{"*"};
+  fglob.SetCancellationToken(token);
+  ASSERT_FALSE(fglob.Exec().empty());
+  ASSERT_FALSE(fglob.Interrupted());
+
+  token.Cancel();
+  ASSERT_TRUE(fglob.Exec().empty());
+  ASSERT_TRUE(fglob.Interrupted());
+
+  glob::file_glob fglob2{"**/*"};
+  fglob2.SetDeadline(glob::file_glob::Clock::now());
+  ASSERT_TRUE(fglob2.Exec().empty());
+  ASSERT_TRUE(fglob2.Interrupted());
+}
+
+TEST(FileGlob, two_stars) {
+  namespace fs = boost::filesystem;
+  fs::path root = fs::temp_directory_path() / fs::unique_path();
+  for (auto dir : {"a/b", "a/x/b", "b", "c/d"}) {
+    fs::create_directories(root / dir);
+  }
+  for (auto file : {"a/b/1.c", "a/x/b/2.c", "a/x/b/3.h", "b/4.c", "c/d/5.c",
+      "6.c"}) {
+    std::ofstream{(root / file).string()};
+  }
+
+  fs::path old_path = fs::current_path();
+  fs::current_path(root);
+  std::vector<std::string> paths;
+  for (auto& res : glob::file_glob{"**/b/*.c"}.Exec()) {
+    paths.push_back(res.path().string());
+  }
+  auto all = glob::file_glob{"**"}.Exec();
+  fs::current_path(old_path);
+  fs::remove_all(root);
+
+  std::sort(paths.begin(), paths.end());
+  ASSERT_EQ(paths, std::vector<std::string>({"./a/b/1.c", "./a/x/b/2.c",
+      "./b/4.c"}));
+  ASSERT_EQ(all.size(), 13u);
+}
+
+// the paths of the results sorted, the order of the entries depends on the
+// source
+std::vector<std::string> SortedPaths(const glob::file_glob::Results& results) {
+  std::vector<std::string> paths;
+  for (auto& res : results) {
+    paths.push_back(res.path().string());
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+TEST(FileGlob, dir_sources) {
+  namespace fs = boost::filesystem;
+  fs::path root = fs::temp_directory_path() / fs::unique_path();
+  glob::MemoryDirSource memory;
+  memory.SetWorkDir("/work");
+  for (auto dir : {"a/b", "a/x/b", "a/.h", "b", "c/d"}) {
+    fs::create_directories(root / dir);
+    memory.AddDir(dir);
+  }
+  for (auto file : {"a/b/1.c", "a/x/b/2.c", "a/x/b/3.h", "a/.h/4.c", "b/5.c",
+      ".6.c", "7.c"}) {
+    std::ofstream{(root / file).string()};
+    memory.AddFile(file);
+  }
+
+  // the same tree gives the same paths from the disk and from memory
+  fs::path old_path = fs::current_path();
+  fs::current_path(root);
+  for (auto pattern : {"*.c", ".*", "**/b/*.c", "a/*/b/*", "a/*/*.c",
+      "a/.*/*", "b/../*.c", "**"}) {
+    glob::file_glob disk_glob{pattern};
+    glob::file_glob memory_glob{pattern};
+    memory_glob.SetDirSource(memory);
+    ASSERT_EQ(SortedPaths(memory_glob.Exec()), SortedPaths(disk_glob.Exec()))
+        << pattern;
+  }
+  fs::current_path(old_path);
+  fs::remove_all(root);
+
+  glob::EntryStat stat;
+  ASSERT_TRUE(memory.Stat("a/b", stat));
+  ASSERT_EQ(stat.type, glob::EntryType::DIR);
+  int64_t mtime = stat.mtime;
+  memory.AddFile("a/b/8.c", 10);
+  ASSERT_TRUE(memory.Stat("/work/a/b", stat));
+  ASSERT_GT(stat.mtime, mtime);
+  ASSERT_TRUE(memory.Stat("a/b/8.c", stat));
+  ASSERT_EQ(stat.size, 10u);
+  ASSERT_TRUE(memory.Remove("a/b"));
+  ASSERT_FALSE(memory.Stat("a/b/8.c", stat));
+  std::string real;
+  ASSERT_TRUE(memory.RealPath("./c/../a", real));
+  ASSERT_EQ(real, "/work/a");
+  ASSERT_THROW(memory.AddFile("7.c/x"), glob::Error);
+
+  // the members of an archive, the directories are in the paths of the
+  // members, the last copy of a member wins
+  glob::ArchiveDirSource archive({
+      {"lib/libx.so", glob::EntryType::FILE, 512, 100, 0},
+      {"./lib/sub/liby.so", glob::EntryType::FILE, 1024, 200, 0},
+      {"share/doc.txt", glob::EntryType::FILE, 2048, 300, 0},
+      {"lib/libx.so", glob::EntryType::FILE, 4096, 400, 0}});
+  glob::file_glob archive_glob{"**/*.so"};
+  archive_glob.SetDirSource(archive);
+  ASSERT_EQ(SortedPaths(archive_glob.Exec()),
+      std::vector<std::string>({"./lib/libx.so", "./lib/sub/liby.so"}));
+  ASSERT_EQ(archive.Member("lib/libx.so")->offset, 4096u);
+  ASSERT_EQ(archive.Member("/lib/sub/../sub/liby.so")->size, 200u);
+  ASSERT_EQ(archive.Member("lib"), nullptr);
+  ASSERT_TRUE(archive.Stat("lib/sub", stat));
+  ASSERT_EQ(stat.type, glob::EntryType::DIR);
+  std::vector<glob::DirEntry> entries;
+  ASSERT_FALSE(archive.List("share/doc.txt", entries));
+  ASSERT_TRUE(archive.List(".", entries));
+  ASSERT_EQ(entries.size(), 2u);
+}
+
+TEST(DirCache, mtime) {
+  glob::MemoryDirSource memory;
+  for (auto file : {"a/1.c", "a/2.h", "b/3.c"}) {
+    memory.AddFile(file);
+  }
+
+  // the walk reads 3 directories, the second walk reads none
+  glob::CachedDirSource cache(memory,
+      glob::CachedDirSource::Invalidation::MTIME, 3);
+  ASSERT_EQ(cache.GetInvalidation(),
+      glob::CachedDirSource::Invalidation::MTIME);
+  glob::file_glob fglob{"*/*.c"};
+  fglob.SetDirSource(cache);
+  auto expected = SortedPaths(fglob.Exec());
+  ASSERT_EQ(expected, std::vector<std::string>({"./a/1.c", "./b/3.c"}));
+  ASSERT_EQ(SortedPaths(fglob.Exec()), expected);
+  auto stats = cache.GetStats();
+  ASSERT_EQ(stats.misses, 3u);
+  ASSERT_EQ(stats.hits, 3u);
+  ASSERT_EQ(stats.size, 3u);
+
+  std::vector<glob::DirEntry> entries;
+  ASSERT_TRUE(cache.List("/", entries));
+  ASSERT_EQ(cache.GetStats().evictions, 1u);
+
+  // a change in a directory changes its mtime
+  entries.clear();
+  ASSERT_TRUE(cache.List("a", entries));
+  ASSERT_TRUE(cache.List("a", entries));
+  memory.AddFile("a/4.c");
+  entries.clear();
+  ASSERT_TRUE(cache.List("a", entries));
+  ASSERT_EQ(entries.size(), 3u);
+  ASSERT_EQ(cache.GetStats().invalidations, 1u);
+  ASSERT_FALSE(cache.List("a/1.c", entries));
+  ASSERT_FALSE(cache.List("x", entries));
+}
+
+#ifdef __linux__
+TEST(DirCache, inotify) {
+  namespace fs = boost::filesystem;
+  fs::path root = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directories(root / "a");
+  std::ofstream{(root / "a/1.c").string()};
+
+  glob::CachedDirSource cache;
+  ASSERT_EQ(cache.GetInvalidation(),
+      glob::CachedDirSource::Invalidation::INOTIFY);
+  std::string dir = (root / "a").string();
+  std::vector<glob::DirEntry> entries;
+  ASSERT_TRUE(cache.List(dir, entries));
+  ASSERT_TRUE(cache.List(dir, entries));
+  ASSERT_EQ(entries.size(), 2u);
+  ASSERT_EQ(cache.GetStats().hits, 1u);
+
+  glob::EntryStat stat;
+  ASSERT_TRUE(cache.Stat(dir + "/1.c", stat));
+  ASSERT_TRUE(cache.Stat(dir + "/1.c", stat));
+  ASSERT_EQ(stat.size, 0u);
+  ASSERT_EQ(cache.GetStats().hits, 2u);
+
+  // the events of the directory drop its listing and the stats
+  std::ofstream{(root / "a/1.c").string()} << "data";
+  ASSERT_TRUE(cache.Stat(dir + "/1.c", stat));
+  ASSERT_EQ(stat.size, 4u);
+  std::ofstream{(root / "a/2.c").string()};
+  entries.clear();
+  ASSERT_TRUE(cache.List(dir, entries));
+  ASSERT_EQ(entries.size(), 2u);
+  ASSERT_GE(cache.GetStats().invalidations, 1u);
+
+  // the listing taken again keeps the watch of the directory
+  uint64_t misses = cache.GetStats().misses;
+  uint64_t invalidations = cache.GetStats().invalidations;
+  entries.clear();
+  ASSERT_TRUE(cache.List(dir, entries));
+  ASSERT_TRUE(cache.List(dir, entries));
+  ASSERT_EQ(cache.GetStats().misses, misses);
+  ASSERT_EQ(cache.GetStats().invalidations, invalidations);
+
+  // a change inside a subdirectory is not an event of the parent, so the
+  // stat of the subdirectory is not kept
+  fs::create_directories(root / "a/sub");
+  entries.clear();
+  ASSERT_TRUE(cache.List(dir, entries));
+  ASSERT_TRUE(cache.Stat(dir + "/sub", stat));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  std::ofstream{(root / "a/sub/new").string()};
+  glob::EntryStat real_stat;
+  ASSERT_TRUE(glob::DefaultDirSource().Stat(dir + "/sub", real_stat));
+  ASSERT_TRUE(cache.Stat(dir + "/sub", stat));
+  ASSERT_EQ(stat.mtime, real_stat.mtime);
+
+  fs::remove_all(root / "a");
+  entries.clear();
+  ASSERT_FALSE(cache.List(dir, entries));
+  ASSERT_EQ(cache.GetStats().size, 0u);
+  fs::remove_all(root);
+}
+
+// polls until the watcher gives the number of events, the events of the
+// kernel can come in many reads
+std::vector<std::string> WatchEvents(glob::GlobWatcher& watcher,
+    size_t num_events) {
+  std::vector<std::string> events;
+  for (int i = 0; i < 20 && events.size() < num_events; i++) {
+    watcher.Poll(100, [&events](const glob::WatchEvent& event) {
+      const char* types[] = {"+", "-", "~"};
+      events.push_back(types[static_cast<int>(event.type)] + event.path);
+    });
+  }
+  std::sort(events.begin(), events.end());
+  return events;
+}
+
+TEST(GlobWatcher, events) {
+  namespace fs = boost::filesystem;
+  fs::path root = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directories(root / "src/lib");
+  fs::create_directories(root / "docs");
+  std::ofstream{(root / "src/a.cc").string()};
+  std::ofstream{(root / "src/lib/b.cc").string()};
+  std::ofstream{(root / "src/lib/c.h").string()};
+  std::ofstream{(root / "docs/d.cc").string()};
+
+  // build doesn't exist, its parent is watched, docs can't match
+  std::string r = root.string();
+  glob::GlobWatcher watcher({r + "/src/**/*.cc", r + "/build/out/*.so"});
+  ASSERT_EQ(watcher.Matches(), (std::vector<std::string>{r + "/src/a.cc",
+      r + "/src/lib/b.cc"}));
+  ASSERT_EQ(watcher.NumWatches(), 3u);
+  ASSERT_EQ(watcher.Poll(0).size(), 0u);
+
+  std::ofstream{(root / "src/lib/e.cc").string()};
+  std::ofstream{(root / "src/lib/f.h").string()};
+  ASSERT_EQ(WatchEvents(watcher, 1),
+      (std::vector<std::string>{"+" + r + "/src/lib/e.cc"}));
+
+  fs::create_directories(root / "build/out");
+  std::ofstream{(root / "build/out/x.so").string()};
+  ASSERT_EQ(WatchEvents(watcher, 1),
+      (std::vector<std::string>{"+" + r + "/build/out/x.so"}));
+
+  // the writes of one poll are one event
+  {
+    std::ofstream out((root / "src/a.cc").string());
+    out << "a" << std::flush;
+    out << "b" << std::flush;
+  }
+  fs::remove(root / "src/lib/b.cc");
+  ASSERT_EQ(WatchEvents(watcher, 2), (std::vector<std::string>{
+      "-" + r + "/src/lib/b.cc", "~" + r + "/src/a.cc"}));
+
+  fs::rename(root / "src/lib", root / "src/lib2");
+  ASSERT_EQ(WatchEvents(watcher, 2), (std::vector<std::string>{
+      "+" + r + "/src/lib2/e.cc", "-" + r + "/src/lib/e.cc"}));
+
+  // a root that is removed is watched again from its parent
+  fs::remove_all(root / "src");
+  ASSERT_EQ(WatchEvents(watcher, 2), (std::vector<std::string>{
+      "-" + r + "/src/a.cc", "-" + r + "/src/lib2/e.cc"}));
+  fs::create_directories(root / "src");
+  std::ofstream{(root / "src/g.cc").string()};
+  ASSERT_EQ(WatchEvents(watcher, 1),
+      (std::vector<std::string>{"+" + r + "/src/g.cc"}));
+  ASSERT_EQ(watcher.Matches(), (std::vector<std::string>{
+      r + "/build/out/x.so", r + "/src/g.cc"}));
+  fs::remove_all(root);
+}
+
+TEST(GlobWatcher, poll_waits) {
+  namespace fs = boost::filesystem;
+  fs::path root = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directories(root);
+  std::string r = root.string();
+  glob::GlobWatcher watcher({r + "/*.cc"});
+
+  // the events of names that don't match are not changes, a timeout
+  // returns after them, -1 waits for the one that matches
+  std::ofstream{(root / "a.txt").string()};
+  ASSERT_EQ(watcher.Poll(50).size(), 0u);
+  std::thread writer([&root]() {
+    std::ofstream{(root / "b.txt").string()};
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::ofstream{(root / "c.cc").string()};
+  });
+  std::vector<glob::WatchEvent> events = watcher.Poll(-1);
+  writer.join();
+  ASSERT_EQ(events.size(), 1u);
+  ASSERT_EQ(events[0].path, r + "/c.cc");
+  fs::remove_all(root);
+}
+#endif
+
+// the checksum of a header changed by a test
+void SetTarChecksum(std::string& block) {
+  block.replace(148, 8, 8, ' ');
+
+  unsigned sum = 0;
+  for (char c : block) {
+    sum += static_cast<unsigned char>(c);
+  }
+  std::snprintf(&block[148], 8, "%06o", sum);
+}
+
+// a tar header for the test archives, the fields that are not set are
+// zero, size_field replaces the octal size
+std::string TarHeader(const std::string& name, size_t size, char type,
+    const std::string& size_field = "") {
+  std::string block(512, '\0');
+  block.replace(0, name.size(), name);
+  std::snprintf(&block[124], 12, "%011zo", size);
+  if (!size_field.empty()) {
+    block.replace(124, 12, size_field);
+  }
+  std::snprintf(&block[136], 12, "%011o", 1700000000);
+  block[156] = type;
+  block.replace(257, 5, "ustar");
+  block.replace(263, 2, "00");
+  SetTarChecksum(block);
+  return block;
+}
+
+// a member with its data padded to blocks
+std::string TarMember(const std::string& name, const std::string& data,
+    char type = '0') {
+  std::string member = TarHeader(name, data.size(), type) + data;
+  member.resize((member.size() + 511) / 512 * 512, '\0');
+  return member;
+}
+
+// CountingBuf is a stream over a string that counts the bytes read from
+// it, the bytes skipped with a seek are not counted
+class CountingBuf: public std::streambuf {
+ public:
+  explicit CountingBuf(const std::string& data): data_{data} {}
+
+  size_t BytesRead() const {
+    return bytes_read_;
+  }
+
+ protected:
+  std::streamsize xsgetn(char* s, std::streamsize n) override {
+    size_t len = pos_ < data_.size() ?
+        std::min(static_cast<size_t>(n), data_.size() - pos_) : 0;
+    std::memcpy(s, data_.data() + pos_, len);
+    pos_ += len;
+    bytes_read_ += len;
+    return static_cast<std::streamsize>(len);
+  }
+
+  int_type underflow() override {
+    return pos_ < data_.size() ? traits_type::to_int_type(data_[pos_]) :
+        traits_type::eof();
+  }
+
+  int_type uflow() override {
+    int_type c = underflow();
+    if (c != traits_type::eof()) {
+      pos_++;
+      bytes_read_++;
+    }
+    return c;
+  }
+
+  pos_type seekoff(off_type off, std::ios::seekdir dir,
+      std::ios::openmode) override {
+    off_type base = dir == std::ios::beg ? 0 :
+        dir == std::ios::cur ? static_cast<off_type>(pos_) :
+        static_cast<off_type>(data_.size());
+    if (base + off < 0) {
+      return pos_type(off_type(-1));
+    }
+    pos_ = static_cast<size_t>(base + off);
+    return pos_type(base + off);
+  }
+
+  pos_type seekpos(pos_type pos, std::ios::openmode mode) override {
+    return seekoff(off_type(pos), std::ios::beg, mode);
+  }
+
+ private:
+  const std::string& data_;
+  size_t pos_ = 0;
+  size_t bytes_read_ = 0;
+};
+
+TEST(TarSource, members) {
+  std::string long_name = "lib/" + std::string(120, 'd') + "/long.so";
+  // the length of a pax record counts its own 2 digits
+  std::string pax_record = " path=lib/pax.so\n";
+  pax_record = std::to_string(pax_record.size() + 2) + pax_record;
+  std::string tar = TarMember("lib/", "", '5') +
+      TarMember("lib/a.so", "hello") +
+      TarMember("././@LongLink", long_name + '\0', 'L') +
+      TarMember("lib/short", std::string(600, 'x')) +
+      TarMember("PaxHeaders/pax.so", pax_record, 'x') +
+      TarMember("lib/ignored", "pax") +
+      TarMember("bin/tool", "#!") +
+      TarMember("bin/link.so", "", '2') + std::string(1024, '\0');
+
+  std::istringstream in(tar);
+  std::vector<glob::ArchiveMember> members = glob::ReadTarMembers(in);
+  ASSERT_EQ(members.size(), 6u);
+  ASSERT_EQ(members[1].path, "lib/a.so");
+  ASSERT_EQ(tar.substr(members[1].offset, members[1].size), "hello");
+  ASSERT_EQ(members[2].path, long_name);
+  ASSERT_EQ(members[2].size, 600u);
+  ASSERT_EQ(members[3].path, "lib/pax.so");
+  ASSERT_EQ(tar.substr(members[3].offset, members[3].size), "pax");
+  ASSERT_EQ(members[5].type, glob::EntryType::SYMLINK);
+  ASSERT_EQ(members[5].mtime, int64_t(1700000000) * 1000000000);
+
+  std::istringstream source_in(tar);
+  glob::TarDirSource source(source_in);
+  glob::file_glob fglob{"**/*.so"};
+  fglob.SetDirSource(source);
+  ASSERT_EQ(SortedPaths(fglob.Exec()), std::vector<std::string>({
+      "./bin/link.so", "./lib/a.so", "./" + long_name, "./lib/pax.so"}));
+
+  // the data of a member is read from the archive without the others
+  namespace fs = boost::filesystem;
+  fs::path path = fs::temp_directory_path() / fs::unique_path();
+  std::ofstream{path.string(), std::ios::binary} << tar;
+  glob::TarDirSource file_source(path.string());
+  ASSERT_EQ(glob::ReadTarMember(path.string(),
+      *file_source.Member("lib/pax.so")), "pax");
+  fs::remove(path);
+
+  // the prefix of a POSIX ustar header is the directory of the name, the
+  // same bytes of a GNU header are its atime and ctime
+  std::string ustar_header = TarHeader("f.so", 0, '0');
+  ustar_header.replace(345, 5, "src/d");
+  SetTarChecksum(ustar_header);
+  std::string gnu_header = TarHeader("src/d/f.so", 0, '0');
+  gnu_header.replace(257, 8, std::string("ustar  \0", 8));
+  std::snprintf(&gnu_header[345], 12, "%011o", 1700000000);
+  SetTarChecksum(gnu_header);
+  std::istringstream magic_in(ustar_header + gnu_header +
+      std::string(1024, '\0'));
+  std::vector<glob::ArchiveMember> magic_members =
+      glob::ReadTarMembers(magic_in);
+  ASSERT_EQ(magic_members.size(), 2u);
+  ASSERT_EQ(magic_members[0].path, "src/d/f.so");
+  ASSERT_EQ(magic_members[1].path, "src/d/f.so");
+
+  // a GNU sparse file is a member, a volume label is not, and the long name
+  // before the label is not the name of the next member
+  std::string vendor_tar = TarMember("sparse.so", "s", 'S') +
+      TarMember("././@LongLink", long_name + '\0', 'L') +
+      TarMember("label", "", 'V') + TarMember("c.so", "c") +
+      std::string(1024, '\0');
+  std::istringstream vendor_in(vendor_tar);
+  std::vector<glob::ArchiveMember> vendor_members =
+      glob::ReadTarMembers(vendor_in);
+  ASSERT_EQ(vendor_members.size(), 2u);
+  ASSERT_EQ(vendor_members[0].path, "sparse.so");
+  ASSERT_EQ(vendor_members[0].type, glob::EntryType::FILE);
+  ASSERT_EQ(vendor_members[1].path, "c.so");
+
+  // the data before the member is skipped with a seek, not read
+  std::string big_tar = TarMember("big", std::string(1 << 20, 'b')) +
+      TarMember("small", "abc") + std::string(1024, '\0');
+  std::istringstream big_in(big_tar);
+  std::vector<glob::ArchiveMember> big_members = glob::ReadTarMembers(big_in);
+  CountingBuf counting_buf(big_tar);
+  std::istream counting_in(&counting_buf);
+  ASSERT_EQ(glob::ReadTarMember(counting_in, big_members[1]), "abc");
+  ASSERT_LT(counting_buf.BytesRead(), 1024u);
+
+  std::string corrupted = tar;
+  corrupted[0] = 'x';
+  std::istringstream corrupted_in(corrupted);
+  ASSERT_THROW(glob::ReadTarMembers(corrupted_in), glob::Error);
+  std::istringstream truncated_in(tar.substr(0, 700));
+  ASSERT_THROW(glob::ReadTarMembers(truncated_in), glob::Error);
+  std::istringstream zstd_in(std::string("\x28\xb5\x2f\xfd", 4) + tar);
+  ASSERT_THROW(glob::ReadTarMembers(zstd_in), glob::Error);
+
+#ifdef GLOB_CPP_WITH_ZLIB
+  // gzip of the archive, the offsets are the ones of the tar stream
+  std::string gz(tar.size() + 1024, '\0');
+  z_stream zs{};
+  deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+      Z_DEFAULT_STRATEGY);
+  zs.next_in = reinterpret_cast<Bytef*>(&tar[0]);
+  zs.avail_in = static_cast<uInt>(tar.size());
+  zs.next_out = reinterpret_cast<Bytef*>(&gz[0]);
+  zs.avail_out = static_cast<uInt>(gz.size());
+  ASSERT_EQ(deflate(&zs, Z_FINISH), Z_STREAM_END);
+  gz.resize(zs.total_out);
+  deflateEnd(&zs);
+
+  std::istringstream gz_in(gz);
+  std::vector<glob::ArchiveMember> gz_members = glob::ReadTarMembers(gz_in);
+  ASSERT_EQ(gz_members.size(), members.size());
+  ASSERT_EQ(gz_members[3].offset, members[3].offset);
+#endif
+}
+
+TEST(TarSource, malformed) {
+  // a base 256 size that overflows when it is padded
+  std::string huge_size("\x80\0\0\0\xff\xff\xff\xff\xff\xff\xfe\0", 12);
+  std::istringstream huge_in(TarHeader("a", 0, '0', huge_size) +
+      std::string(1024, '\0'));
+  ASSERT_THROW(glob::ReadTarMembers(huge_in), glob::Error);
+
+  // base 256 sizes that don't fit in 64 bits or are negative
+  for (std::string size_field : {
+      std::string("\x80\0\0\x01\0\0\0\0\0\0\0\x05", 12),
+      std::string(11, '\xff') + '\xfb'}) {
+    std::istringstream size_in(TarHeader("a", 0, '0', size_field) +
+        std::string(1024, '\0'));
+    ASSERT_THROW(glob::ReadTarMembers(size_in), glob::Error);
+  }
+
+  // the seek past the end of a truncated archive
+  std::istringstream truncated_in(TarHeader("a", 32 * 1024, '0'));
+  ASSERT_THROW(glob::ReadTarMembers(truncated_in), glob::Error);
+
+  // pax records with no room for a key or without a newline
+  for (std::string record : {"2 ", "3 a", "9 path=ab"}) {
+    std::istringstream pax_in(TarMember("pax", record, 'x') +
+        TarMember("a", "a") + std::string(1024, '\0'));
+    ASSERT_THROW(glob::ReadTarMembers(pax_in), glob::Error);
+  }
+}
+
+// compiles the pattern with or without the optimizer
+void CompileAutomata(const std::string& pattern, bool optimize,
+    glob::Automata<char>& automata) {
+  glob::Lexer<char> l(pattern);
+  glob::Parser<char> p(l.Scanner());
+  auto ast_ptr = p.GenAst();
+  if (optimize) {
+    glob::AstOptimizer<char> ast_optimizer;
+    ast_optimizer.Optimize(ast_ptr.get());
+  }
+
+  glob::AstConsumer<char> ast_consumer;
+  ast_consumer.GenAutomata(ast_ptr.get(), automata);
+}
+
+TEST(GlobString, ast_optimizer) {
+  struct {
+    const char* pattern;
+    size_t max_states;
+  } cases[] = {
+    {"***.txt", 7},
+    {"file_???.[c]", 10},
+    {"@(foo.c|foo.h)", 7},
+    {"@(src/a.cc|src/b.cc)", 10},
+    {"x@(abc)y", 7},
+    {"(a[b]c)*", 6},
+    {"*(ab|ac)d", 4},
+    {"?(x|y)???*", 5},
+  };
+
+  const char* strs[] = {"", "a", "abc", "acd", "abacd", "foo.c", "foo.h",
+      "foo.cc", "file_123.c", "file_12.c", "x.txt", ".txt", "xabcy", "xaby",
+      "src/a.cc", "src/c.cc", "abcde", "xyz", "x", "y"};
+
+  for (auto& c : cases) {
+    glob::Automata<char> automata;
+    glob::Automata<char> opt_automata;
+    CompileAutomata(c.pattern, false, automata);
+    CompileAutomata(c.pattern, true, opt_automata);
+    ASSERT_LE(opt_automata.GetNumStates(), c.max_states) << c.pattern;
+
+    for (auto str : strs) {
+      ASSERT_EQ(std::get<0>(automata.Exec(str)),
+          std::get<0>(opt_automata.Exec(str))) << c.pattern << " " << str;
+    }
+  }
+}
+
+// the captures of a match are the ones of the pattern without the
+// optimizer
+TEST(GlobString, ast_optimizer_captures) {
+  const char* patterns[] = {"f@(oo|ox)", "[x]y*", "**.txt", "***.txt",
+      "file_???.[c]", "@(foo.c|foo.h)", "x@(abc)y", "(a[b]c)*", "*(ab|ac)d",
+      "?(x|y)???*"};
+  const char* strs[] = {"foo", "fox", "xyz", "a.txt", ".txt", "file_123.c",
+      "foo.h", "xabcy", "abcde", "acd", "abacd", "xyz", "x"};
+
+  for (auto pattern : patterns) {
+    glob::glob g(pattern);
+    glob::Automata<char> automata;
+    CompileAutomata(pattern, false, automata);
+    for (auto str : strs) {
+      glob::cmatch m;
+      bool r = glob::glob_match(str, m, g);
+      ASSERT_EQ(r, std::get<0>(automata.Exec(str))) << pattern << " " << str;
+      if (r) {
+        ASSERT_EQ(std::vector<std::string>(m.begin(), m.end()),
+            automata.GetMatchedStrings()) << pattern << " " << str;
+      }
+    }
+  }
+
+  glob::glob g("f@(oo|ox)");
+  glob::cmatch m;
+  ASSERT_TRUE(glob::glob_match("foo", m, g));
+  ASSERT_EQ(std::vector<std::string>(m.begin(), m.end()),
+      std::vector<std::string>{"oo"});
+}
+
+TEST(GlobString, any_run) {
+  glob::glob g("a???b");
+  glob::cmatch m;
+  ASSERT_TRUE(glob_match("axyzb", m, g));
+  ASSERT_FALSE(glob_match("axyb", g));
+  ASSERT_FALSE(glob_match("axyzwb", g));
+
+  // each '?' of the run is still one match
+  ASSERT_TRUE(glob_match("a123b", m, g));
+  ASSERT_EQ(m.size(), 3u);
+  ASSERT_EQ(*m.begin(), "1");
+}
+
+TEST(GlobString, prefilter) {
+  glob::glob g("*.tar.gz");
+  auto& prefilter = g.GetPrefilter();
+  ASSERT_EQ(prefilter.MinLength(), 7u);
+  ASSERT_EQ(prefilter.MaxLength(), glob::Prefilter<char>::kUnbounded);
+  ASSERT_EQ(prefilter.Suffix(), ".tar.gz");
+  ASSERT_FALSE(prefilter.Check("file.tar"));
+  ASSERT_TRUE(prefilter.Check("file.tar.gz"));
+
+  glob::glob g2("src_*test*_[0-9]?(a|bc)");
+  auto& prefilter2 = g2.GetPrefilter();
+  ASSERT_EQ(prefilter2.MinLength(), 10u);
+  ASSERT_EQ(prefilter2.MaxLength(), glob::Prefilter<char>::kUnbounded);
+  ASSERT_EQ(prefilter2.Prefix(), "src_");
+  ASSERT_EQ(prefilter2.Literals().size(), 2u);
+  ASSERT_FALSE(prefilter2.Check("src_tset_1"));
+  ASSERT_TRUE(glob_match("src_unit_test_1bc", g2));
+  ASSERT_FALSE(glob_match("src_unit_tst_1bc", g2));
+
+  glob::glob g3("file_??.@(c|cc)");
+  ASSERT_EQ(g3.GetPrefilter().MinLength(), 9u);
+  ASSERT_EQ(g3.GetPrefilter().MaxLength(), 10u);
+  ASSERT_FALSE(glob_match("file_1.c", g3));
+  ASSERT_TRUE(glob_match("file_12.c", g3));
+
+  // the results of a failed match are empty
+  glob::cmatch m;
+  ASSERT_TRUE(glob_match("a.tar.gz", m, g));
+  ASSERT_FALSE(m.empty());
+  ASSERT_FALSE(glob_match("a.tar", m, g));
+  ASSERT_TRUE(m.empty());
+}
+
+TEST(GlobString, shift_and) {
+  glob::glob g("[a-z]*_??.[ch]");
+  ASSERT_NE(g.GetFastMatcher(), nullptr);
+  ASSERT_TRUE(glob_match("main_01.c", g));
+  ASSERT_TRUE(glob_match("m__01.h", g));
+  ASSERT_FALSE(glob_match("Main_01.c", g));
+  ASSERT_FALSE(glob_match("main_1.c", g));
+
+  // patterns with groups run on the automata
+  glob::glob g2("*.@(c|h)");
+  ASSERT_EQ(g2.GetFastMatcher(), nullptr);
+
+  // more than 64 positions use the 128 bits engine
+  std::string pattern = "*";
+  std::string str = "x";
+  for (int i = 0; i < 50; i++) {
+    pattern += "[ab]?";
+    str += "ay";
+  }
+  glob::glob g3(pattern);
+  ASSERT_NE(g3.GetFastMatcher(), nullptr);
+  ASSERT_TRUE(glob_match(str, g3));
+  str[51] = 'c';
+  ASSERT_FALSE(glob_match(str, g3));
+
+  glob::wglob wg(L"*é[Ā-Ȁ]?");
+  ASSERT_TRUE(glob_match(L"caféŐx", wg));
+  ASSERT_FALSE(glob_match(L"caféɐx", wg));
+
+  // reversed ranges match as in the automata
+  glob::glob g4("[z-a]*.[9-0]");
+  ASSERT_NE(g4.GetFastMatcher(), nullptr);
+  ASSERT_TRUE(glob_match("main.5", g4));
+  ASSERT_TRUE(glob_match("z.0", g4));
+  ASSERT_FALSE(glob_match("Main.5", g4));
+  ASSERT_FALSE(glob_match("main.x", g4));
+}
+
+TEST(GlobString, segments) {
+  glob::glob g("*foo*bar*.log");
+  ASSERT_TRUE(g.GetPrefilter().Exact());
+  ASSERT_TRUE(glob_match("xfooybarz.log", g));
+  ASSERT_TRUE(glob_match("foobar.log", g));
+  ASSERT_FALSE(glob_match("barfoo.log", g));
+  ASSERT_FALSE(glob_match("foobar.log.gz", g));
+
+  // the last segment is anchored at the end, so it can't be used by a
+  // segment before it
+  glob::glob g2("*foo*.log*.log");
+  ASSERT_FALSE(glob_match("foo.log", g2));
+  ASSERT_TRUE(glob_match("foo.log.log", g2));
+  ASSERT_FALSE(glob::glob("*foo?bar*").GetPrefilter().Exact());
+}
+
+TEST(GlobString, path_mode) {
+  glob::GlobOptions options;
+  options.SetPathMode(true);
+
+  glob::glob g("src/*.cc", options);
+  ASSERT_FALSE(g.GetPrefilter().Exact());
+  ASSERT_TRUE(glob_match("src/main.cc", g));
+  ASSERT_FALSE(glob_match("src/a/main.cc", g));
+  ASSERT_FALSE(glob_match("src/.main.cc", g));
+  glob::glob any_path("src/*.cc");
+  ASSERT_TRUE(glob_match("src/a/main.cc", any_path));
+
+  // "**" matches any number of segments, but no hidden one
+  glob::glob g2("src/**/*.cc", options);
+  ASSERT_NE(g2.GetFastMatcher(), nullptr);
+  ASSERT_TRUE(glob_match("src/main.cc", g2));
+  ASSERT_TRUE(glob_match("src/a/b/main.cc", g2));
+  ASSERT_FALSE(glob_match("src/.git/main.cc", g2));
+  ASSERT_FALSE(glob_match("lib/src/main.cc", g2));
+
+  glob::glob g3("**", options);
+  ASSERT_TRUE(glob_match("", g3));
+  ASSERT_TRUE(glob_match("a/b/c", g3));
+  ASSERT_FALSE(glob_match("a/.b", g3));
+
+  // a leading '.' is matched only by a '.' at the start of a segment of the
+  // glob
+  glob::glob g4("*/.[a-z]*", options);
+  ASSERT_TRUE(glob_match("home/.bashrc", g4));
+  ASSERT_FALSE(glob_match("home/bashrc", g4));
+  ASSERT_FALSE(glob_match(".home/.bashrc", g4));
+  glob::glob hidden("*.c", options);
+  ASSERT_FALSE(glob_match(".c", hidden));
+  ASSERT_TRUE(glob_match("a.c", hidden));
+  glob::glob any_char("[.a]?b", options);
+  ASSERT_FALSE(glob_match(".xb", any_char));
+  ASSERT_FALSE(glob_match("a/b", any_char));
+
+  // the automata gives the same answers as the fast matcher, "**" inside
+  // groups is a star of one segment
+  glob::glob g5("**/@(a|b)/*.c", options);
+  ASSERT_EQ(g5.GetFastMatcher(), nullptr);
+  ASSERT_TRUE(glob_match("x/y/a/f.c", g5));
+  ASSERT_TRUE(glob_match("b/f.c", g5));
+  ASSERT_FALSE(glob_match("x/c/f.c", g5));
+  ASSERT_FALSE(glob_match("a/x/f.c", g5));
+
+  glob::glob g6("a/@(**)", options);
+  ASSERT_TRUE(glob_match("a/x.c", g6));
+  ASSERT_FALSE(glob_match("a/x/y.c", g6));
+
+  glob::cmatch m;
+  ASSERT_TRUE(glob_match("src/a/b/main.cc", m, g2));
+  ASSERT_EQ(std::vector<std::string>(m.begin(), m.end()),
+      (std::vector<std::string>{"a/b/", "main"}));
+
+  glob::BasicGlob<char, glob::no_extended_glob<char>> sg("a/**/?.c",
+      options);
+  ASSERT_TRUE(glob_match("a/x.c", sg));
+  ASSERT_TRUE(glob_match("a/b/c/x.c", sg));
+  ASSERT_FALSE(glob_match("a/b/.c/x.c", sg));
+  ASSERT_FALSE(glob_match("a/b/xy.c", sg));
+}
+
+TEST(PathIndex, same_as_path_mode) {
+  std::vector<std::string> paths = {"src/main.cc", "src/lib/a.cc",
+      "src/lib/a.h", "src/lib/b/c.cc", "src/.git/config", "docs/index.md",
+      "a/a/b", "a/b", "./x//y/", "/abs/z.cc", "src/lib/a.cc"};
+  glob::path_index index(paths);
+
+  // the directories are entries too, but only the paths were listed
+  size_t lib = index.Find("src/lib");
+  ASSERT_NE(lib, glob::path_index::npos);
+  ASSERT_FALSE(index.Listed(lib));
+  ASSERT_EQ(index.NumChildren(lib), 3u);
+  ASSERT_EQ(index.Path(index.Find("./src//lib/a.cc")), "src/lib/a.cc");
+  ASSERT_TRUE(index.Listed(index.Find("x/y")));
+  ASSERT_EQ(index.Name(index.Parent(index.Find("abs/z.cc"))), "abs");
+  ASSERT_EQ(index.Find("src/lib/x"), glob::path_index::npos);
+  ASSERT_EQ(index.Find(""), glob::path_index::npos);
+
+  // the entries that match are the ones a glob in path mode matches
+  std::vector<std::string> patterns = {"src/*.cc", "src/**/*.cc", "**",
+      "**/*.cc", "src/lib/a.*", "src/lib/[ab]*", "*/*", "**/b", "a/**/b",
+      "**/a/**/b", "src/.*/*", "src/**/**", "src/!(lib)", "*/+(a|b)",
+      "src/lib", "src/l?b/*.h", "nothing/*", "*.md", "**/*.@(md|h)"};
+  glob::GlobOptions options;
+  options.SetPathMode(true);
+  for (auto& pattern : patterns) {
+    glob::glob g(pattern, options);
+    std::vector<std::string> expected;
+    for (size_t entry = 1; entry <= index.Size(); entry++) {
+      if (glob_match(index.Path(entry), g)) {
+        expected.push_back(index.Path(entry));
+      }
+    }
+
+    std::vector<std::string> result = index.GlobPaths(pattern);
+    std::sort(expected.begin(), expected.end());
+    std::sort(result.begin(), result.end());
+    ASSERT_EQ(result, expected) << pattern;
+  }
+
+  // two ways of splitting "a/a/b" don't match it twice
+  ASSERT_EQ(index.Glob("**/a/**/b").size(), 2u);
+
+  // a packed manifest
+  std::string manifest = "b/x.c\na/y.c\n\na/z.h\n";
+  glob::path_index packed(manifest.data(), manifest.size());
+  ASSERT_EQ(packed.Size(), 5u);
+  ASSERT_EQ(packed.GlobPaths("*/*.c"),
+      (std::vector<std::string>{"a/y.c", "b/x.c"}));
+  ASSERT_THROW(packed.Glob("a/[b"), glob::Error);
+
+  glob::wpath_index windex(std::vector<std::wstring>{L"caf\u00e9/a.txt"});
+  ASSERT_EQ(windex.Glob(L"*/*.txt").size(), 1u);
+}
+
+TEST(LiteralSearch, impls) {
+  std::string haystack;
+  for (int i = 0; i < 300; i++) {
+    haystack += "abcab"[(i * 7) % 5];
+  }
+  haystack += "needle";
+
+  const char* needles[] = {"a", "ab", "cab", "needle", "bcabcabc", "x",
+      "eedl", "abcabcabcabcabcabcabcabcabcabcabcabcabcabcx"};
+  glob::SearchImpl impls[] = {glob::SearchImpl::SSE2,
+      glob::SearchImpl::AVX2, glob::SearchImpl::SCALAR};
+  glob::SearchImpl best = glob::BestSearchImpl();
+
+  for (auto needle : needles) {
+    size_t len = std::string(needle).length();
+    for (size_t start = 0; start < 40; start++) {
+      size_t expected = haystack.find(needle, start);
+      expected = expected == std::string::npos ? expected : expected - start;
+      for (auto impl : impls) {
+        if (impl == glob::SearchImpl::AVX2 && best != impl) {
+          continue;
+        }
+
+        ASSERT_EQ(glob::FindLiteral(haystack.data() + start,
+            haystack.length() - start, needle, len, impl), expected) << needle;
+      }
+    }
+  }
+}
+
+TEST(GlobBatch, same_as_glob_match) {
+  std::vector<std::string> inputs = {"", "a.txt", "b.pdf", "foo_bar.log",
+      "abc42.c", "a", "x.txt.gz", "aaaab", "dir/file.txt", ".txt"};
+  std::string packed;
+  std::string concat;
+  std::vector<size_t> offsets = {0};
+  for (auto& input : inputs) {
+    packed += input + '\n';
+    concat += input;
+    offsets.push_back(concat.size());
+  }
+
+  for (auto pattern : {"*.txt", "*foo*bar*.log", "[a-z]*[0-9].[ch]", "?",
+      "+([a-z]).@(txt|pdf)", "*a*a*b", "a.txt"}) {
+    glob::glob g(pattern);
+    std::vector<bool> expected;
+    for (auto& input : inputs) {
+      expected.push_back(glob::glob_match(input, g));
+    }
+    size_t num_expected = std::count(expected.begin(), expected.end(), true);
+
+    std::vector<bool> out;
+    ASSERT_EQ(glob::glob_match_batch(g, inputs, out), num_expected);
+    ASSERT_EQ(out, expected) << pattern;
+
+    ASSERT_EQ(glob::glob_match_packed(g, concat.data(), offsets.data(),
+        inputs.size(), out), num_expected);
+    ASSERT_EQ(out, expected) << pattern;
+
+    ASSERT_EQ(glob::glob_match_packed(g, packed.data(), packed.size(), '\n',
+        out), num_expected);
+    ASSERT_EQ(out, expected) << pattern;
+  }
+
+  // without the last delim the last string is still one input
+  glob::glob g("*.pdf");
+  std::vector<bool> out;
+  std::string buffer("a.pdf\0b.txt\0c.pdf", 17);
+  ASSERT_EQ(glob::glob_match_packed(g, buffer.data(), buffer.size(), '\0',
+      out), 2u);
+  ASSERT_EQ(out, std::vector<bool>({true, false, true}));
+}
+
+TEST(GlobParallel, same_as_batch) {
+  // enough inputs for many chunks of strings and of bytes
+  std::vector<std::string> inputs;
+  std::string packed;
+  for (size_t i = 0; i < 30000; i++) {
+    inputs.push_back("dir_" + std::to_string(i % 13) + "/file_" +
+        std::to_string(i) + (i % 3 ? ".txt" : ".log"));
+    packed += inputs.back() + '\n';
+  }
+
+  glob::ThreadPool pool(4);
+  ASSERT_EQ(pool.NumThreads(), 4u);
+  for (auto pattern : {"*.txt", "dir_1?/*", "+([a-z_0-9/]).@(log|md)"}) {
+    glob::glob g(pattern);
+    std::vector<bool> out;
+    glob::glob_match_batch(g, inputs, out);
+    std::vector<size_t> expected;
+    for (size_t i = 0; i < out.size(); i++) {
+      if (out[i]) {
+        expected.push_back(i);
+      }
+    }
+
+    glob::shared_glob<char> shared(pattern);
+    ASSERT_EQ(glob::parallel_filter(shared, inputs, pool), expected);
+    ASSERT_EQ(glob::parallel_filter(shared, packed.data(), packed.size(), '\n',
+        pool), expected);
+  }
+
+  // the first exception of a task is thrown by ParallelFor
+  ASSERT_THROW(pool.ParallelFor(100, [](size_t i) {
+    if (i == 42) {
+      throw glob::Error("task");
+    }
+  }), glob::Error);
+}
+
+TEST(GlobGrep, same_as_packed) {
+  // short lines, lines longer than a block of the scanner, empty lines, and
+  // no delim at the end
+  std::string data;
+  for (size_t i = 0; i < 500; i++) {
+    data += "src/" + std::string(i % 97, 'a') + "/file_" + std::to_string(i) +
+        (i % 3 ? ".txt" : ".log") + '\n';
+    if (i % 50 == 0) {
+      data += '\n';
+    }
+  }
+  data += "last.txt";
+
+  for (auto pattern : {"*.txt", "src/a*/*", "+([a-z_0-9/]).@(log|md)", ""}) {
+    glob::glob g(pattern);
+    std::vector<bool> out;
+    size_t n = glob::glob_match_packed(g, data.data(), data.size(), '\n', out);
+
+    std::vector<size_t> numbers;
+    size_t num_matches = glob::glob_grep(g, data.data(), data.size(),
+        [&](const glob::LineMatch<char>& line) {
+          ASSERT_EQ(line.data, data.data() + line.offset);
+          ASSERT_TRUE(line.offset + line.size == data.size() ||
+              data[line.offset + line.size] == '\n');
+          numbers.push_back(line.number);
+        });
+    ASSERT_EQ(num_matches, n) << pattern;
+
+    std::vector<size_t> expected;
+    for (size_t i = 0; i < out.size(); i++) {
+      if (out[i]) {
+        expected.push_back(i);
+      }
+    }
+    ASSERT_EQ(numbers, expected) << pattern;
+  }
+}
+
+TEST(GlobGrep, mapped_file) {
+  namespace fs = boost::filesystem;
+  fs::path path = fs::temp_directory_path() / fs::unique_path();
+  {
+    std::ofstream file(path.string(), std::ios::binary);
+    file << "a.txt\nb.log\nc/d.txt\n";
+  }
+
+  glob::glob g("*.txt");
+  std::ostringstream out;
+  ASSERT_EQ(glob::glob_grep(g, path.string(), out), 2u);
+  ASSERT_EQ(out.str(), "a.txt\nc/d.txt\n");
+  ASSERT_EQ(glob::glob_grep_offsets(g, path.string()),
+      std::vector<size_t>({0, 12}));
+
+  fs::remove(path);
+  ASSERT_THROW(glob::glob_grep_offsets(g, path.string()), glob::Error);
+}
+
+TEST(GlobStream, same_as_glob_match) {
+  // with and without a fast matcher, and a pattern too long for it
+  std::vector<std::string> patterns = {"*.txt", "a?c*", "[a-c]*x", "abc",
+      "src/+(a|b).c", "*(ab|c)d", "!(x)*.y", "", "@(a|)",
+      std::string(130, 'a') + "*"};
+  std::vector<std::string> inputs = {"", "a.txt", "abcd", "bbx", "abc",
+      "src/a.c", "src/ab.c", "ababcd", "z.y", "x.y", std::string(131, 'a')};
+
+  for (auto& pattern : patterns) {
+    glob::glob g(pattern);
+    glob::StreamMatcher<char> matcher(g);
+    for (auto& input : inputs) {
+      // parts of 1, 2 and 3 chars
+      for (size_t part_len = 1; part_len <= 3; part_len++) {
+        matcher.Reset();
+        for (size_t pos = 0; pos < input.length(); pos += part_len) {
+          matcher.Feed(input.substr(pos, part_len));
+        }
+        ASSERT_EQ(matcher.Length(), input.length());
+        ASSERT_EQ(matcher.Finish(), glob_match(input, g))
+            << pattern << " " << input;
+      }
+    }
+  }
+
+  glob::glob g("src/*.c");
+  glob::StreamMatcher<char> matcher(g);
+  ASSERT_EQ(matcher.Feed("sr"), glob::StreamStatus::CAN_MATCH);
+  ASSERT_EQ(matcher.Feed("x/"), glob::StreamStatus::DEAD);
+  ASSERT_EQ(matcher.Feed("a.c"), glob::StreamStatus::DEAD);
+  ASSERT_FALSE(matcher.Finish());
+
+  glob::glob prefix("src/*");
+  glob::StreamMatcher<char> prefix_matcher(prefix);
+  ASSERT_EQ(prefix_matcher.Feed("src"), glob::StreamStatus::CAN_MATCH);
+  ASSERT_EQ(prefix_matcher.Feed("/"), glob::StreamStatus::WILL_MATCH);
+  ASSERT_TRUE(prefix_matcher.Finish());
+
+  // without a fast matcher only the prefix tells that the string is dead
+  glob::glob group("src/+(a|b).c");
+  glob::StreamMatcher<char> group_matcher(group);
+  ASSERT_EQ(group_matcher.Feed("src/"), glob::StreamStatus::CAN_MATCH);
+  ASSERT_EQ(group_matcher.Feed("ab.c"), glob::StreamStatus::CAN_MATCH);
+  ASSERT_TRUE(group_matcher.Finish());
+  group_matcher.Reset();
+  ASSERT_EQ(group_matcher.Feed("sx"), glob::StreamStatus::DEAD);
+
+  // a walk can skip the directories that can't contain a match
+  glob::glob path_glob("src/*/test/*.cc");
+  ASSERT_EQ(glob::glob_match_prefix("docs/", path_glob),
+      glob::StreamStatus::DEAD);
+  ASSERT_EQ(glob::glob_match_prefix("src/lib/", path_glob),
+      glob::StreamStatus::CAN_MATCH);
+  ASSERT_EQ(glob::glob_match_prefix("", path_glob),
+      glob::StreamStatus::CAN_MATCH);
+
+  glob::wglob wg(L"*.txt");
+  glob::StreamMatcher<wchar_t> wmatcher(wg);
+  wmatcher.Feed(L"caf\u00e9");
+  wmatcher.Feed(L".txt");
+  ASSERT_TRUE(wmatcher.Finish());
+}
+
+TEST(GlobCache, hits_and_evictions) {
+  glob::glob_cache cache(2, 1);
+  auto g1 = cache.Get("*.pdf");
+  ASSERT_EQ(cache.Get("*.pdf"), g1);
+  ASSERT_TRUE(glob_match("test.pdf", *g1));
+  ASSERT_FALSE(glob_match("test.txt", *g1));
+
+  // "*.pdf" has a hit, so the hand takes "*.txt" first
+  cache.Get("*.txt");
+  cache.Get("*.c");
+  auto stats = cache.GetStats();
+  ASSERT_EQ(stats.hits, 1u);
+  ASSERT_EQ(stats.misses, 3u);
+  ASSERT_EQ(stats.evictions, 1u);
+  ASSERT_EQ(stats.size, 2u);
+  ASSERT_EQ(cache.Get("*.pdf"), g1);
+  ASSERT_EQ(cache.GetStats().hits, 2u);
+
+  // the options are part of the key
+  auto g2 = cache.Get("*.pdf", glob::GlobOptions().SetPathMode(true));
+  ASSERT_NE(g2, g1);
+  ASSERT_TRUE(g2->Options().PathMode());
+  ASSERT_FALSE(glob_match("a/b.pdf", *g2));
+  ASSERT_TRUE(glob_match("a/b.pdf", *cache.Get("*.pdf")));
+  cache.Get("*.pdf");
+
+  // invalid patterns are not cached
+  ASSERT_THROW(cache.Get("[a"), glob::Error);
+  ASSERT_EQ(cache.GetStats().size, 2u);
+
+  // evicted globs are still valid for who holds them
+  cache.Clear();
+  ASSERT_TRUE(glob_match("a.pdf", *g1));
+  ASSERT_NE(cache.Get("*.pdf"), g1);
+}
+
+TEST(GlobCache, shared_glob) {
+  auto g = glob::cached_glob("+([a-z]).@(txt|pdf)");
+  ASSERT_EQ(glob::cached_glob("+([a-z]).@(txt|pdf)"), g);
+
+  glob::cmatch m;
+  ASSERT_TRUE(glob_match(std::string("abc.pdf"), m, *g));
+  ASSERT_EQ(m[0], "abc");
+
+  // the threads use the automata at the same time, each one with its own
+  // compiled glob of the pool
+  std::vector<std::thread> threads;
+  std::vector<int> errors(4, 0);
+  for (size_t t = 0; t < errors.size(); t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < 2000; i++) {
+        errors[t] += !glob_match("file.txt", *g);
+        errors[t] += glob_match("file1.txt", *g);
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (int e : errors) {
+    ASSERT_EQ(e, 0);
+  }
+  ASSERT_LE(g->PoolSize(), errors.size() + 1);
+}
+
+TEST(GlobSerialize, round_trip) {
+  const char* patterns[] = {"*.cc", "file_??.[ch]", "[a-z]*[!0-9].[ch]",
+      "+([a-z0-9_]).@(txt|pdf|md)", "*(a|b)c", "!(*.o)", "*foo*bar*.log"};
+  const char* strs[] = {"main.cc", "file_42.c", "abc.h", "a1.c", "abc_9.pdf",
+      "ababc", "x.o", "x.c", "xfooybar.log", ""};
+
+  glob::glob_writer writer;
+  for (auto pattern : patterns) {
+    writer.Add(pattern);
+  }
+
+  std::string data = writer.Data();
+  glob::glob_file file(data.data(), data.size());
+  ASSERT_EQ(file.Size(), sizeof(patterns)/sizeof(patterns[0]));
+
+  // the globs are moved into the vector, they must still work after it
+  auto globs = file.LoadAll();
+  for (size_t i = 0; i < file.Size(); i++) {
+    ASSERT_EQ(file.Pattern(i), patterns[i]);
+    glob::glob g(patterns[i]);
+    for (auto str : strs) {
+      glob::cmatch m1;
+      glob::cmatch m2;
+      ASSERT_EQ(glob_match(str, m1, globs[i]), glob_match(str, m2, g))
+          << patterns[i] << " " << str;
+      ASSERT_EQ(std::vector<std::string>(m1.begin(), m1.end()),
+          std::vector<std::string>(m2.begin(), m2.end()));
+    }
+  }
+
+  // the options are written with each glob
+  glob::glob_writer path_writer;
+  glob::GlobOptions options;
+  options.SetPathMode(true);
+  path_writer.Add("**/*.cc", options);
+  path_writer.Add("*/@(a|.b)/?.[ch]", options);
+  std::string path_data = path_writer.Data();
+  glob::glob_file path_file(path_data.data(), path_data.size());
+  const char* paths[] = {"a.cc", "a/b/c.cc", "a/.b/c.cc", "x/a/c.h",
+      "x/.b/c.c", "x/a/.c", "x/y/a/c.h"};
+  for (size_t i = 0; i < path_file.Size(); i++) {
+    auto g = path_file.Load(i);
+    ASSERT_TRUE(g.GetOptions().PathMode());
+    glob::glob expected(path_file.Pattern(i), options);
+    for (auto path : paths) {
+      ASSERT_EQ(glob_match(path, g), glob_match(path, expected)) << path;
+    }
+  }
+
+  glob::GlobWriter<wchar_t, glob::no_extended_glob<wchar_t>> wwriter;
+  wwriter.Add(L"*é?.txt");
+  std::string wdata = wwriter.Data();
+  glob::GlobFile<wchar_t, glob::no_extended_glob<wchar_t>> wfile(
+      wdata.data(), wdata.size());
+  auto wg = wfile.Load(0);
+  ASSERT_TRUE(glob_match(L"caféx.txt", wg));
+  ASSERT_FALSE(glob_match(L"cafex.txt", wg));
+
+  // the kind of glob and of char must be the same of the writer
+  ASSERT_THROW(glob::wglob_file(data.data(), data.size()), glob::Error);
+  using SimpleGlobFile = glob::GlobFile<char, glob::no_extended_glob<char>>;
+  ASSERT_THROW(SimpleGlobFile(data.data(), data.size()), glob::Error);
+}
+
+TEST(GlobSerialize, mapped_file) {
+  namespace fs = boost::filesystem;
+  fs::path path = fs::temp_directory_path() / fs::unique_path();
+  glob::glob_writer writer;
+  writer.Add("*.pdf");
+  writer.Add("+([a-z]).@(txt|md)");
+  writer.Write(path.string());
+
+  {
+    glob::glob_file file(path.string());
+    auto g = file.Load(1);
+    ASSERT_TRUE(glob_match("abc.md", g));
+    ASSERT_FALSE(glob_match("abc.pdf", g));
+    ASSERT_THROW(file.Load(2), glob::Error);
+  }
+
+  fs::remove(path);
+  ASSERT_THROW(glob::glob_file(path.string()), glob::Error);
+}
+
+TEST(GlobSerialize, corrupted) {
+  glob::glob_writer writer;
+  writer.Add("[a-c]*x?(y|z)");
+  writer.Add("*(ab|+(c))d");
+  std::string data = writer.Data();
+
+  // any truncated file throws
+  for (size_t len = 0; len < data.size(); len++) {
+    ASSERT_THROW({
+      glob::glob_file file(data.data(), len);
+      file.LoadAll();
+    }, glob::Error) << len;
+  }
+
+  // a changed byte throws or gives a glob that still ends
+  for (size_t i = 0; i < data.size(); i++) {
+    for (unsigned char bit : {0x01, 0x04, 0x80}) {
+      std::string bad = data;
+      bad[i] = static_cast<char>(bad[i] ^ bit);
+      try {
+        glob::glob_file file(bad.data(), bad.size());
+        for (auto& g : file.LoadAll()) {
+          glob_match("abcxyd", g);
+          glob_match("ababccd", g);
+        }
+      } catch (glob::Error&) {
+      }
+    }
+  }
+
+  // a min_len shorter than the literals would make the prefilter read
+  // before the string, the record starts after the header and the table,
+  // with the pattern and the flags before the prefilter
+  glob::glob_writer literal_writer;
+  std::string pattern = "*abcdefgh";
+  literal_writer.Add(pattern);
+  std::string literal_data = literal_writer.Data();
+  size_t min_len_pos = glob::kGlobFileHeaderSize + 16 + 4 +
+      4 * pattern.size() + 4;
+  ASSERT_EQ(literal_data.substr(min_len_pos, 8),
+      std::string("\x08\0\0\0\0\0\0\0", 8));
+  literal_data.replace(min_len_pos, 8, 8, '\0');
+  glob::glob_file literal_file(literal_data.data(), literal_data.size());
+  ASSERT_THROW(literal_file.Load(0), glob::Error);
+}
+
+TEST(Arena, blocks) {
+  alignas(std::max_align_t) char buffer[64];
+  glob::Arena arena(buffer, sizeof(buffer), 128);
+
+  // the buffer is used before any block
+  char* c = arena.New<char>('a');
+  ASSERT_TRUE(c >= buffer && c < buffer + sizeof(buffer));
+  ASSERT_EQ(arena.NumBlocks(), 0u);
+
+  // the objects are aligned and don't overlap
+  std::vector<uint64_t*> values;
+  for (uint64_t i = 0; i < 100; i++) {
+    values.push_back(arena.New<uint64_t>(i));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(values.back()) % alignof(uint64_t),
+        0u);
+  }
+
+  for (uint64_t i = 0; i < 100; i++) {
+    ASSERT_EQ(*values[i], i);
+  }
+
+  // blocks double, so 800 bytes need few blocks
+  ASSERT_GT(arena.NumBlocks(), 0u);
+  ASSERT_LE(arena.NumBlocks(), 4u);
+  ASSERT_EQ(arena.Allocated(), 1 + 100 * sizeof(uint64_t));
+
+  // an object bigger than the block has its own block
+  char* big = static_cast<char*>(arena.Allocate(4096, 1));
+  big[4095] = 'x';
+  ASSERT_EQ(*c, 'a');
+}
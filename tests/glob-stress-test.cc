@@ -0,0 +1,115 @@
+#include <chrono>
+#include <string>
+#include <gtest/gtest.h>
+#include "glob-cpp/glob.h"
+
+// the number of steps of the automata is deterministic, so the bounds here
+// don't depend on the speed of the machine, each case checks the bound for
+// inputs of different sizes, so a change in the complexity is caught even
+// when the constant is small
+
+// the automata runs without the prefilter of the glob, that would reject most
+// of these strings before the automata
+size_t MatchSteps(const std::string& pattern, const std::string& str,
+    bool expected = false) {
+  glob::Lexer<char> l(pattern);
+  glob::Parser<char> p(l.Scanner());
+  auto ast_ptr = p.GenAst();
+  glob::AstOptimizer<char> ast_optimizer;
+  ast_optimizer.Optimize(ast_ptr.get());
+
+  glob::Automata<char> automata;
+  glob::AstConsumer<char> ast_consumer;
+  ast_consumer.GenAutomata(ast_ptr.get(), automata);
+
+  EXPECT_EQ(std::get<0>(automata.Exec(str)), expected) << pattern;
+  return automata.Steps();
+}
+
+TEST(GlobStress, many_stars) {
+  for (size_t n = 64; n <= 4096; n *= 8) {
+    std::string str(n, 'a');
+    ASSERT_LE(MatchSteps("*a*a*a*a*b", str), 2 * n + 16);
+    ASSERT_LE(MatchSteps("*a*b*a*b*a*b*c", str), 2 * n + 16);
+  }
+}
+
+TEST(GlobStress, many_stars_match) {
+  for (size_t n = 64; n <= 4096; n *= 8) {
+    std::string str = std::string(n, 'a') + "b";
+    ASSERT_LE(MatchSteps("*a*a*a*a*b", str, true), 2 * n + 16);
+  }
+}
+
+TEST(GlobStress, nested_star_groups) {
+  for (size_t n = 64; n <= 4096; n *= 8) {
+    std::string str = std::string(n, 'a') + "c";
+    ASSERT_LE(MatchSteps("*(*(a|aa))b", str), 4 * n + 16);
+    ASSERT_LE(MatchSteps("*(+(a|aa))b", str), 4 * n + 16);
+  }
+}
+
+TEST(GlobStress, overlapping_plus) {
+  for (size_t n = 64; n <= 4096; n *= 8) {
+    std::string str = std::string(n, 'a') + "b";
+    ASSERT_LE(MatchSteps("+(a|aa|aaa)", str), 4 * n + 16);
+    ASSERT_LE(MatchSteps("*(a|aa)+(a|b)b", str + "c"), 4 * n + 16);
+  }
+}
+
+TEST(GlobStress, huge_set) {
+  // a set is one state whatever its size, so a big set takes the same steps
+  // of a set of one item, the check of the items in each step is not counted
+  // by the steps and it is not bounded here
+  std::string set = "[";
+  for (int i = 0; i < 8; i++) {
+    for (char c = 'a'; c <= 'w'; c++) {
+      set += c;
+    }
+    set += "A-Z0-9";
+  }
+  set += "]";
+
+  for (size_t n = 64; n <= 4096; n *= 8) {
+    std::string str(n, 'a');
+    ASSERT_EQ(MatchSteps("*" + set + "x", str), MatchSteps("*[a]x", str));
+    ASSERT_EQ(MatchSteps("*" + set + set + set + "x", str),
+        MatchSteps("*[a][a][a]x", str));
+    ASSERT_LE(MatchSteps("*" + set + set + set + "x", str), 6 * n + 16);
+  }
+}
+
+// a star followed by a group checks the whole group on each char, this case
+// is quadratic, the bound documents it and catches anything worse
+TEST(GlobStress, star_before_group) {
+  for (size_t n = 64; n <= 512; n *= 2) {
+    std::string str(n, 'a');
+    ASSERT_LE(MatchSteps("*+(ab|a)*x", str), 3 * n * n);
+  }
+}
+
+TEST(GlobStress, step_budget) {
+  std::string str(512, 'a');
+  glob::glob g("*+(ab|a)*[xy]");
+  auto budget = glob::MatchBudget{}.SetMaxSteps(1000);
+  ASSERT_EQ(glob::glob_match(str, g, budget),
+      glob::MatchStatus::BUDGET_EXCEEDED);
+  ASSERT_LE(g.GetAutomata().Steps(), 1000u);
+
+  // the budget is for each match, the glob can be used again
+  ASSERT_EQ(glob::glob_match("aax", g, budget), glob::MatchStatus::MATCH);
+  ASSERT_EQ(glob::glob_match("aab", g, budget), glob::MatchStatus::NO_MATCH);
+  ASSERT_FALSE(glob::glob_match(str, g));
+}
+
+TEST(GlobStress, time_budget) {
+  std::string str(4096, 'a');
+  glob::glob g("*+(ab|a)*[xy]");
+  auto budget = glob::MatchBudget{}.SetTimeout(std::chrono::milliseconds(0));
+  ASSERT_EQ(glob::glob_match(str, g, budget),
+      glob::MatchStatus::BUDGET_EXCEEDED);
+
+  budget = glob::MatchBudget{}.SetDeadline(
+      glob::MatchBudget::Clock::now() + std::chrono::hours(1));
+  ASSERT_EQ(glob::glob_match("abx", g, budget), glob::MatchStatus::MATCH);
+}
@@ -0,0 +1,62 @@
+#include <string>
+#include <gtest/gtest.h>
+#include "glob-cpp/static-glob.h"
+
+#if __cplusplus >= 202002L
+
+// static globs are checked at compile time as well
+static_assert(glob::static_glob<"*.cc">::Match("main.cc"));
+static_assert(!glob::static_glob<"*.cc">::Match("main.h"));
+static_assert(glob::static_glob<"main.*">::Match("main.cc"));
+static_assert(glob::static_glob<"[a-z]*[!0-9].[ch]">::Match("foo.c"));
+static_assert(!glob::static_glob<"[a-z]*[!0-9].[ch]">::Match("foo1.c"));
+static_assert(glob::static_glob<"a**b">::NumItems() == 3);
+static_assert(glob::static_glob<"">::Match(""));
+static_assert(!glob::static_glob<"">::Match("a"));
+
+// each static glob must match the same strings of the dynamic glob
+template<glob::FixedString Pattern>
+void CheckStaticGlob(const std::vector<std::string>& strs) {
+  using StaticGlob = glob::static_glob<Pattern>;
+  glob::glob g(Pattern.value);
+  for (auto& str : strs) {
+    ASSERT_EQ(StaticGlob::Match(str), glob::glob_match(str, g))
+        << Pattern.value << " " << str;
+  }
+}
+
+TEST(StaticGlob, same_as_glob) {
+  std::vector<std::string> strs = {"", "a", "main.cc", "main.c", ".cc",
+      "file_42.c", "file_4.c", "abcabc", "a+b!c@d", "x-y", "[a]", "a*b",
+      "test.pdf", "ab", "aab", "ba"};
+
+  CheckStaticGlob<"main.cc">(strs);
+  CheckStaticGlob<"*.cc">(strs);
+  CheckStaticGlob<"main.*">(strs);
+  CheckStaticGlob<"*">(strs);
+  CheckStaticGlob<"?">(strs);
+  CheckStaticGlob<"*a*b">(strs);
+  CheckStaticGlob<"*_[0-9][0-9].?">(strs);
+  CheckStaticGlob<"file_[!a-z].[ch]">(strs);
+  CheckStaticGlob<"*abc*">(strs);
+  CheckStaticGlob<"a+b!c@d">(strs);
+  CheckStaticGlob<"x-y">(strs);
+  CheckStaticGlob<"\\[a\\]">(strs);
+  CheckStaticGlob<"a\\*b">(strs);
+  CheckStaticGlob<"[\\[]a[\\]]">(strs);
+  CheckStaticGlob<"[z-a]?">(strs);
+}
+
+TEST(StaticGlob, wide) {
+  ASSERT_TRUE(glob::static_glob<L"*.cc">::Match(L"main.cc"));
+  ASSERT_FALSE(glob::static_glob<L"*.cc">::Match(L"main.h"));
+  ASSERT_TRUE(glob::static_glob<L"[a-c]?x">::Match(L"bzx"));
+}
+
+TEST(StaticGlob, glob_match) {
+  glob::static_glob<"*.pdf"> g;
+  ASSERT_TRUE(glob::glob_match("test.pdf", g));
+  ASSERT_FALSE(glob::glob_match("test.txt", g));
+}
+
+#endif  // __cplusplus >= 202002L